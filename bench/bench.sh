@@ -0,0 +1,131 @@
+#!/bin/sh
+#
+# end to end throughput benchmark of hubic-backup against the local swift stand-in.
+#
+# usage : bench.sh [hubic-backup] [swift-standin]
+#
+# environment :
+#   BENCH_FILES   number of files of the synthetic tree (default 2000)
+#   BENCH_PORT    stand-in listening port (default 18080)
+#   BENCH_TLS     1 to run over https with a self signed certificate
+#   BENCH_ARGS    extra hubic-backup arguments (ex: "-k secret --http2")
+#   STANDIN_ARGS  extra stand-in arguments (ex: "--latency-ms 20 --bandwidth 10000000")
+#   BENCH_H2PROXY path of nghttpx : runs through it, https with h2 and http/1.1
+#                 ALPN in front of the stand-in. Requests and connections are
+#                 then the client side ones (the stand-in only sees the proxy)
+#
+
+set -e
+
+BIN=${1:-../src/hubic-backup}
+STANDIN=${2:-./swift-standin}
+FILES=${BENCH_FILES:-2000}
+PORT=${BENCH_PORT:-18080}
+
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/hubic-bench.XXXXXX")
+STANDIN_PID=
+PROXY_PID=
+cleanup() {
+	[ -n "$PROXY_PID" ] && kill "$PROXY_PID" 2>/dev/null
+	[ -n "$STANDIN_PID" ] && kill "$STANDIN_PID" 2>/dev/null
+	rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+# --- synthetic tree -------------------------------------------------------
+# 100 files per folder. Mostly small files, one 1MB file every 16 files.
+echo "generating $FILES files in $WORK/src"
+i=0
+while [ $i -lt "$FILES" ]; do
+	dir="$WORK/src/d$((i / 100))"
+	[ $((i % 100)) -eq 0 ] && mkdir -p "$dir"
+	if [ $((i % 16)) -eq 0 ]; then size=1048576; else size=$(( (i % 4 + 1) * 4096 )); fi
+	head -c $size /dev/urandom > "$dir/f$i"
+	i=$((i + 1))
+done
+TOTAL_BYTES=$(du -sb "$WORK/src" | cut -f1)
+
+# --- stand-in -------------------------------------------------------------
+SCHEME=http
+TLS_ARGS=
+if [ "$BENCH_TLS" = "1" ] || [ -n "$BENCH_H2PROXY" ]; then
+	openssl req -x509 -newkey rsa:2048 -nodes -subj /CN=127.0.0.1 -days 1 \
+		-keyout "$WORK/key.pem" -out "$WORK/cert.pem" >/dev/null 2>&1
+	SCHEME=https
+	TLS_ARGS="--tls-cert $WORK/cert.pem --tls-key $WORK/key.pem"
+fi
+
+URL="$SCHEME://127.0.0.1:$PORT"
+STATS_URL=$URL
+LOG_LEVEL=warning
+if [ -n "$BENCH_H2PROXY" ]; then
+	# the proxy listens on PORT, the stand-in behind it on PORT + 1 in clear
+	"$STANDIN" --port $((PORT + 1)) $STANDIN_ARGS 2>"$WORK/standin.log" &
+	STANDIN_PID=$!
+	"$BENCH_H2PROXY" --frontend="127.0.0.1,$PORT" --backend="127.0.0.1,$((PORT + 1))" \
+		--workers=2 --backend-connections-per-host=64 --no-via --no-ocsp \
+		--errorlog-file="$WORK/proxy.log" "$WORK/key.pem" "$WORK/cert.pem" &
+	PROXY_PID=$!
+	STATS_URL="http://127.0.0.1:$((PORT + 1))"
+	LOG_LEVEL=info # for the client side request and connection counts
+else
+	"$STANDIN" --port "$PORT" $TLS_ARGS $STANDIN_ARGS 2>"$WORK/standin.log" &
+	STANDIN_PID=$!
+fi
+sleep 1
+
+stat_field() {
+	sed -n "s/.*\"$1\":\([0-9]*\).*/\1/p" "$WORK/stats.json"
+}
+
+run() {
+	name=$1
+	shift
+	curl -sk -X DELETE "$STATS_URL/_stats" >/dev/null
+	start=$(date +%s.%N)
+	"$BIN" --auth-token bench --auth-endpoint "$URL/v1/AUTH_bench" \
+		-i "$WORK/src" -o bench --state-dir "$WORK/state" --loglevel $LOG_LEVEL $BENCH_ARGS "$@" >"$WORK/$name.log" 2>&1 \
+		|| { echo "$name run failed :"; cat "$WORK/$name.log"; exit 1; }
+	end=$(date +%s.%N)
+	curl -sk "$STATS_URL/_stats" >"$WORK/stats.json"
+
+	requests=$(stat_field requests)
+	connections=$(stat_field connections)
+	if [ -n "$BENCH_H2PROXY" ]; then
+		requests=$(sed -n 's/.* \([0-9]*\) http request(s) using [0-9]* connection(s).*/\1/p' "$WORK/$name.log")
+		connections=$(sed -n 's/.* [0-9]* http request(s) using \([0-9]*\) connection(s).*/\1/p' "$WORK/$name.log")
+	fi
+
+	awk -v name="$name" -v files="$FILES" -v bytes="$(stat_field bytes_in)" -v total="$TOTAL_BYTES" \
+		-v requests="$requests" -v connections="$connections" \
+		-v start="$start" -v end="$end" 'BEGIN {
+		t = end - start; if (t <= 0) t = 0.001;
+		printf "%-12s %8.2f s %10.1f files/s %8.2f MB/s sent %8.1f req/s %6d requests %4d connections\n",
+			name, t, files / t, bytes / t / 1048576, requests / t, requests, connections
+	}'
+}
+
+echo "tree : $FILES files, $TOTAL_BYTES bytes. endpoint : $URL. args : $BENCH_ARGS"
+run full
+run incremental
+
+# rewrite one file out of ten
+i=0
+while [ $i -lt "$FILES" ]; do
+	f="$WORK/src/d$((i / 100))/f$i"
+	head -c "$(wc -c < "$f")" /dev/urandom > "$f"
+	i=$((i + 10))
+done
+run modified
+
+# move a folder : big files are copied server side
+mv "$WORK/src/d1" "$WORK/src/moved"
+run moved -d
+
+# remove a tenth of the folders
+i=0
+while [ $i -lt "$FILES" ]; do
+	rm -rf "$WORK/src/d$((i / 100))"
+	i=$((i + 1000))
+done
+run deleted -d
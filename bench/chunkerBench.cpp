@@ -0,0 +1,85 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+/*
+
+Throughput of the content defined chunker, and of the sha256 used to name
+chunks, on random data :
+
+	chunker-bench [MB]
+
+*/
+
+#include "../src/chunker.h"
+#include <openssl/evp.h>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char ** argv)
+{
+	const std::size_t size = ((argc > 1) ? atoi(argv[1]) : 512) * std::size_t(1024 * 1024);
+	std::vector<uint8_t> data(size);
+	std::mt19937_64 random(42);
+	for (std::size_t i=0; i + 8 <= size; i += 8) {
+		const uint64_t v = random();
+		memcpy(data.data() + i, &v, 8);
+	}
+
+	const CChunker chunker;
+	std::size_t chunkCount(0), minLen(size), maxLen(0);
+
+	auto start = std::chrono::steady_clock::now();
+	for (std::size_t pos = 0; pos < size; ) {
+		const std::size_t len = chunker.next(data.data() + pos, size - pos);
+		pos += len;
+		chunkCount++;
+		if (pos < size) { // the last chunk is truncated
+			minLen = std::min(minLen, len);
+			maxLen = std::max(maxLen, len);
+		}
+	}
+	const double chunkSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	start = std::chrono::steady_clock::now();
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int digestLen(0);
+	for (std::size_t pos = 0; pos < size; pos += chunkAvgSize)
+		EVP_Digest(data.data() + pos, std::min(chunkAvgSize, size - pos), digest, &digestLen, EVP_sha256(), nullptr);
+	const double hashSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	const double mb = double(size) / (1024 * 1024);
+	std::cout
+		<< "data          : " << mb << " MB" << std::endl
+		<< "chunks        : " << chunkCount << " (avg " << size / chunkCount / 1024 << " KB, min " << minLen / 1024 << " KB, max " << maxLen / 1024 << " KB)" << std::endl
+		<< "chunker       : " << mb / chunkSeconds << " MB/s" << std::endl
+		<< "sha256        : " << mb / hashSeconds << " MB/s" << std::endl;
+
+	return EXIT_SUCCESS;
+}
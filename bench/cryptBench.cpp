@@ -0,0 +1,111 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+/*
+
+Encryption throughput of the default aes-256-cbc format, which is serial by
+nature, and of the gcm1 format on 1 to N threads :
+
+	crypt-bench [MB]
+
+*/
+
+#include "../src/crypto.h"
+#include "../src/cryptGcm.h"
+#include "../src/common.h"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static const std::string password("crypt-bench");
+
+// both engines are fed the way the uploader feeds them
+static double cbcSeconds(const std::vector<uint8_t> & data)
+{
+	CCryptoContext * ctx = CCryptoContext::create(password);
+	CCryptEngine engine;
+	std::vector<uint8_t> crypted;
+
+	const auto start = std::chrono::steady_clock::now();
+	engine.encryptStart(crypted, ctx);
+	for (std::size_t pos = 0; pos < data.size(); pos += compressSampleSize)
+		engine.update(crypted, data.data() + pos, std::min(compressSampleSize, data.size() - pos));
+	engine.finalize(crypted);
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	delete ctx;
+	return seconds;
+}
+
+static double gcmSeconds(const std::vector<uint8_t> & data, int numThread)
+{
+	CGcmCryptEngine engine(numThread);
+	std::vector<uint8_t> crypted;
+	engine.encryptStart(crypted, password); // key derivation is cached, out of the measure
+
+	const std::size_t step = gcmChunkSize * numThread;
+	const auto start = std::chrono::steady_clock::now();
+	engine.encryptStart(crypted, password);
+	for (std::size_t pos = 0; pos < data.size(); pos += step)
+		engine.update(crypted, data.data() + pos, std::min(step, data.size() - pos));
+	engine.finalize(crypted);
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char ** argv)
+{
+	auto console = spdlog::stderr_logger_mt(configConsoleName);
+
+	const std::size_t size = ((argc > 1) ? atoi(argv[1]) : 512) * std::size_t(1024 * 1024);
+	std::vector<uint8_t> data(size);
+	std::mt19937_64 random(42);
+	for (std::size_t i=0; i + 8 <= size; i += 8) {
+		const uint64_t v = random();
+		memcpy(data.data() + i, &v, 8);
+	}
+
+	const double mb = double(size) / (1024 * 1024);
+	std::cout
+		<< "data          : " << mb << " MB" << std::endl
+		<< "cbc           : " << mb / cbcSeconds(data) << " MB/s" << std::endl;
+
+	const int hw = std::max(1u, std::thread::hardware_concurrency());
+	double single(0);
+	for (int n = 1; ; n = std::min(n * 2, hw)) {
+		const double rate = mb / gcmSeconds(data, n);
+		if (n == 1)
+			single = rate;
+		std::cout << "gcm " << n << " thread(s) : " << rate << " MB/s (x" << rate / single << ", " << rate / n << " MB/s per thread)" << std::endl;
+		if (n == hw)
+			break;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,189 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+/*
+
+Reads a large file and a small file corpus, cold, with fread as the md5 pass
+and the uploads did, then with each engine of CFileReader. One file at a
+time first, then 16 files at once as the md5 lanes do. The contents are
+checked by xxh64 against the fread pass :
+
+	io-bench [--dir D] [--depth N]
+
+The corpora are written in D (default the current folder) and removed at
+the end. Pages are dropped with posix_fadvise before each pass.
+
+*/
+
+#include "../src/fileReader.h"
+#include "../src/xxh64.h"
+#include "../src/common.h"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <fcntl.h>
+#include <cstdlib>
+#include <cstring>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static std::vector<std::string> makeCorpus(const std::string & dir, std::size_t count, std::size_t size, std::mt19937_64 & random)
+{
+	std::vector<std::string> files;
+	std::vector<uint8_t> data(size);
+	for (std::size_t n = 0; n < count; n++) {
+		for (std::size_t i = 0; i + 8 <= size; i += 8) {
+			const uint64_t v = random();
+			memcpy(data.data() + i, &v, 8);
+		}
+		files.push_back(fmt::format("{}/f{}", dir, n));
+		FILE * f = fopen(files.back().c_str(), "wb");
+		fwrite(data.data(), 1, data.size(), f);
+		fflush(f);
+		fdatasync(fileno(f));
+		fclose(f);
+	}
+	return files;
+}
+
+static void dropPages(const std::vector<std::string> & files)
+{
+	for (const auto & path : files) {
+		const int fd = open(path.c_str(), O_RDONLY);
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+}
+
+static uint64_t readFread(const std::vector<std::string> & files)
+{
+	uint64_t sum(0);
+	std::vector<uint8_t> buffer(1024*1024);
+	for (const auto & path : files) {
+		FILE * f = fopen(path.c_str(), "rb");
+		CXxh64 h;
+		std::size_t n;
+		while ((n = fread(buffer.data(), 1, buffer.size(), f)) > 0)
+			h.feed(buffer.data(), n);
+		fclose(f);
+		sum += h.digest();
+	}
+	return sum;
+}
+
+// 'slots' files read at once, one piece of each in turn
+static uint64_t readEngine(EIoEngine e, std::size_t depth, std::size_t slots, const std::vector<std::string> & files)
+{
+	CFileReader reader(e, depth, 256 * 1024, slots);
+	std::vector<int> open(slots, -1);
+	std::vector<CXxh64> h(slots);
+	uint64_t sum(0);
+	std::size_t next(0), busy(0);
+	do {
+		for (std::size_t i = 0; i < slots; i++)
+			if ((open[i] < 0) && (next < files.size())) {
+				open[i] = reader.open(files[next++]);
+				h[i] = CXxh64();
+				busy++;
+			}
+
+		for (std::size_t i = 0; i < slots; i++) {
+			if (open[i] < 0)
+				continue;
+			const uint8_t * data;
+			std::size_t len;
+			if (!reader.next(open[i], data, len))
+				return 0;
+			h[i].feed(data, len);
+			if (reader.eof(open[i])) {
+				reader.close(open[i]);
+				open[i] = -1;
+				sum += h[i].digest();
+				busy--;
+			}
+		}
+	} while ((next < files.size()) || (busy > 0));
+	return sum;
+}
+
+static void run(const std::string & name, const std::vector<std::string> & files, std::size_t size, std::size_t depth)
+{
+	const double mb = double(files.size() * size) / (1024 * 1024);
+	auto rate = [&](std::chrono::steady_clock::time_point start) {
+		const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return fmt::format("{:8.1f} MB/s {:9.0f} files/s", mb / s, files.size() / s);
+	};
+
+	std::cout << name << " : " << files.size() << " x " << size / 1024 << " Ko" << std::endl;
+	dropPages(files);
+	auto start = std::chrono::steady_clock::now();
+	const uint64_t ref = readFread(files);
+	std::cout << "  fread              " << rate(start) << std::endl;
+
+	for (auto e : { EIoEngine::sync, EIoEngine::threads, EIoEngine::uring }) {
+		if (!CFileReader::supported(e))
+			continue;
+		for (std::size_t slots : { 1, 16 }) {
+			dropPages(files);
+			start = std::chrono::steady_clock::now();
+			const uint64_t sum = readEngine(e, depth, slots, files);
+			std::cout << "  " << fmt::format("{:<8} x{:<2}", CFileReader::engineName(e), slots) << "       " << rate(start)
+				<< ((sum == ref) ? "" : "  CONTENT MISMATCH") << std::endl;
+		}
+	}
+}
+
+int main(int argc, char ** argv)
+{
+	auto console = spdlog::stderr_logger_mt(configConsoleName);
+
+	std::string dir(".");
+	std::size_t depth(8);
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "--dir") == 0)
+			dir = argv[i + 1];
+		else if (strcmp(argv[i], "--depth") == 0)
+			depth = atoi(argv[i + 1]);
+	}
+
+	std::string tmp = dir + "/io-bench-XXXXXX";
+	if (mkdtemp(&tmp[0]) == nullptr) {
+		std::cout << "can't create a folder in " << dir << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::mt19937_64 random(42);
+	const auto large = makeCorpus(tmp, 4, 64 * 1024 * 1024, random);
+	run("large files", large, 64 * 1024 * 1024, depth);
+	for (const auto & f : large)
+		unlink(f.c_str());
+
+	const auto small = makeCorpus(tmp, 4000, 16 * 1024, random);
+	run("small files", small, 16 * 1024, depth);
+	for (const auto & f : small)
+		unlink(f.c_str());
+
+	rmdir(tmp.c_str());
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+/*
+
+Checks the multi buffer md5 engines against openssl, bit for bit, then
+compares their aggregate throughput with the scalar openssl md5 used for
+one file, and with the xxh64 of --fingerprint-fast :
+
+	md5-bench [MB]
+
+*/
+
+#include "../src/md5Multi.h"
+#include "../src/xxh64.h"
+#include "../src/common.h"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// random lengths around the block and padding limits, fed by random pieces
+static bool check(NMD5::EEngine e, std::mt19937_64 & random)
+{
+	NMD5::CMultiComputer c(e);
+	const std::size_t lanes = c.laneCount();
+	for (int round = 0; round < 200; round++)
+	{
+		std::vector<std::vector<uint8_t>> datas(lanes);
+		for (auto & d : datas) {
+			d.resize((round < 130) ? (round + random() % 3) : (random() % 300000));
+			for (auto & b : d)
+				b = static_cast<uint8_t>(random());
+		}
+
+		std::vector<std::size_t> pos(lanes, 0);
+		for (std::size_t i = 0; i < lanes; i++)
+			c.init(i);
+		for (bool bMore = true; bMore; ) {
+			bMore = false;
+			for (std::size_t i = 0; i < lanes; i++) {
+				const std::size_t n = std::min(datas[i].size() - pos[i], static_cast<std::size_t>(random() % 70000));
+				c.feed(i, datas[i].data() + pos[i], n);
+				pos[i] += n;
+				bMore |= (pos[i] < datas[i].size());
+			}
+			c.update();
+		}
+		for (std::size_t i = 0; i < lanes; i++)
+			if (c.done(i) != NMD5::computeMd5(datas[i])) {
+				std::cout << NMD5::CMultiComputer::engineName(e) << " : md5 mismatch, length " << datas[i].size() << std::endl;
+				return false;
+			}
+	}
+	return true;
+}
+
+int main(int argc, char ** argv)
+{
+	auto console = spdlog::stderr_logger_mt(configConsoleName);
+
+	std::mt19937_64 random(42);
+	for (auto e : NMD5::CMultiComputer::supportedEngines())
+		if (!check(e, random))
+			return EXIT_FAILURE;
+	std::cout << "engines match openssl md5" << std::endl;
+
+	const std::size_t size = ((argc > 1) ? atoi(argv[1]) : 256) * std::size_t(1024 * 1024);
+	std::vector<uint8_t> data(size);
+	for (std::size_t i=0; i + 8 <= size; i += 8) {
+		const uint64_t v = random();
+		memcpy(data.data() + i, &v, 8);
+	}
+
+	const double mb = double(size) / (1024 * 1024);
+	auto start = std::chrono::steady_clock::now();
+	NMD5::computeMd5(data);
+	const double scalar = mb / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "openssl       : " << scalar << " MB/s" << std::endl;
+
+	start = std::chrono::steady_clock::now();
+	CXxh64::compute(data.data(), data.size());
+	const double xxh = mb / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "xxh64         : " << xxh << " MB/s (x" << xxh / scalar << ")" << std::endl;
+
+	// the same data split in one stream per lane, fed by 1 Mo pieces
+	for (auto e : NMD5::CMultiComputer::supportedEngines())
+	{
+		NMD5::CMultiComputer c(e);
+		const std::size_t lanes = c.laneCount();
+		const std::size_t streamSize = size / lanes;
+
+		start = std::chrono::steady_clock::now();
+		for (std::size_t i = 0; i < lanes; i++)
+			c.init(i);
+		for (std::size_t pos = 0; pos < streamSize; pos += 1024 * 1024) {
+			for (std::size_t i = 0; i < lanes; i++)
+				c.feed(i, data.data() + i * streamSize + pos, std::min<std::size_t>(1024 * 1024, streamSize - pos));
+			c.update();
+		}
+		for (std::size_t i = 0; i < lanes; i++)
+			c.done(i);
+		const double rate = mb / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::cout << NMD5::CMultiComputer::engineName(e) << " x" << lanes << std::string(12 - strlen(NMD5::CMultiComputer::engineName(e)) - std::to_string(lanes).size(), ' ')
+			<< ": " << rate << " MB/s (x" << rate / scalar << ")" << std::endl;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,1114 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+/*
+
+Local in memory stand-in for the subset of the hubiC / openstack swift API
+used by hubic-backup. Used by 'make bench' and to reproduce issues without
+a hubiC account :
+
+	swift-standin --port 18080 &
+	hubic-backup --auth-token x --auth-endpoint http://127.0.0.1:18080/v1/AUTH_bench ...
+
+'GET /_stats' returns the server counters as json.
+
+*/
+
+#include "../src/common.h"
+
+#include <random>
+#include <csignal>
+#include <cerrno>
+#include <cerrno>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <openssl/md5.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct CSettings
+{
+	CSettings()
+	:	_port(8080)
+	,	_latencyMs(0)
+	,	_bandwidth(0)
+	,	_errorRate(0.0)
+	,	_errorCode(500)
+	,	_listingLimit(10000)
+	,	_bulkDelete(true)
+	,	_bulkUpload(true)
+	{}
+
+	int         _port;
+	uint64_t    _latencyMs;    // added to each request
+	uint64_t    _bandwidth;    // bytes/s shared by all connections. 0 = unlimited
+	double      _errorRate;    // probability of an injected error
+	int         _errorCode;    // http code of injected errors
+	std::string _token;        // expected X-Auth-Token. Empty = any
+	std::string _tlsCert;
+	std::string _tlsKey;
+	std::size_t _listingLimit; // swift default page size
+	bool        _bulkDelete;   // advertise and accept ?bulk-delete
+	bool        _bulkUpload;   // advertise and accept ?extract-archive=tar
+};
+
+static CSettings s_settings;
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct CStats
+{
+	CStats() { reset(); }
+	void reset();
+	std::string json() const;
+
+	std::atomic<uint64_t> _connections;
+	std::atomic<uint64_t> _tlsHandshakes;
+	std::atomic<uint64_t> _tlsResumed;
+	std::atomic<uint64_t> _requests;
+	std::atomic<uint64_t> _get;
+	std::atomic<uint64_t> _head;
+	std::atomic<uint64_t> _put;
+	std::atomic<uint64_t> _post;
+	std::atomic<uint64_t> _delete;
+	std::atomic<uint64_t> _bulkDelete;
+	std::atomic<uint64_t> _extractArchive;
+	std::atomic<uint64_t> _copy;
+	std::atomic<uint64_t> _injectedErrors;
+	std::atomic<uint64_t> _bytesIn;
+	std::atomic<uint64_t> _bytesOut;
+};
+
+static CStats s_stats;
+
+void CStats::reset()
+{
+	_connections = _tlsHandshakes = _tlsResumed = 0;
+	_requests = _get = _head = _put = _post = _delete = _bulkDelete = _extractArchive = _copy = 0;
+	_injectedErrors = 0;
+	_bytesIn = _bytesOut = 0;
+}
+
+std::string CStats::json() const
+{
+	return fmt::format(
+		"{{\"connections\":{},\"tls_handshakes\":{},\"tls_resumed\":{},\"requests\":{},"
+		"\"get\":{},\"head\":{},\"put\":{},\"post\":{},\"delete\":{},\"bulk_delete\":{},\"extract_archive\":{},\"copy\":{},"
+		"\"injected_errors\":{},\"bytes_in\":{},\"bytes_out\":{}}}\n",
+		_connections.load(), _tlsHandshakes.load(), _tlsResumed.load(), _requests.load(),
+		_get.load(), _head.load(), _put.load(), _post.load(), _delete.load(), _bulkDelete.load(), _extractArchive.load(), _copy.load(),
+		_injectedErrors.load(), _bytesIn.load(), _bytesOut.load()
+	);
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+//- emulates a link of limited bandwidth shared by all connections
+
+class CBandwidth
+{
+public:
+	CBandwidth() : _next(std::chrono::steady_clock::now()) {}
+	void consume(uint64_t byteCount);
+
+private:
+	std::mutex _m;
+	std::chrono::steady_clock::time_point _next;
+};
+
+static CBandwidth s_bandwidth;
+
+void CBandwidth::consume(uint64_t byteCount)
+{
+	if ((s_settings._bandwidth == 0) || (byteCount == 0))
+		return;
+
+	const auto duration = std::chrono::microseconds( (1000000 * byteCount) / s_settings._bandwidth );
+	std::chrono::steady_clock::time_point until;
+	{
+		std::lock_guard<std::mutex> lock(_m);
+		const auto now = std::chrono::steady_clock::now();
+		if (_next < now)
+			_next = now;
+		_next += duration;
+		until = _next;
+	}
+	std::this_thread::sleep_until(until);
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct CObject
+{
+	std::string _data;
+	std::string _etag;
+	std::string _contentType;
+	std::map<std::string, std::string> _meta; // lower case key -> value
+	std::time_t _lastModified;
+};
+
+class CStore
+{
+public:
+	bool get(const std::string & key, CObject & o);
+	void put(const std::string & key, const CObject & o);
+	bool setMeta(const std::string & key, const std::map<std::string, std::string> & meta);
+	bool erase(const std::string & key);
+	std::vector<std::pair<std::string, CObject>> list(const std::string & container, const std::string & prefix, const std::string & marker, bool bWithData);
+
+private:
+	std::mutex _m;
+	std::map<std::string, CObject> _objects; // "container/object"
+};
+
+static CStore s_store;
+
+bool CStore::get(const std::string & key, CObject & o)
+{
+	std::lock_guard<std::mutex> lock(_m);
+	auto i = _objects.find(key);
+	if (i == _objects.end())
+		return false;
+	o = i->second;
+	return true;
+}
+
+void CStore::put(const std::string & key, const CObject & o)
+{
+	std::lock_guard<std::mutex> lock(_m);
+	_objects[key] = o;
+}
+
+bool CStore::setMeta(const std::string & key, const std::map<std::string, std::string> & meta)
+{
+	std::lock_guard<std::mutex> lock(_m);
+	auto i = _objects.find(key);
+	if (i == _objects.end())
+		return false;
+	i->second._meta = meta;
+	return true;
+}
+
+bool CStore::erase(const std::string & key)
+{
+	std::lock_guard<std::mutex> lock(_m);
+	return _objects.erase(key) > 0;
+}
+
+std::vector<std::pair<std::string, CObject>> CStore::list(const std::string & container, const std::string & prefix, const std::string & marker, bool bWithData)
+{
+	std::vector<std::pair<std::string, CObject>> res;
+	const std::string start = container + "/" + std::max(prefix, marker);
+
+	std::lock_guard<std::mutex> lock(_m);
+	for (auto i = _objects.lower_bound(start); i != _objects.end(); ++i)
+	{
+		if (!boost::algorithm::starts_with(i->first, container + "/" + prefix))
+			break;
+
+		const std::string name = i->first.substr(container.length() + 1);
+		if (name <= marker)
+			continue;
+
+		CObject o;
+		if (bWithData)
+			o = i->second;
+		else {
+			o._etag = i->second._etag;
+			o._contentType = i->second._contentType;
+			o._lastModified = i->second._lastModified;
+			o._data.clear();
+			o._meta[":bytes"] = fmt::format("{}", i->second._data.size());
+		}
+		res.push_back(std::make_pair(name, o));
+	}
+	return res;
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static std::string md5Hex(const std::string & data)
+{
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+	unsigned char d[MD5_DIGEST_LENGTH];
+	MD5(reinterpret_cast<const unsigned char*>(data.data()), data.size(), d);
+#pragma GCC diagnostic pop
+	std::string res;
+	for (int i=0; i<MD5_DIGEST_LENGTH; ++i)
+		res += fmt::format("{:02x}", static_cast<int>(d[i]));
+	return res;
+}
+
+static std::string urlDecode(const std::string & s)
+{
+	std::string res;
+	for (std::size_t i=0; i<s.length(); ++i) {
+		if ((s[i] == '%') && (i + 2 < s.length()) && isxdigit(s[i+1]) && isxdigit(s[i+2])) {
+			res += static_cast<char>(std::stoi(s.substr(i+1, 2), nullptr, 16));
+			i += 2;
+		} else if (s[i] == '+') {
+			res += ' ';
+		} else {
+			res += s[i];
+		}
+	}
+	return res;
+}
+
+// numbers sent by clients : false when empty, signed, not a number or out of range
+static bool parseNumber(const std::string & s, int base, uint64_t & v)
+{
+	if (s.empty() || !isxdigit(static_cast<unsigned char>(s[0])))
+		return false;
+
+	char * end(nullptr);
+	errno = 0;
+	v = strtoull(s.c_str(), &end, base);
+	return (errno == 0) && (*end == '\0');
+}
+
+static std::string jsonEscape(const std::string & s)
+{
+	std::string res;
+	for (const char c : s) {
+		switch (c) {
+			case '"' : res += "\\\""; break;
+			case '\\': res += "\\\\"; break;
+			case '\n': res += "\\n"; break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20)
+					res += fmt::format("\\u{:04x}", static_cast<int>(c));
+				else
+					res += c;
+		}
+	}
+	return res;
+}
+
+static std::string httpDate(std::time_t t)
+{
+	char buf[64];
+	struct tm tm;
+	gmtime_r(&t, &tm);
+	strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+	return buf;
+}
+
+static std::string isoDate(std::time_t t)
+{
+	char buf[64];
+	struct tm tm;
+	gmtime_r(&t, &tm);
+	strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S.000000", &tm);
+	return buf;
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CConnection
+{
+public:
+	CConnection(int fd, SSL_CTX * sslCtx);
+	~CConnection();
+
+public:
+	bool handshake();
+	bool readLine(std::string & line);
+	bool read(std::string & dst, std::size_t len);
+	bool write(const std::string & data);
+
+private:
+	bool fill();
+
+private:
+	int         _fd;
+	SSL       * _ssl;
+	std::string _buffer;
+};
+
+CConnection::CConnection(int fd, SSL_CTX * sslCtx)
+:	_fd(fd)
+,	_ssl(nullptr)
+{
+	if (sslCtx) {
+		_ssl = SSL_new(sslCtx);
+		SSL_set_fd(_ssl, _fd);
+	}
+}
+
+CConnection::~CConnection()
+{
+	if (_ssl) {
+		SSL_shutdown(_ssl);
+		SSL_free(_ssl);
+	}
+	close(_fd);
+}
+
+bool CConnection::handshake()
+{
+	if (!_ssl)
+		return true;
+
+	if (SSL_accept(_ssl) <= 0)
+		return false;
+
+	s_stats._tlsHandshakes++;
+	if (SSL_session_reused(_ssl))
+		s_stats._tlsResumed++;
+	return true;
+}
+
+bool CConnection::fill()
+{
+	char buf[64*1024];
+	const int n = _ssl ? SSL_read(_ssl, buf, sizeof(buf)) : static_cast<int>(recv(_fd, buf, sizeof(buf), 0));
+	if (n <= 0)
+		return false;
+
+	_buffer.append(buf, n);
+	s_stats._bytesIn += n;
+	s_bandwidth.consume(n);
+	return true;
+}
+
+bool CConnection::readLine(std::string & line)
+{
+	std::string::size_type i;
+	while ((i = _buffer.find("\r\n")) == std::string::npos)
+		if (!fill())
+			return false;
+
+	line = _buffer.substr(0, i);
+	_buffer.erase(0, i + 2);
+	return true;
+}
+
+bool CConnection::read(std::string & dst, std::size_t len)
+{
+	while (_buffer.length() < len)
+		if (!fill())
+			return false;
+
+	dst.append(_buffer, 0, len);
+	_buffer.erase(0, len);
+	return true;
+}
+
+bool CConnection::write(const std::string & data)
+{
+	std::size_t done(0);
+	while (done < data.length())
+	{
+		const std::size_t len = std::min<std::size_t>(data.length() - done, 64*1024);
+		const int n = _ssl ? SSL_write(_ssl, data.data() + done, static_cast<int>(len)) : static_cast<int>(send(_fd, data.data() + done, len, MSG_NOSIGNAL));
+		if (n <= 0)
+			return false;
+		s_bandwidth.consume(n);
+		s_stats._bytesOut += n;
+		done += n;
+	}
+	return true;
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct CHttpRequest
+{
+	std::string _method;
+	std::string _path;    // decoded
+	std::map<std::string, std::string> _query;   // decoded
+	std::map<std::string, std::string> _headers; // lower case key
+	std::string _body;
+	bool        _keepAlive;
+	bool        _bBadFraming; // the body length can't be parsed : answered 400, then closed
+
+	std::string header(const std::string & k) const {
+		auto i = _headers.find(k);
+		return (i == _headers.end()) ? std::string() : i->second;
+	}
+	std::string query(const std::string & k) const {
+		auto i = _query.find(k);
+		return (i == _query.end()) ? std::string() : i->second;
+	}
+	bool hasQuery(const std::string & k) const { return _query.find(k) != _query.end(); }
+};
+
+struct CHttpResponse
+{
+	CHttpResponse(int code = 200) : _code(code), _contentLength(-1) {}
+	void add(const std::string & k, const std::string & v) { _headers.push_back(std::make_pair(k, v)); }
+
+	int         _code;
+	std::vector<std::pair<std::string, std::string>> _headers;
+	std::string _body;
+	int64_t     _contentLength; // HEAD : length of the object. -1 = body length
+};
+
+static std::string statusText(int code)
+{
+	switch (code) {
+		case 100: return "Continue";
+		case 200: return "OK";
+		case 201: return "Created";
+		case 202: return "Accepted";
+		case 204: return "No Content";
+		case 400: return "Bad Request";
+		case 401: return "Unauthorized";
+		case 404: return "Not Found";
+		case 405: return "Method Not Allowed";
+		case 411: return "Length Required";
+		case 500: return "Internal Server Error";
+		case 503: return "Service Unavailable";
+		default : return "Unknown";
+	}
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CSwiftServer
+{
+public:
+	CSwiftServer();
+	~CSwiftServer();
+	bool start();
+
+private:
+	void acceptLoop();
+	void serve(int fd);
+	bool readRequest(CConnection & c, CHttpRequest & rq);
+	bool injectError();
+	CHttpResponse handle(const CHttpRequest & rq);
+	CHttpResponse handleBulkDelete(const CHttpRequest & rq);
+	CHttpResponse handleExtractArchive(const CHttpRequest & rq, const std::string & container, const std::string & prefix);
+	CHttpResponse handleListing(const CHttpRequest & rq, const std::string & container);
+	CHttpResponse handleObject(const CHttpRequest & rq, const std::string & container, const std::string & object);
+
+private:
+	int        _fd;
+	SSL_CTX  * _sslCtx;
+	std::thread _thread;
+	std::mutex _randomMutex;
+	std::mt19937 _random;
+};
+
+CSwiftServer::CSwiftServer()
+:	_fd(-1)
+,	_sslCtx(nullptr)
+,	_random(std::random_device()())
+{
+}
+
+CSwiftServer::~CSwiftServer()
+{
+	if (_thread.joinable())
+		_thread.detach();
+	if (_sslCtx)
+		SSL_CTX_free(_sslCtx);
+}
+
+bool CSwiftServer::start()
+{
+	if (!s_settings._tlsCert.empty()) {
+		SSL_library_init();
+		SSL_load_error_strings();
+		_sslCtx = SSL_CTX_new(SSLv23_server_method());
+		if ((!_sslCtx) ||
+			(SSL_CTX_use_certificate_file(_sslCtx, s_settings._tlsCert.c_str(), SSL_FILETYPE_PEM) <= 0) ||
+			(SSL_CTX_use_PrivateKey_file(_sslCtx, s_settings._tlsKey.c_str(), SSL_FILETYPE_PEM) <= 0))
+		{
+			ERR_print_errors_fp(stderr);
+			return false;
+		}
+		SSL_CTX_set_session_cache_mode(_sslCtx, SSL_SESS_CACHE_SERVER);
+	}
+
+	_fd = socket(AF_INET, SOCK_STREAM, 0);
+	const int one = 1;
+	setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(s_settings._port);
+	if ((bind(_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) || (listen(_fd, 128) < 0)) {
+		LOGE("can't listen on port {} : {}", s_settings._port, strerror(errno));
+		return false;
+	}
+
+	_thread = std::thread(&CSwiftServer::acceptLoop, this);
+	return true;
+}
+
+void CSwiftServer::acceptLoop()
+{
+	for (;;)
+	{
+		const int fd = accept(_fd, nullptr, nullptr);
+		if (fd < 0)
+			continue;
+
+		const int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		s_stats._connections++;
+		std::thread(&CSwiftServer::serve, this, fd).detach();
+	}
+}
+
+bool CSwiftServer::readRequest(CConnection & c, CHttpRequest & rq)
+{
+	std::string line;
+	do {
+		if (!c.readLine(line))
+			return false;
+	} while (line.empty());
+
+	std::vector<std::string> parts;
+	boost::algorithm::split(parts, line, boost::algorithm::is_any_of(" "));
+	if (parts.size() < 3)
+		return false;
+
+	rq._method = parts[0];
+	const std::string target = parts[1];
+	rq._keepAlive = (parts[2] == "HTTP/1.1");
+
+	const std::string::size_type q = target.find('?');
+	rq._path = urlDecode(target.substr(0, q));
+	rq._query.clear();
+	if (q != std::string::npos) {
+		std::vector<std::string> args;
+		boost::algorithm::split(args, target.substr(q + 1), boost::algorithm::is_any_of("&"));
+		for (const auto & a : args) {
+			const std::string::size_type e = a.find('=');
+			if (e == std::string::npos)
+				rq._query[urlDecode(a)] = "";
+			else
+				rq._query[urlDecode(a.substr(0, e))] = urlDecode(a.substr(e + 1));
+		}
+	}
+
+	rq._headers.clear();
+	for (;;) {
+		if (!c.readLine(line))
+			return false;
+		if (line.empty())
+			break;
+		const std::string::size_type i = line.find(':');
+		if (i == std::string::npos)
+			continue;
+		rq._headers[boost::algorithm::to_lower_copy(boost::algorithm::trim_copy(line.substr(0, i)))] = boost::algorithm::trim_copy(line.substr(i + 1));
+	}
+
+	const std::string connection = boost::algorithm::to_lower_copy(rq.header("connection"));
+	if (connection == "close")
+		rq._keepAlive = false;
+	else if (connection == "keep-alive")
+		rq._keepAlive = true;
+
+	if (boost::algorithm::iequals(rq.header("expect"), "100-continue"))
+		if (!c.write("HTTP/1.1 100 Continue\r\n\r\n"))
+			return false;
+
+	rq._body.clear();
+	rq._bBadFraming = false;
+	uint64_t len(0);
+	if (boost::algorithm::iequals(rq.header("transfer-encoding"), "chunked")) {
+		for (;;) {
+			if (!c.readLine(line))
+				return false;
+			// chunk extensions are ignored
+			if (!parseNumber(boost::algorithm::trim_copy(line.substr(0, line.find(';'))), 16, len)) {
+				rq._bBadFraming = true;
+				rq._keepAlive = false;
+				return true;
+			}
+			if (len == 0) {
+				do { // trailers
+					if (!c.readLine(line))
+						return false;
+				} while (!line.empty());
+				break;
+			}
+			if ((!c.read(rq._body, len)) || (!c.readLine(line)))
+				return false;
+		}
+	} else if (!rq.header("content-length").empty()) {
+		if (!parseNumber(rq.header("content-length"), 10, len)) {
+			rq._bBadFraming = true;
+			rq._keepAlive = false;
+			return true;
+		}
+		if (!c.read(rq._body, len))
+			return false;
+	}
+
+	return true;
+}
+
+bool CSwiftServer::injectError()
+{
+	if (s_settings._errorRate <= 0.0)
+		return false;
+
+	std::lock_guard<std::mutex> lock(_randomMutex);
+	return std::uniform_real_distribution<double>(0.0, 1.0)(_random) < s_settings._errorRate;
+}
+
+void CSwiftServer::serve(int fd)
+{
+	CConnection c(fd, _sslCtx);
+	if (!c.handshake())
+		return;
+
+	CHttpRequest rq;
+	while (readRequest(c, rq))
+	{
+		s_stats._requests++;
+		if (s_settings._latencyMs)
+			std::this_thread::sleep_for(std::chrono::milliseconds(s_settings._latencyMs));
+
+		CHttpResponse r = rq._bBadFraming ? CHttpResponse(400) : handle(rq);
+
+		std::string out = fmt::format("HTTP/1.1 {} {}\r\n", r._code, statusText(r._code));
+		for (const auto & h : r._headers)
+			out += h.first + ": " + h.second + "\r\n";
+		out += fmt::format("Content-Length: {}\r\n", (r._contentLength >= 0) ? static_cast<uint64_t>(r._contentLength) : r._body.length());
+		out += fmt::format("Date: {}\r\n", httpDate(std::time(nullptr)));
+		out += "X-Trans-Id: standin\r\n";
+		if (!rq._keepAlive)
+			out += "Connection: close\r\n";
+		out += "\r\n";
+		if (rq._method != "HEAD")
+			out += r._body;
+
+		if ((!c.write(out)) || (!rq._keepAlive))
+			break;
+	}
+}
+
+CHttpResponse CSwiftServer::handle(const CHttpRequest & rq)
+{
+	if (rq._path == "/_stats") {
+		if (rq._method == "DELETE")
+			s_stats.reset();
+		CHttpResponse r(200);
+		r.add("Content-Type", "application/json");
+		r._body = s_stats.json();
+		return r;
+	}
+
+	if (injectError()) {
+		s_stats._injectedErrors++;
+		return CHttpResponse(s_settings._errorCode);
+	}
+
+	if (rq._path == "/info") {
+		CHttpResponse r(200);
+		r.add("Content-Type", "application/json; charset=utf-8");
+		r._body = "{\"swift\":{\"version\":\"standin\"}";
+		if (s_settings._bulkDelete)
+			r._body += ",\"bulk_delete\":{\"max_deletes_per_request\":10000,\"max_failed_deletes\":1000}";
+		if (s_settings._bulkUpload)
+			r._body += ",\"bulk_upload\":{\"max_containers_per_extraction\":10000,\"max_failed_extractions\":1000}";
+		r._body += "}";
+		return r;
+	}
+
+	// /v1/<account>/<container>[/<object>]
+	std::vector<std::string> parts;
+	boost::algorithm::split(parts, rq._path, boost::algorithm::is_any_of("/"));
+	if ((parts.size() < 3) || (parts[1] != "v1"))
+		return CHttpResponse(404);
+
+	if ((!s_settings._token.empty()) && (rq.header("x-auth-token") != s_settings._token))
+		return CHttpResponse(401);
+
+	if ((parts.size() == 3) || parts[3].empty()) {
+		if ((rq._method == "POST") && rq.hasQuery("bulk-delete") && s_settings._bulkDelete)
+			return handleBulkDelete(rq);
+		return CHttpResponse(404);
+	}
+
+	const std::string container = parts[3];
+	const std::string::size_type objectStart = 1 + 2 + 1 + parts[2].length() + 1 + container.length() + 1;
+	const std::string object = (objectStart < rq._path.length()) ? rq._path.substr(objectStart) : std::string();
+
+	if ((rq._method == "PUT") && rq.hasQuery("extract-archive") && s_settings._bulkUpload) {
+		if (rq.query("extract-archive") != "tar")
+			return CHttpResponse(400);
+		return handleExtractArchive(rq, container, object);
+	}
+
+	if (object.empty()) {
+		if ((rq._method == "GET") || (rq._method == "HEAD"))
+			return handleListing(rq, container);
+		return CHttpResponse(405);
+	}
+
+	return handleObject(rq, container, object);
+}
+
+// body : one url encoded /container/object per line
+CHttpResponse CSwiftServer::handleBulkDelete(const CHttpRequest & rq)
+{
+	s_stats._bulkDelete++;
+	std::vector<std::string> lines;
+	boost::algorithm::split(lines, rq._body, boost::algorithm::is_any_of("\n"));
+
+	std::size_t deleted(0), notFound(0);
+	std::vector<std::string> errors;
+	for (const auto & l : lines)
+	{
+		const std::string path = urlDecode(boost::algorithm::trim_copy(l));
+		if (path.empty())
+			continue;
+
+		const std::string::size_type i = path.find('/', 1);
+		if ((path[0] != '/') || (i == std::string::npos) || (i + 1 == path.length()))
+			errors.push_back(fmt::format("[\"{}\",\"400 Bad Request\"]", jsonEscape(path)));
+		else if (s_store.erase(path.substr(1)))
+			deleted++;
+		else
+			notFound++;
+	}
+
+	CHttpResponse r(200);
+	r.add("Content-Type", "application/json; charset=utf-8");
+	r._body = fmt::format(
+		"{{\"Number Deleted\":{},\"Number Not Found\":{},\"Response Status\":\"{}\",\"Response Body\":\"\",\"Errors\":[{}]}}",
+		deleted, notFound, errors.empty() ? "200 OK" : "400 Bad Request", boost::algorithm::join(errors, ",")
+	);
+	return r;
+}
+
+static uint64_t parseOctal(const char * p, std::size_t size)
+{
+	uint64_t v(0);
+	for (std::size_t i=0; (i<size) && (p[i] >= '0') && (p[i] <= '7'); ++i)
+		v = (v << 3) + (p[i] - '0');
+	return v;
+}
+
+// ustar entries, with pax 'path' and 'SCHILY.xattr.user.*' records, are
+// stored as <container>/<prefix>/<entry name>
+CHttpResponse CSwiftServer::handleExtractArchive(const CHttpRequest & rq, const std::string & container, const std::string & prefix)
+{
+	s_stats._extractArchive++;
+	std::size_t created(0);
+	std::vector<std::string> errors;
+	std::map<std::string, std::string> pax;
+	bool bBadArchive(false);
+
+	const std::string & tar = rq._body;
+	for (std::size_t pos = 0; pos + 512 <= tar.size(); )
+	{
+		const char * h = tar.data() + pos;
+		if (std::all_of(h, h + 512, [](char c) { return c == 0; }))
+			break;
+
+		const uint64_t size = parseOctal(h + 124, 12);
+		const char type = h[156];
+		pos += 512;
+		if (pos + size > tar.size()) {
+			bBadArchive = true;
+			break;
+		}
+		const std::string data = tar.substr(pos, size);
+		pos += (size + 511) / 512 * 512;
+
+		if (type == 'x') {
+			// "<length> <key>=<value>\n" records
+			for (std::size_t i = 0; i < data.size(); ) {
+				const std::size_t sp = data.find(' ', i);
+				uint64_t len(0);
+				if ((sp == std::string::npos) || !parseNumber(data.substr(i, sp - i), 10, len))
+					len = 0;
+				const std::size_t eq = data.find('=', sp);
+				if ((len == 0) || (eq == std::string::npos) || (len > data.size() - i) || (eq + 2 > i + len))
+					break;
+				pax[data.substr(sp + 1, eq - sp - 1)] = data.substr(eq + 1, i + len - eq - 2);
+				i += len;
+			}
+			continue;
+		}
+
+		if ((type != '0') && (type != '\0')) {
+			pax.clear();
+			continue;
+		}
+
+		std::string name = pax.count("path") ? pax["path"] : std::string(h, strnlen(h, 100));
+		if ((h[345] != 0) && !pax.count("path"))
+			name = std::string(h + 345, strnlen(h + 345, 155)) + "/" + name;
+		while (boost::algorithm::starts_with(name, "/"))
+			name = name.substr(1);
+
+		CObject o;
+		o._data = data;
+		o._etag = md5Hex(o._data);
+		o._contentType = pax.count("SCHILY.xattr.user.mime_type") ? pax["SCHILY.xattr.user.mime_type"] : "application/octet-stream";
+		o._lastModified = std::time(nullptr);
+		for (const auto & r : pax)
+			if (boost::algorithm::starts_with(r.first, "SCHILY.xattr.user.meta."))
+				o._meta["x-object-meta-" + boost::algorithm::to_lower_copy(r.first.substr(23))] = r.second;
+		pax.clear();
+
+		if (name.empty() || (name.size() > 1024)) {
+			errors.push_back(fmt::format("[\"{}\",\"400 Bad Request\"]", jsonEscape(name)));
+			continue;
+		}
+
+		s_store.put(container + "/" + (prefix.empty() ? name : prefix + "/" + name), o);
+		created++;
+	}
+
+	CHttpResponse r(200);
+	r.add("Content-Type", "application/json; charset=utf-8");
+	r._body = fmt::format(
+		"{{\"Number Files Created\":{},\"Response Status\":\"{}\",\"Response Body\":\"{}\",\"Errors\":[{}]}}",
+		created, (bBadArchive || !errors.empty()) ? "400 Bad Request" : "201 Created", bBadArchive ? "Invalid Tar File: truncated" : "", boost::algorithm::join(errors, ",")
+	);
+	return r;
+}
+
+CHttpResponse CSwiftServer::handleListing(const CHttpRequest & rq, const std::string & container)
+{
+	s_stats._get++;
+	const std::string prefix    = rq.query("prefix");
+	const std::string delimiter = rq.query("delimiter");
+	const std::string marker    = rq.query("marker");
+	const bool bJson = (rq.query("format") == "json");
+	std::size_t limit = s_settings._listingLimit;
+	if (rq.hasQuery("limit")) {
+		uint64_t l(0);
+		if (!parseNumber(rq.query("limit"), 10, l))
+			return CHttpResponse(400);
+		limit = std::min<uint64_t>(limit, l);
+	}
+
+	std::vector<std::string> lines;
+	std::string lastSubdir;
+	for (const auto & i : s_store.list(container, prefix, marker, false))
+	{
+		if (lines.size() >= limit)
+			break;
+
+		const std::string & name = i.first;
+		if (!delimiter.empty()) {
+			const std::string::size_type d = name.find(delimiter, prefix.length());
+			if (d != std::string::npos) {
+				const std::string subdir = name.substr(0, d + delimiter.length());
+				if (subdir != lastSubdir) {
+					lastSubdir = subdir;
+					lines.push_back( bJson ? fmt::format("{{\"subdir\":\"{}\"}}", jsonEscape(subdir)) : subdir );
+				}
+				continue;
+			}
+		}
+
+		const CObject & o = i.second;
+		if (bJson)
+			lines.push_back(fmt::format("{{\"name\":\"{}\",\"hash\":\"{}\",\"bytes\":{},\"content_type\":\"{}\",\"last_modified\":\"{}\"}}",
+				jsonEscape(name), o._etag, o._meta.at(":bytes"), jsonEscape(o._contentType), isoDate(o._lastModified)));
+		else
+			lines.push_back(name);
+	}
+
+	CHttpResponse r( (lines.empty() && !bJson) ? 204 : 200 );
+	if (bJson) {
+		r.add("Content-Type", "application/json; charset=utf-8");
+		r._body = "[" + boost::algorithm::join(lines, ",") + "]";
+	} else {
+		r.add("Content-Type", "text/plain; charset=utf-8");
+		for (const auto & l : lines)
+			r._body += l + "\n";
+	}
+	return r;
+}
+
+static std::map<std::string, std::string> metaHeaders(const CHttpRequest & rq)
+{
+	std::map<std::string, std::string> meta;
+	for (const auto & h : rq._headers)
+		if (boost::algorithm::starts_with(h.first, "x-object-meta-"))
+			meta[h.first] = h.second;
+	return meta;
+}
+
+CHttpResponse CSwiftServer::handleObject(const CHttpRequest & rq, const std::string & container, const std::string & object)
+{
+	const std::string key = container + "/" + object;
+
+	if ((rq._method == "GET") || (rq._method == "HEAD")) {
+		(rq._method == "GET") ? s_stats._get++ : s_stats._head++;
+		CObject o;
+		if (!s_store.get(key, o))
+			return CHttpResponse(404);
+
+		CHttpResponse r(200);
+		r.add("Etag", o._etag);
+		r.add("Last-Modified", httpDate(o._lastModified));
+		r.add("Content-Type", o._contentType);
+		for (const auto & m : o._meta)
+			r.add(m.first, m.second);
+		if (rq._method == "GET")
+			r._body = o._data;
+		else
+			r._contentLength = o._data.size();
+		return r;
+	}
+
+	// server side copy : PUT with X-Copy-From, or COPY with Destination.
+	// The source metadatas are kept, overridden by the request ones
+	const bool bCopy = ((rq._method == "PUT") && !rq.header("x-copy-from").empty()) || (rq._method == "COPY");
+	if (bCopy) {
+		s_stats._copy++;
+		std::string src, dst;
+		if (rq._method == "PUT") {
+			src = urlDecode(rq.header("x-copy-from"));
+			dst = key;
+		} else {
+			src = "/" + key;
+			dst = urlDecode(rq.header("destination"));
+			if (boost::algorithm::starts_with(dst, "/"))
+				dst = dst.substr(1);
+		}
+		if (boost::algorithm::starts_with(src, "/"))
+			src = src.substr(1);
+
+		CObject o;
+		if (!s_store.get(src, o))
+			return CHttpResponse(404);
+
+		for (const auto & m : metaHeaders(rq))
+			o._meta[m.first] = m.second;
+		o._lastModified = std::time(nullptr);
+		s_store.put(dst, o);
+
+		CHttpResponse r(201);
+		r.add("Etag", o._etag);
+		r.add("X-Copied-From", src);
+		return r;
+	}
+
+	if (rq._method == "PUT") {
+		s_stats._put++;
+		CObject o;
+		o._data = rq._body;
+		o._etag = md5Hex(o._data);
+		o._contentType = rq.header("content-type").empty() ? "application/octet-stream" : rq.header("content-type");
+		o._meta = metaHeaders(rq);
+		o._lastModified = std::time(nullptr);
+
+		const std::string etag = rq.header("etag");
+		if ((!etag.empty()) && (etag != o._etag))
+			return CHttpResponse(422);
+
+		s_store.put(key, o);
+		CHttpResponse r(201);
+		r.add("Etag", o._etag);
+		return r;
+	}
+
+	if (rq._method == "POST") {
+		s_stats._post++;
+		return CHttpResponse( s_store.setMeta(key, metaHeaders(rq)) ? 202 : 404 );
+	}
+
+	if (rq._method == "DELETE") {
+		s_stats._delete++;
+		return CHttpResponse( s_store.erase(key) ? 204 : 404 );
+	}
+
+	return CHttpResponse(405);
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void usage(const char * name)
+{
+	std::cerr
+		<< "Usage: " << name << " [OPTIONS]" << std::endl
+		<< "  --port N           listening port (default 8080)" << std::endl
+		<< "  --latency-ms N     latency added to each request" << std::endl
+		<< "  --bandwidth N      shared bandwidth limit in bytes/s (default unlimited)" << std::endl
+		<< "  --error-rate P     probability [0..1] of an injected error" << std::endl
+		<< "  --error-code N     http code of injected errors (default 500)" << std::endl
+		<< "  --token T          expected X-Auth-Token (default any)" << std::endl
+		<< "  --tls-cert F       PEM certificate. Enables https" << std::endl
+		<< "  --tls-key F        PEM private key" << std::endl
+		<< "  --listing-limit N  max entries per listing page (default 10000)" << std::endl
+		<< "  --no-bulk-delete   disable the bulk-delete middleware" << std::endl
+		<< "  --no-bulk-upload   disable the extract-archive middleware" << std::endl;
+}
+
+int main(int argc, char ** argv)
+{
+	spdlog::stderr_logger_mt(configConsoleName);
+
+	for (int i=1; i<argc; ++i)
+	{
+		const std::string a(argv[i]);
+		const bool bHasValue = (i + 1 < argc);
+		if      ((a == "--port"         ) && bHasValue) s_settings._port         = atoi(argv[++i]);
+		else if ((a == "--latency-ms"   ) && bHasValue) s_settings._latencyMs    = strtoull(argv[++i], nullptr, 10);
+		else if ((a == "--bandwidth"    ) && bHasValue) s_settings._bandwidth    = strtoull(argv[++i], nullptr, 10);
+		else if ((a == "--error-rate"   ) && bHasValue) s_settings._errorRate    = atof(argv[++i]);
+		else if ((a == "--error-code"   ) && bHasValue) s_settings._errorCode    = atoi(argv[++i]);
+		else if ((a == "--token"        ) && bHasValue) s_settings._token        = argv[++i];
+		else if ((a == "--tls-cert"     ) && bHasValue) s_settings._tlsCert      = argv[++i];
+		else if ((a == "--tls-key"      ) && bHasValue) s_settings._tlsKey       = argv[++i];
+		else if ((a == "--listing-limit") && bHasValue) s_settings._listingLimit = strtoull(argv[++i], nullptr, 10);
+		else if  (a == "--no-bulk-delete"             ) s_settings._bulkDelete   = false;
+		else if  (a == "--no-bulk-upload"             ) s_settings._bulkUpload   = false;
+		else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// handle termination signals synchronously from the main thread
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+	signal(SIGPIPE, SIG_IGN);
+
+	CSwiftServer server;
+	if (!server.start())
+		return EXIT_FAILURE;
+
+	LOGI("swift stand-in listening on {}://127.0.0.1:{}/v1/AUTH_standin", s_settings._tlsCert.empty() ? "http" : "https", s_settings._port);
+
+	int sig(0);
+	sigwait(&signals, &sig);
+	std::cerr << s_stats.json();
+	_exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,272 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "archiveUploader.h"
+#include "../thirdparty/jsonxx/jsonxx.h"
+#include <iterator>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+//- minimal pax/ustar writer
+
+namespace
+{
+	constexpr std::size_t tarBlock = 512;
+
+	void putOctal(char * p, std::size_t size, uint64_t v)
+	{
+		// size-1 digits and a NUL
+		for (std::size_t i=size-1; i-- > 0; v >>= 3)
+			p[i] = static_cast<char>('0' + (v & 7));
+		p[size-1] = '\0';
+	}
+
+	void pad(std::string & tar)
+	{
+		tar.append((tarBlock - tar.size() % tarBlock) % tarBlock, '\0');
+	}
+
+	void putHeader(std::string & tar, const std::string & name, uint64_t size, uint64_t mtime, char type)
+	{
+		char h[tarBlock];
+		memset(h, 0, sizeof(h));
+		memcpy(h, name.data(), std::min<std::size_t>(name.size(), 99)); // the pax 'path' record holds the full name
+		putOctal(h + 100, 8, 0644);
+		putOctal(h + 108, 8, 0);
+		putOctal(h + 116, 8, 0);
+		putOctal(h + 124, 12, size);
+		putOctal(h + 136, 12, mtime);
+		h[156] = type;
+		memcpy(h + 257, "ustar", 6);
+		memcpy(h + 263, "00", 2);
+
+		memset(h + 148, ' ', 8);
+		unsigned int sum(0);
+		for (std::size_t i=0; i<sizeof(h); ++i)
+			sum += static_cast<unsigned char>(h[i]);
+		putOctal(h + 148, 7, sum);
+
+		tar.append(h, sizeof(h));
+	}
+
+	// "<length> <key>=<value>\n", the length counting itself
+	std::string paxRecord(const std::string & key, const std::string & value)
+	{
+		const std::size_t n = key.size() + value.size() + 3;
+		std::size_t len = n + fmt::format("{}", n).size();
+		if (fmt::format("{}", len).size() != fmt::format("{}", n).size())
+			len++;
+		return fmt::format("{} {}={}\n", len, key, value);
+	}
+
+	// X-Object-Meta-<name> as a bulk middleware xattr
+	std::string metaRecord(const char * meta, const std::string & value)
+	{
+		static const std::string prefix("X-Object-Meta-");
+		return paxRecord("SCHILY.xattr.user.meta." + std::string(meta).substr(prefix.size()), value);
+	}
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+CArchiveUploader::CArchiveUploader(CContext & ctx)
+:	CContextual(ctx)
+,	_bEnabled(ctx._options->_archiveSmallFilesMax > 0)
+,	_archivedFileCount(0)
+,	_fallbackFileCount(0)
+,	_uploadedByteCount(0)
+{
+}
+
+void CArchiveUploader::init()
+{
+	if (!_bEnabled)
+		return;
+
+	const std::string endpoint = _ctx._credentials.get().endpoint();
+	const std::string::size_type i = endpoint.find("/v1/");
+
+	jsonxx::Object info;
+	if (i != std::string::npos) {
+		CRequest rq(_ctx._options->_curlVerbose);
+		rq.get(endpoint.substr(0, i) + "/info");
+		if (rq.getHttpResponseCode() == 200)
+			info.parse(rq.getResponse());
+	}
+
+	if (!info.has<jsonxx::Object>("bulk_upload")) {
+		LOGW("the server has no extract-archive support. Small files are uploaded one by one");
+		_bEnabled = false;
+	}
+}
+
+CUploader::result_code CArchiveUploader::add(CAsset * p)
+{
+	assert( p );
+	assert( !p->isFolder() );
+
+	std::string data;
+	if ((!_ctx._readCache.take(p, data)) && !CFileReader::readFile(p->getFullPath().string(), data, _ctx._options->_cacheMode)) {
+		LOGE("file read error '{}'", p->getFullPath());
+		return CUploader::resError;
+	}
+
+	CHash h = p->getSrcHash();
+	h._computed = true;
+	h._len = data.size();
+	h._md5 = NMD5::computeMd5(data);
+	p->setSrcHash(h);
+
+	// same metadatas as a regular upload
+	const bool bCompressed = CCompressor::compressIfWorth(data, _ctx._options->_compressLevel);
+	std::string pax = paxRecord("path", p->getRelativePath().string());
+	pax += paxRecord("SCHILY.xattr.user.mime_type", "application/octet-stream");
+	if (bCompressed) {
+		pax += metaRecord(metaCompression , "gzip");
+		if (!_ctx.crypted()) {
+			pax += metaRecord(metaUncryptedMd5, h._md5.hex());
+			pax += metaRecord(metaUncryptedLen, fmt::format("{}", h._len));
+		}
+	}
+	if (_ctx.crypted()) {
+		std::unique_ptr<CCryptoContext> cryptoContext( CCryptoContext::create(_ctx._options->_cryptoPassword) );
+		CCryptEngine cryptor;
+		std::vector<uint8_t> crypted;
+		if (!cryptor.encrypt(crypted, data.data(), data.size(), cryptoContext.get())) {
+			LOGE("encryption error '{}'", p->getFullPath());
+			return CUploader::resError;
+		}
+		data.assign(crypted.begin(), crypted.end());
+
+		pax += metaRecord(metaUncryptedMd5, h._md5.hex());
+		pax += metaRecord(metaUncryptedLen, fmt::format("{}", h._len));
+		pax += metaRecord(metaCryptoKey   , _ctx._options->_cryptoKey.hex());
+	}
+	pax += metaRecord(metaLastModificationDate, fmt::format("{}", p->getLocalLastModifTime()));
+
+	std::unique_ptr<CBatch> full;
+	{
+		std::lock_guard<std::mutex> lock(_m);
+		if (!_current) {
+			_current.reset(new CBatch);
+			_current->_tar.reserve(archiveBatchBytes + archiveBatchBytes / 8);
+		}
+
+		std::string & tar = _current->_tar;
+		putHeader(tar, "PaxHeaders/" + p->_name, pax.size(), p->getLocalLastModifTime(), 'x');
+		tar += pax;
+		pad(tar);
+		putHeader(tar, p->getRelativePath().string(), data.size(), p->getLocalLastModifTime(), '0');
+		tar += data;
+		pad(tar);
+		_current->_assets.push_back(p);
+
+		if ((tar.size() >= archiveBatchBytes) || (_current->_assets.size() >= archiveBatchMaxFiles))
+			full = std::move(_current);
+	}
+
+	return full ? upload(*full) : CUploader::resOk;
+}
+
+CUploader::result_code CArchiveUploader::flush()
+{
+	std::unique_ptr<CBatch> batch;
+	{
+		std::lock_guard<std::mutex> lock(_m);
+		batch = std::move(_current);
+	}
+	return batch ? upload(*batch) : CUploader::resOk;
+}
+
+CUploader::result_code CArchiveUploader::uploadOneByOne(const std::vector<CAsset*> & assets)
+{
+	CUploader uploader(_ctx);
+	for (CAsset * p : assets)
+	{
+		CUploader::result_code r = uploader.upload(p);
+		if ((r == CUploader::resRetry) && (!_ctx.aborted())) {
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+			LOGW("retrying uploading {}", p->getRelativePath().string());
+			r = uploader.upload(p);
+		}
+		if (r != CUploader::resOk)
+			return CUploader::resError;
+
+		_fallbackFileCount++;
+		_uploadedByteCount += uploader.uploadedByteCount();
+	}
+	return CUploader::resOk;
+}
+
+CUploader::result_code CArchiveUploader::upload(const CBatch & batch)
+{
+	std::string tar(batch._tar);
+	tar.append(2 * tarBlock, '\0');
+
+	CRequest rq(_ctx._options->_curlVerbose);
+	const std::string url = fmt::format("{}/{}/{}?extract-archive=tar", _ctx._credentials.get().endpoint(), _ctx._options->_dstContainer, rq.escapePath(_ctx._options->_dstFolder).string());
+	rq.setHeaders(_ctx._credentials.uploadHeaders());
+	rq.addHeader("Content-Type", "application/x-tar");
+	rq.addHeader("Accept", "application/json");
+	rq.put(url, tar.data(), tar.size());
+
+	// the http code is sent before the extraction : the result is in the body
+	jsonxx::Object result;
+	const bool bParsed = ((rq.getHttpResponseCode() == 200) || (rq.getHttpResponseCode() == 201)) && result.parse(rq.getResponse());
+	const std::string status = (bParsed && result.has<jsonxx::String>("Response Status")) ? result.get<jsonxx::String>("Response Status") : std::string();
+	if ((!bParsed) || ((!boost::algorithm::starts_with(status, "2")) && (!boost::algorithm::starts_with(status, "400")))) {
+		LOGW("archive of {} file(s) rejected [http response : {}, {}]. Uploading them one by one", batch._assets.size(), rq.getHttpResponseCode(), status);
+		return uploadOneByOne(batch._assets);
+	}
+
+	// per file errors, as [ "<url encoded name>", "<status>" ]
+	std::set<std::string> failed;
+	if (result.has<jsonxx::Array>("Errors")) {
+		const jsonxx::Array & errors = result.get<jsonxx::Array>("Errors");
+		for (std::size_t i=0; i<errors.size(); ++i) {
+			if ((!errors.has<jsonxx::Array>(i)) || (!errors.get<jsonxx::Array>(i).has<jsonxx::String>(0)))
+				continue;
+			int len(0);
+			const std::string & e = errors.get<jsonxx::Array>(i).get<jsonxx::String>(0);
+			char * s = curl_easy_unescape(rq.curl(), e.c_str(), static_cast<int>(e.size()), &len);
+			failed.insert(std::string(s, len));
+			curl_free(s);
+		}
+	}
+
+	std::vector<CAsset*> retry;
+	for (CAsset * p : batch._assets)
+	{
+		const std::string name = p->getRelativePath().string();
+		const bool bFailed = std::any_of(failed.begin(), failed.end(), [&name](const std::string & f) { return (f == name) || boost::algorithm::ends_with(f, "/" + name); });
+		if (bFailed) {
+			LOGW("'{}' not extracted from the archive", name);
+			retry.push_back(p);
+		} else
+			_archivedFileCount++;
+	}
+
+	_uploadedByteCount += tar.size();
+	LOGD("archive of {} file(s) uploaded, {} bytes. {} error(s)", batch._assets.size(), tar.size(), retry.size());
+	return uploadOneByOne(retry);
+}
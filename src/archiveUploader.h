@@ -0,0 +1,90 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#pragma once
+
+#include "context.h"
+#include "compressor.h"
+#include "crypto.h"
+#include "uploader.h"
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+
+Small files archive uploads (--archive-small-files SIZE)
+
+Files smaller than SIZE are appended to a tar batch instead of being
+uploaded one by one. A full batch is sent with a single
+	PUT <container>/<destination folder>?extract-archive=tar
+and the swift bulk middleware expands it server side in one object per
+file, as a regular upload would. The object metadatas are carried by pax
+'SCHILY.xattr.user.meta.*' records of each entry.
+
+Files reported in the response 'Errors' list, and all the files of a
+rejected batch, are uploaded again one by one.
+
+*/
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CArchiveUploader
+:	public CContextual
+{
+public:
+	CArchiveUploader(CContext & ctx);
+
+public:
+	bool enabled() const { return _bEnabled; }
+	bool accepts(uint64_t size) const { return _bEnabled && (size < _ctx._options->_archiveSmallFilesMax); }
+
+	// checks the server supports extract-archive. Disabled if not
+	void init();
+
+	// thread safe. Full batches are uploaded by the calling thread
+	CUploader::result_code add(CAsset * p);
+	CUploader::result_code flush();
+
+	uint64_t archivedFileCount() const { return _archivedFileCount; }
+	uint64_t fallbackFileCount() const { return _fallbackFileCount; }
+	uint64_t uploadedByteCount() const { return _uploadedByteCount; }
+
+private:
+	struct CBatch
+	{
+		std::string _tar;
+		std::vector<CAsset*> _assets;
+	};
+
+	CUploader::result_code upload(const CBatch & batch);
+	CUploader::result_code uploadOneByOne(const std::vector<CAsset*> & assets);
+
+private:
+	bool _bEnabled;
+	std::mutex _m;
+	std::unique_ptr<CBatch> _current;
+	std::atomic<uint64_t> _archivedFileCount;
+	std::atomic<uint64_t> _fallbackFileCount;
+	std::atomic<uint64_t> _uploadedByteCount;
+};
@@ -55,6 +55,10 @@ CAsset::CAsset(CAsset * parent, const std::string & name, bool bFolder)
 ,	_parent(parent)
 ,	_isFolder(bFolder)
 ,	_srcHash()
+,	_readKey(0)
+,	_device(0)
+,	_linkPrimary(nullptr)
+,	_stored(false)
 ,	_crypted(false)
 ,	_dstHash()
 ,	_remoteLastModifTime(INVALID_TIME)
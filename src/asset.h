@@ -44,6 +44,15 @@ struct CHash
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// remote object that may hold the content of a new file
+struct CCopySource
+{
+	bf::path      _path; // relative to the destination folder
+	NMD5::CDigest _etag; // md5 of the stored (possibly crypted) object, as listed
+};
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 enum class BACKUP_ITEM_STATUS
 {
 	UNKNOWN,
@@ -52,6 +61,9 @@ enum class BACKUP_ITEM_STATUS
 	IGNORED,
 	TO_BE_DELETED,
 	TO_BE_CREATED,
+	TO_BE_COPIED,
+	TO_BE_LINKED,
+	TO_BE_PACKED,
 	UPDATE_CONTENT_CHANGED,
 	UPDATE_PWD_CHANGED
 };
@@ -84,8 +96,8 @@ public:
 	void setFolder( bool bFolder );
 
 public:
-	CHash getSrcHash();
-	CHash getDstHash();
+	CHash getSrcHash() const;
+	CHash getDstHash() const;
 	void setSrcHash(const CHash & h);
 	void setDstHash(const CHash & h);
 
@@ -101,10 +113,31 @@ public:
 	uint64_t getRemoteLastModifTime() const { return _remoteLastModifTime; }
 	void setRemoteLastModifTime(uint64_t m) { _remoteLastModifTime = m; }
 
+	// place of the file on its disk, see --read-order
+	uint64_t getReadKey() const { return _readKey; }
+	void setReadKey(uint64_t k) { _readKey = k; }
+
+	// st_dev of the source file, see --device-readers
+	uint64_t getDevice() const { return _device; }
+	void setDevice(uint64_t d) { _device = d; }
+
+	// hard links : the first link of the inode met by the scan, which is read
+	// and uploaded. nullptr for the first link and for single linked files
+	CAsset * getLinkPrimary() const { return _linkPrimary; }
+	void setLinkPrimary(CAsset * p) { _linkPrimary = p; }
+
+	// the remote object holds the current content
+	bool isStored() const { return _stored; }
+	void setStored(bool s) { _stored = s; }
+
 public:
 	bool isCrypted() { return _crypted; }
 	void setCrypted(bool c) { _crypted = c; }
 
+public:
+	const std::vector<CCopySource> & getCopySources() const { return _copySources; }
+	void setCopySources(const std::vector<CCopySource> & s) { _copySources = s; }
+
 public:
 	BACKUP_ITEM_STATUS getBackupStatus() const { return _backupStatus; }
 	void setBackupStatus(BACKUP_ITEM_STATUS s) { _backupStatus = s; }
@@ -116,16 +149,21 @@ private:
 private:
 	bool _isFolder;
 	
-	std::mutex _srcHashMutex;
+	mutable std::mutex _srcHashMutex;
 	CHash      _srcHash;
 	uint64_t   _localLastModifTime;
+	uint64_t   _readKey;
+	uint64_t   _device;
+	CAsset *   _linkPrimary;
+	std::atomic_bool _stored;
 	
-	std::mutex _dstHashMutex;
+	mutable std::mutex _dstHashMutex;
 	std::atomic_bool _crypted;
 	CHash _dstHash;
 	NMD5::CDigest _remoteCryptoKey;
 	std::string   _remoteLastModifDateString;
 	uint64_t      _remoteLastModifTime;
+	std::vector<CCopySource> _copySources;
 	
 	std::atomic<BACKUP_ITEM_STATUS> _backupStatus;
 };
@@ -133,7 +171,7 @@ private:
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-inline CHash CAsset::getSrcHash()
+inline CHash CAsset::getSrcHash() const
 {
 	CHash r;
 	_srcHashMutex.lock();
@@ -142,7 +180,7 @@ inline CHash CAsset::getSrcHash()
 	return r;
 }
 
-inline CHash CAsset::getDstHash()
+inline CHash CAsset::getDstHash() const
 {
 	CHash r;
 	_dstHashMutex.lock();
@@ -27,6 +27,10 @@
 #include "base64.h"
 #include "request.h"
 #include "token.h"
+#include <algorithm>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include <jsoncpp/json/json.h>
 
@@ -169,7 +173,7 @@ static CCredentials getCredentials(CRequest & rq, const CToken & t)
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-CCredentials getCredentials(const CGetCredentialSettings & settings, bool bVerbose)
+bool fetchCredentials(const CGetCredentialSettings & settings, bool bVerbose, CCredentials & result)
 {
 	try {
 		CRequest rq(bVerbose);
@@ -180,24 +184,208 @@ CCredentials getCredentials(const CGetCredentialSettings & settings, bool bVerbo
 		CToken token= requestToken(rq, code, settings);
 		if (!token.isValid()) {
 			LOGE(AUTH_LOG "invalid token");
-			exit( EXIT_FAILURE );
+			return false;
 		}
 		
-		CCredentials credentials =getCredentials(rq, token);
-		return credentials;
-		
+		result = getCredentials(rq, token);
+		return true;
 	}
 	catch (const std::exception & e)
 	{
-		LOGC(AUTH_LOG "{}. {}", e.what(), "Application will now exit.");
-		exit( EXIT_FAILURE );
+		LOGE(AUTH_LOG "{}", e.what());
 	}
 	catch (...)
 	{
-		LOGC(AUTH_LOG "{}", "Unhandled Exception reached the top of main while authorizing. Application will now exit.");
+		LOGE(AUTH_LOG "{}", "Unhandled Exception reached the top of main while authorizing.");
+	}
+	
+	return false;
+}
+
+CCredentials getCredentials(const CGetCredentialSettings & settings, bool bVerbose)
+{
+	CCredentials credentials;
+	if (!fetchCredentials(settings, bVerbose, credentials)) {
+		LOGC(AUTH_LOG "{}", "Can't get credentials. Application will now exit.");
 		exit( EXIT_FAILURE );
 	}
+	return credentials;
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static constexpr std::time_t renewMargin = 10 * 60; // renew 10 minutes before expiration
+static constexpr std::time_t renewRetryMin = 30;     // back off after a failed renewal ...
+static constexpr std::time_t renewRetryMax = 5 * 60; // ... doubling up to 5 minutes
+
+CCredentialProvider::CCredentialProvider()
+:	_bVerbose(false)
+,	_renewable(false)
+,	_retryAt(0)
+,	_retryDelay(0)
+{
+}
+
+CCredentialProvider::~CCredentialProvider()
+{
+	CRequest::setAuthRefresher(nullptr);
+}
+
+bool CCredentialProvider::init(const CGetCredentialSettings & settings, bool bVerbose, const bf::path & cachePath)
+{
+	_settings = settings;
+	_bVerbose = bVerbose;
+	_renewable= true;
+	_cachePath= cachePath;
+
+	if (loadCache()) {
+		LOGI(AUTH_LOG "Using cached credentials, endpoint = '{}', expire = '{}'", _cr.endpoint(), _cr.expires());
+	} else if (!fetch()) {
+		return false;
+	}
+
+	CRequest::setAuthRefresher(this);
+	return true;
+}
+
+void CCredentialProvider::initFixed(const CCredentials & cr)
+{
+	_renewable = false;
+	set(cr);
+}
+
+bool CCredentialProvider::expiresSoon() const
+{
+	const std::time_t expires = _cr.expiresTime();
+	return (expires != 0) && (std::time(nullptr) + renewMargin >= expires);
+}
+
+void CCredentialProvider::set(const CCredentials & cr)
+{
+	_cr = cr;
+
+	// hot request headers are built once and shared by all requests
+	std::shared_ptr<CHeaderList> authHeaders(new CHeaderList);
+	authHeaders->add(headerAuthToken, _cr.token());
+	_authHeaders = authHeaders;
+
+	std::shared_ptr<CHeaderList> uploadHeaders(new CHeaderList);
+	uploadHeaders->add(headerAuthToken, _cr.token());
+	uploadHeaders->add(metaVersion, HUBACK_VERSION);
+	_uploadHeaders = uploadHeaders;
+}
+
+bool CCredentialProvider::fetch()
+{
+	// every thread asks under the mutex : don't scrape the auth pages again for each of them
+	const std::time_t now = std::time(nullptr);
+	if (now < _retryAt) {
+		LOGD(AUTH_LOG "Renewal failed recently, next attempt in {}s", _retryAt - now);
+		return false;
+	}
+
+	CCredentials cr;
+	if (!fetchCredentials(_settings, _bVerbose, cr)) {
+		_retryDelay = std::min(std::max(2 * _retryDelay, renewRetryMin), renewRetryMax);
+		_retryAt = std::time(nullptr) + _retryDelay;
+		LOGW(AUTH_LOG "Credentials renewal failed, next attempt in {}s", _retryDelay);
+		return false;
+	}
+
+	_retryAt = _retryDelay = 0;
+	_previous = _cr;
+	set(cr);
+	saveCache();
+	return true;
+}
+
+CCredentials CCredentialProvider::get()
+{
+	std::lock_guard<std::mutex> lock(_m);
+	if (_renewable && expiresSoon()) {
+		LOGI(AUTH_LOG "Credentials expire at '{}'. Renewing", _cr.expires());
+		fetch();
+	}
+	return _cr;
+}
+
+std::shared_ptr<const CHeaderList> CCredentialProvider::authHeaders()
+{
+	get();
+	std::lock_guard<std::mutex> lock(_m);
+	return _authHeaders;
+}
+
+std::shared_ptr<const CHeaderList> CCredentialProvider::uploadHeaders()
+{
+	get();
+	std::lock_guard<std::mutex> lock(_m);
+	return _uploadHeaders;
+}
+
+bool CCredentialProvider::renew(const std::string & rejectedToken, std::string & rejectedEndpoint, CCredentials & cr)
+{
+	std::lock_guard<std::mutex> lock(_m);
+	if (rejectedToken == _previous.token()) {
+		// already renewed by another thread
+		rejectedEndpoint = _previous.endpoint();
+		
+	} else if (rejectedToken == _cr.token()) {
+		if (!_renewable)
+			return false;
+		
+		LOGI(AUTH_LOG "Token rejected. Renewing credentials");
+		rejectedEndpoint = _cr.endpoint();
+		if (!fetch())
+			return false;
+	
+	} else {
+		return false;
+	}
+	
+	cr = _cr;
+	return true;
+}
+
+bool CCredentialProvider::loadCache()
+{
+	if (_cachePath.empty() || !bf::exists(_cachePath))
+		return false;
+
+	std::ifstream f(_cachePath.c_str());
+	const std::string content((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
 	
-	return CCredentials();
+	CCredentials cr;
+	if (content.empty() || (!cr.fromJson(content)) || (!cr.isValid()))
+		return false;
+
+	const std::time_t expires = cr.expiresTime();
+	if ((expires == 0) || (std::time(nullptr) + renewMargin >= expires))
+		return false;
+
+	set(cr);
+	return true;
 }
 
+void CCredentialProvider::saveCache() const
+{
+	if (_cachePath.empty())
+		return;
+
+	boost::system::error_code ec;
+	bf::create_directories(_cachePath.parent_path(), ec);
+	
+	const int fd = open(_cachePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		LOGW(AUTH_LOG "Can't write credentials cache '{}'", _cachePath.string());
+		return;
+	}
+	
+	fchmod(fd, S_IRUSR | S_IWUSR); // the file may already exist with other rights
+	const std::string content = _cr.toJson();
+	const bool bOk = (write(fd, content.c_str(), content.length()) == static_cast<ssize_t>(content.length()));
+	close(fd);
+
+	if (!bOk)
+		LOGW(AUTH_LOG "Error writing credentials cache '{}'", _cachePath.string());
+}
@@ -25,6 +25,7 @@
 #pragma once
 
 #include "credentials.h"
+#include "request.h"
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -36,8 +37,55 @@ struct CGetCredentialSettings
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// Central credentials owner shared by all worker threads. Credentials are
+// cached in a user only readable file and reused while valid. They are
+// renewed before they expire and whenever the storage rejects the token.
+
+class CCredentialProvider
+:	public CAuthRefresher
+{
+public:
+	CCredentialProvider();
+	virtual ~CCredentialProvider();
+
+public:
+	bool init(const CGetCredentialSettings & settings, bool bVerbose, const bf::path & cachePath);
+	void initFixed(const CCredentials & cr); // debug token : never renewed
+
+public:
+	CCredentials get();
+	std::shared_ptr<const CHeaderList> authHeaders();   // auth token
+	std::shared_ptr<const CHeaderList> uploadHeaders(); // auth token + version
+
+public:
+	virtual bool renew(const std::string & rejectedToken, std::string & rejectedEndpoint, CCredentials & cr) override;
+
+private:
+	bool expiresSoon() const;
+	bool fetch();
+	void set(const CCredentials & cr);
+	bool loadCache();
+	void saveCache() const;
+
+private:
+	std::mutex             _m;
+	CGetCredentialSettings _settings;
+	bool                   _bVerbose;
+	bool                   _renewable;
+	bf::path               _cachePath;
+	CCredentials           _cr;
+	CCredentials           _previous;
+	std::time_t            _retryAt;    // no renewal before, after a failed one
+	std::time_t            _retryDelay; // doubled on each failure
+	std::shared_ptr<const CHeaderList> _authHeaders;
+	std::shared_ptr<const CHeaderList> _uploadHeaders;
+};
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 CCredentials getCredentials(const std::string & login, const std::string & pwd, bool bVerbose);
 CCredentials getCredentials(const CGetCredentialSettings & settings, bool bVerbose);
+bool fetchCredentials(const CGetCredentialSettings & settings, bool bVerbose, CCredentials & result);
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
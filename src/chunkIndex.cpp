@@ -0,0 +1,98 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "chunkIndex.h"
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool CChunkIndex::open(const bf::path & path)
+{
+	std::lock_guard<std::mutex> lock(_m);
+	_ids.clear();
+	_path = path;
+
+	boost::system::error_code ec;
+	bf::create_directories(path.parent_path(), ec);
+
+	{
+		std::ifstream f(path.c_str());
+		std::string line;
+		while (std::getline(f, line))
+			if (!line.empty())
+				_ids.insert(line);
+	}
+
+	_file.open(path.c_str(), std::ios::out | std::ios::app);
+	if (!_file.is_open()) {
+		LOGE("can't open chunk index '{}'", path.string());
+		return false;
+	}
+
+	LOGI("chunk index : {} known chunk(s)", _ids.size());
+	return true;
+}
+
+bool CChunkIndex::contains(const std::string & id) const
+{
+	std::lock_guard<std::mutex> lock(_m);
+	return _ids.find(id) != _ids.end();
+}
+
+void CChunkIndex::add(const std::string & id)
+{
+	std::lock_guard<std::mutex> lock(_m);
+	if (_ids.insert(id).second)
+		_file << id << std::endl;
+}
+
+std::size_t CChunkIndex::size() const
+{
+	std::lock_guard<std::mutex> lock(_m);
+	return _ids.size();
+}
+
+std::vector<std::string> CChunkIndex::sample(std::size_t count) const
+{
+	std::lock_guard<std::mutex> lock(_m);
+	std::vector<std::string> result;
+	if ((count == 0) || _ids.empty())
+		return result;
+
+	const std::size_t step = std::max<std::size_t>(1, _ids.size() / count);
+	std::size_t n(0);
+	for (auto i = _ids.begin(); (i != _ids.end()) && (result.size() < count); ++i, ++n)
+		if (n % step == 0)
+			result.push_back(*i);
+	return result;
+}
+
+void CChunkIndex::clear()
+{
+	std::lock_guard<std::mutex> lock(_m);
+	_ids.clear();
+	_file.close();
+	_file.open(_path.c_str(), std::ios::out | std::ios::trunc);
+	if (!_file.is_open())
+		LOGE("can't open chunk index '{}'", _path.string());
+}
@@ -0,0 +1,63 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#pragma once
+
+#include "common.h"
+#include <unordered_set>
+#include <fstream>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// ids of the chunks known to be stored. Loaded from and appended to a local
+// file of the state folder.
+//
+// A known chunk is not checked again : a chunk removed from the container
+// behind the index (container emptied or recreated, account or endpoint
+// reused, store cleaned by hand) would be listed by new recipes without being
+// stored. Before a run trusts it, a sample of the index is checked with HEAD
+// requests, and the whole index is dropped when one of them is missing. Single
+// chunks removed out of the sample are not noticed : removing the index file
+// makes the next run check every chunk again.
+
+class CChunkIndex
+{
+public:
+	bool open(const bf::path & path);
+	bool contains(const std::string & id) const;
+	void add(const std::string & id);
+	std::size_t size() const;
+
+	// up to 'count' ids, spread over the index
+	std::vector<std::string> sample(std::size_t count) const;
+
+	// forgets every id, in the file too
+	void clear();
+
+private:
+	mutable std::mutex _m;
+	std::unordered_set<std::string> _ids;
+	bf::path      _path;
+	std::ofstream _file;
+};
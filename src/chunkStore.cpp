@@ -0,0 +1,321 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "chunkStore.h"
+#include "cryptGcm.h"
+#include "../thirdparty/jsonxx/jsonxx.h"
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	std::string toHex(const uint8_t * p, std::size_t len)
+	{
+		static const char * const digits = "0123456789abcdef";
+		std::string r(2 * len, '0');
+		for (std::size_t i=0; i<len; ++i) {
+			r[2*i+0] = digits[p[i] >> 4];
+			r[2*i+1] = digits[p[i] & 0x0f];
+		}
+		return r;
+	}
+
+	void sha256(uint8_t (&digest)[32], const void * p, std::size_t len)
+	{
+		unsigned int digestLen(0);
+		EVP_Digest(p, len, digest, &digestLen, EVP_sha256(), nullptr);
+	}
+
+	// the md5 of a hole, fed from a shared zero block instead of read
+	void feedZeros(NMD5::CComputer & c, uint64_t len)
+	{
+		static const std::vector<uint8_t> zeros(ioPieceSize, 0);
+		for (uint64_t n; len > 0; len -= n) {
+			n = std::min<uint64_t>(len, zeros.size());
+			c.feed(zeros.data(), n);
+		}
+	}
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+CChunkedUploader::CChunkedUploader(CContext & ctx)
+:	CContextual(ctx)
+,	_rq(ctx._options->_curlVerbose)
+,	_reader(ctx._options->_ioEngine, ctx._options->_ioDepth, ioPieceSize, 1, ctx._options->_cacheMode)
+,	_totalUploaded(0)
+,	_totalDedup(0)
+,	_totalHoles(0)
+,	_idKey(crypted() ? chunkIdKeySize : 0)
+{
+	if (crypted() && !getChunkIdKey(_idKey.data(), ctx._options->_cryptoPassword))
+		_idKey.clear();
+	for (int i=0; i<std::max(1, ctx._options->_uploadParts); ++i)
+		_parts.push_back(std::unique_ptr<CPart>(new CPart(ctx._options->_curlVerbose)));
+}
+
+// empty when the crypted ids key couldn't be derived
+std::string CChunkedUploader::chunkId(const uint8_t * p, std::size_t len) const
+{
+	uint8_t digest[32];
+	if (!crypted()) {
+		sha256(digest, p, len);
+		return toHex(digest, sizeof(digest));
+	}
+
+	unsigned int digestLen(0);
+	if (_idKey.empty() || (HMAC(EVP_sha256(), _idKey.data(), static_cast<int>(_idKey.size()), p, len, digest, &digestLen) == nullptr))
+		return std::string();
+	return toHex(digest, digestLen);
+}
+
+std::string CChunkedUploader::chunkUrl(const std::string & id) const
+{
+	return fmt::format("{}/{}/{}/{}/{}", _ctx._credentials.get().endpoint(), _ctx._options->_dstContainer, chunkPrefix, id.substr(0, 2), id);
+}
+
+bool CChunkedUploader::putData(CRequest & rq, const std::string & url, const uint8_t * p, std::size_t len)
+{
+	rq.addHeader("Etag", NMD5::computeMd5(p, len).hex());
+	rq.put(url, p, len);
+	return (rq.getHttpResponseCode() == 201);
+}
+
+// thread safe, each part has its own request and buffers
+void CChunkedUploader::storeChunk(CPart & part)
+{
+	const uint8_t * p = part._data.data();
+	std::size_t len = part._data.size();
+	part._id = chunkId(p, len);
+	part._uploaded = part._dedup = 0;
+	part._ok = true;
+	if (part._id.empty()) {
+		LOGE("chunk id key error");
+		part._ok = false;
+		return;
+	}
+
+	if (_ctx._chunkIndex.contains(part._id)) {
+		part._dedup = len;
+		return;
+	}
+
+	// not in the local index : may have been stored from another machine
+	const std::string url = chunkUrl(part._id);
+	part._rq.setHeaders(_ctx._credentials.authHeaders());
+	part._rq.head(url);
+	if (part._rq.getHttpResponseCode() == 200) {
+		_ctx._chunkIndex.add(part._id);
+		part._dedup = len;
+		return;
+	}
+
+	if (crypted()) {
+		std::unique_ptr<CCryptoContext> cryptoContext( CCryptoContext::create(_ctx._options->_cryptoPassword) );
+		if (!part._cryptor.encrypt(part._cryptedData, p, len, cryptoContext.get())) {
+			LOGE("chunk encryption error");
+			part._ok = false;
+			return;
+		}
+		p   = part._cryptedData.data();
+		len = part._cryptedData.size();
+	}
+
+	part._rq.setHeaders(_ctx._credentials.uploadHeaders());
+	part._rq.addHeader("Content-Type", "application/octet-stream");
+	if (!putData(part._rq, url, p, len)) {
+		LOGE("Error uploading chunk '{}' [http response : {}]", url, part._rq.getHttpResponseCode());
+		part._ok = false;
+		return;
+	}
+
+	_ctx._chunkIndex.add(part._id);
+	part._uploaded = len;
+}
+
+// stores the first 'count' parts at once, then lists them in the recipe in
+// their order. 'failed' is the first part which couldn't be stored
+bool CChunkedUploader::storeParts(std::size_t count, jsonxx::Array & chunks, CPart * & failed)
+{
+	std::vector<std::thread> threads;
+	for (std::size_t i=1; i<count; ++i)
+		threads.push_back(std::thread(&CChunkedUploader::storeChunk, this, std::ref(*_parts[i])));
+	if (count > 0)
+		storeChunk(*_parts[0]);
+	for (auto & t : threads)
+		t.join();
+
+	failed = nullptr;
+	for (std::size_t i=0; i<count; ++i)
+	{
+		CPart & part = *_parts[i];
+		if (!part._ok) {
+			failed = &part;
+			return false;
+		}
+
+		jsonxx::Object chunk;
+		chunk << "id" << part._id;
+		chunk << "size" << static_cast<jsonxx::Number>(part._data.size());
+		chunks << chunk;
+		_totalUploaded += part._uploaded;
+		_totalDedup += part._dedup;
+	}
+	return true;
+}
+
+CUploader::result_code CChunkedUploader::upload(CAsset * p)
+{
+	assert( p );
+	assert( !p->isFolder() );
+	LOGD("uploading chunked {}", p->getRelativePath());
+	_totalUploaded = _totalDedup = _totalHoles = 0;
+
+	std::string cachedData;
+	const int slot = _ctx._readCache.open(_reader, p, cachedData);
+	if (slot < 0) {
+		LOGE("file open error '{}'", p->getFullPath());
+		return CUploader::resError;
+	}
+
+	// the buffer always holds a full chunk unless the file ends
+	std::vector<uint8_t> buffer(2 * _chunker.maxSize());
+	std::size_t filled(0);
+	bool eof(false);
+
+	NMD5::CComputer md5;
+	md5.init();
+	uint64_t fileSize(0);
+	jsonxx::Array chunks;
+	std::size_t filledParts(0);
+	CPart * failed(nullptr);
+	auto retryCode = [](const CRequest & rq) {
+		return (rq.getHttpResponseCode() == 401) || (rq.getHttpResponseCode() >= 500) ? CUploader::resRetry : CUploader::resError;
+	};
+	for (;;)
+	{
+		// chunks end where a hole starts
+		while ((!eof) && (filled < buffer.size())) {
+			const std::size_t len = std::min<uint64_t>(buffer.size() - filled, _reader.dataLength(slot));
+			if ((len == 0) && (_reader.holeLength(slot) > 0))
+				break;
+			const std::size_t n = _reader.read(slot, buffer.data() + filled, len);
+			filled += n;
+			if (n == 0)
+				eof = true;
+		}
+
+		if (_reader.error(slot)) {
+			LOGE("file read error '{}'", p->getFullPath());
+			_reader.close(slot);
+			return CUploader::resError;
+		}
+
+		if (filled == 0) {
+			// the chunks before it are listed first
+			if ((filledParts > 0) && !storeParts(filledParts, chunks, failed)) {
+				_reader.close(slot);
+				return retryCode(failed->_rq);
+			}
+			filledParts = 0;
+
+			// a hole of a sparse file : a zero run in the recipe, not read
+			// nor stored
+			const uint64_t hole = _reader.holeLength(slot);
+			if (hole == 0)
+				break;
+
+			_reader.skipHole(slot, hole);
+			feedZeros(md5, hole);
+			fileSize += hole;
+			_totalHoles += hole;
+
+			jsonxx::Object run;
+			run << "zero" << static_cast<jsonxx::Number>(hole);
+			chunks << run;
+			continue;
+		}
+
+		const std::size_t len = _chunker.next(buffer.data(), filled);
+		md5.feed(buffer.data(), len);
+		fileSize += len;
+
+		// stored once --upload-parts of them are filled
+		_parts[filledParts++]->_data.assign(buffer.data(), buffer.data() + len);
+		if (filledParts == _parts.size()) {
+			if (!storeParts(filledParts, chunks, failed)) {
+				_reader.close(slot);
+				return retryCode(failed->_rq);
+			}
+			filledParts = 0;
+		}
+
+		memmove(buffer.data(), buffer.data() + len, filled - len);
+		filled -= len;
+
+		if (_ctx.aborted()) {
+			_reader.close(slot);
+			return CUploader::resError;
+		}
+	}
+	_reader.close(slot);
+	md5.done();
+
+	CHash h = p->getSrcHash();
+	h._computed = true;
+	h._len = fileSize;
+	h._md5 = md5.getDigest();
+	p->setSrcHash(h);
+
+	jsonxx::Object recipe;
+	recipe << "format"  << "hubk-chunked";
+	recipe << "version" << static_cast<jsonxx::Number>(2);
+	recipe << "size"    << static_cast<jsonxx::Number>(fileSize);
+	recipe << "md5"     << h._md5.hex();
+	recipe << "crypted" << crypted();
+	recipe << "chunks"  << chunks;
+	const std::string json = recipe.json();
+
+	// the plain md5 and size are set as for crypted files so the up to date
+	// checks are unchanged
+	const std::string url= fmt::format("{}/{}/{}", _ctx._credentials.get().endpoint(), _ctx._options->_dstContainer, (_ctx._options->_dstFolder / _rq.escapePath(p->getRelativePath())).string() );
+	_rq.setHeaders(_ctx._credentials.uploadHeaders());
+	_rq.addHeader("Content-Type", "application/json");
+	_rq.addHeader(metaChunked, "1");
+	_rq.addHeader(metaUncryptedMd5, h._md5.hex());
+	_rq.addHeader(metaUncryptedLen, fmt::format("{}", fileSize));
+	if (crypted())
+		_rq.addHeader(metaCryptoKey, _ctx._options->_cryptoKey.hex());
+	_rq.addHeader(metaLastModificationDate, fmt::format("{}", p->getLocalLastModifTime()));
+	if (!putData(_rq, url, reinterpret_cast<const uint8_t*>(json.data()), json.size())) {
+		LOGE("Error uploading recipe '{}' [http response : {}]", url, _rq.getHttpResponseCode());
+		return retryCode(_rq);
+	}
+
+	_totalUploaded += json.size();
+	LOGD("'{}' uploaded Ok. {} chunk(s), {} bytes already stored, {} bytes of holes", url, chunks.size(), _totalDedup, _totalHoles);
+	return CUploader::resOk;
+}
@@ -0,0 +1,111 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#pragma once
+
+#include "context.h"
+#include "chunker.h"
+#include "crypto.h"
+#include "uploader.h"
+
+namespace jsonxx { class Array; }
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+
+Chunked backup format (--chunked)
+
+Files are split by CChunker. Each chunk is stored once in the container, under
+	.hubk-chunks/<2 first id chars>/<id>
+where id is the hex sha256 of the chunk, or when crypted, its hex
+hmac-sha256 keyed by the chunk ids key derived from the password (see
+cryptGcm.h). Without the password, a known plain chunk can't be looked for.
+Crypted chunks are encrypted separately, each one is an 'openssl enc
+-aes-256-cbc' file.
+
+The file itself is stored at its usual place as a json recipe :
+	{ "format": "hubk-chunked", "version": 2, "size": N, "md5": "...",
+	  "crypted": false, "chunks": [ { "id": "...", "size": n }, ... ] }
+Restoring it is concatenating its (decrypted) chunks. Version 1 recipes keyed
+crypted ids by the published crypto key check value : their chunks restore the
+same way, but are not reused by version 2 recipes.
+
+The holes of sparse files, as SEEK_HOLE reports them (rounded to the 256 Ko
+read pieces), are neither read nor stored. They are listed between the chunks
+as zero runs :
+	{ "zero": n }
+which restore as n zero bytes, or as a hole.
+
+With --upload-parts N, up to N chunks of a file are checked, encrypted and
+stored at once, each by its own request. The recipe keeps the file order.
+
+*/
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CChunkedUploader
+:	public CContextual
+{
+public:
+	CChunkedUploader(CContext & ctx);
+
+public:
+	CUploader::result_code upload(CAsset * p);
+	uint64_t uploadedByteCount() const { return _totalUploaded; }
+	uint64_t dedupByteCount() const { return _totalDedup; }
+
+private:
+	// a chunk being stored, with what its request needs
+	struct CPart
+	{
+		CPart(bool bVerbose) : _rq(bVerbose), _ok(false), _uploaded(0), _dedup(0) {}
+
+		CRequest             _rq;
+		CCryptEngine         _cryptor;
+		std::vector<uint8_t> _data;
+		std::vector<uint8_t> _cryptedData;
+		std::string          _id;
+		bool                 _ok;
+		uint64_t             _uploaded;
+		uint64_t             _dedup;
+	};
+
+	bool crypted() const { return _ctx._options->crypted(); }
+	std::string chunkId(const uint8_t * p, std::size_t len) const;
+	std::string chunkUrl(const std::string & id) const;
+	void storeChunk(CPart & part);
+	bool storeParts(std::size_t count, jsonxx::Array & chunks, CPart * & failed);
+	bool putData(CRequest & rq, const std::string & url, const uint8_t * p, std::size_t len);
+
+private:
+	CRequest      _rq;
+	CFileReader   _reader;
+	CChunker      _chunker;
+	std::vector<std::unique_ptr<CPart>> _parts;
+	uint64_t _totalUploaded;
+	uint64_t _totalDedup;
+	uint64_t _totalHoles;
+	std::vector<uint8_t> _idKey; // crypted chunks ids
+};
@@ -0,0 +1,106 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "chunker.h"
+#include <algorithm>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	// 256 random 64 bits values (splitmix64, fixed seed)
+	struct CGearTable
+	{
+		uint64_t _v[256];
+
+		CGearTable() {
+			uint64_t x = 0x6875626b2d636463ULL; // "hubk-cdc"
+			for (int i=0; i<256; ++i) {
+				uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+				z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+				z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+				_v[i] = z ^ (z >> 31);
+			}
+		}
+	};
+
+	const CGearTable s_gear;
+
+	// 'bits' most significant bits set. The gear hash shifts left, so the
+	// top bits depend on the last 64 bytes while the low bits only depend
+	// on the very last ones
+	uint64_t topBitsMask(int bits)
+	{
+		return ~0ULL << (64 - bits);
+	}
+
+	int log2(std::size_t v)
+	{
+		int r(0);
+		while (v >>= 1)
+			r++;
+		return r;
+	}
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+CChunker::CChunker(std::size_t minSize, std::size_t avgSize, std::size_t maxSize)
+:	_minSize(minSize)
+,	_avgSize(avgSize)
+,	_maxSize(maxSize)
+{
+	// normalization level 2
+	const int bits = log2(avgSize);
+	_maskS = topBitsMask(bits + 2);
+	_maskL = topBitsMask(bits - 2);
+}
+
+std::size_t CChunker::next(const uint8_t * p, std::size_t len) const
+{
+	if (len <= _minSize)
+		return len;
+
+	const uint64_t * gear = s_gear._v;
+	const std::size_t normal = std::min(len, _avgSize);
+	const std::size_t end    = std::min(len, _maxSize);
+	const uint64_t maskS = _maskS;
+	const uint64_t maskL = _maskL;
+
+	uint64_t fp(0);
+	std::size_t i = _minSize;
+	for (; i < normal; ++i) {
+		fp = (fp << 1) + gear[p[i]];
+		if (!(fp & maskS))
+			return i + 1;
+	}
+
+	for (; i < end; ++i) {
+		fp = (fp << 1) + gear[p[i]];
+		if (!(fp & maskL))
+			return i + 1;
+	}
+
+	return end;
+}
@@ -0,0 +1,66 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+constexpr std::size_t chunkMinSize = 256 * 1024;
+constexpr std::size_t chunkAvgSize = 1024 * 1024;
+constexpr std::size_t chunkMaxSize = 4 * 1024 * 1024;
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Content defined chunker (FastCDC). A gear rolling hash is updated for each
+// byte and a chunk ends when its top bits are zero. Cut points only depend on
+// the content around them, so an insertion only changes the chunks near it.
+//
+// The first chunkMinSize bytes of a chunk are skipped without hashing, a
+// harder mask is used below chunkAvgSize and an easier one above (normalized
+// chunking) so chunk sizes stay close to the average.
+//
+// The gear table and masks define the chunk boundaries of every stored
+// backup : they must never change.
+
+class CChunker
+{
+public:
+	CChunker(std::size_t minSize = chunkMinSize, std::size_t avgSize = chunkAvgSize, std::size_t maxSize = chunkMaxSize);
+
+public:
+	// length of the chunk starting at 'p'. 'len' must be at least maxSize()
+	// unless the data ends at p + len
+	std::size_t next(const uint8_t * p, std::size_t len) const;
+	std::size_t maxSize() const { return _maxSize; }
+
+private:
+	const std::size_t _minSize;
+	const std::size_t _avgSize;
+	const std::size_t _maxSize;
+	uint64_t _maskS; // below average size
+	uint64_t _maskL; // above average size
+};
@@ -90,10 +90,36 @@ constexpr const char * metaUncryptedLen= "X-Object-Meta-Hubk-UncryptedLen";
 constexpr const char * metaVersion     = "X-Object-Meta-Hubk-Version";
 constexpr const char * metaCryptoKey   = "X-Object-Meta-Hubk-Cryptokey";
 constexpr const char * metaLastModificationDate= "X-Object-Meta-Hubk-LastModDate";
+constexpr const char * metaChunked     = "X-Object-Meta-Hubk-Chunked";
+constexpr const char * metaCompression = "X-Object-Meta-Hubk-Compression"; // "gzip" when compressed
+constexpr const char * metaCryptFormat = "X-Object-Meta-Hubk-CryptFormat"; // "gcm1" when --crypt-format gcm, else cbc
+
+constexpr const char * chunkPrefix = ".hubk-chunks"; // chunked backups store, at the container root
+constexpr const char * packPrefix  = ".hubk-packs";  // small files packs, at the container root
+constexpr const char * summaryPrefix = ".hubk-folders"; // folder summaries manifests, at the container root
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 constexpr uint64_t fileSizeMax = 5368709120ULL; // 5 Go = 5*1024*1024*1024
+constexpr uint64_t smallObjectSizeMax = 1048576ULL; // 1 Mo. Smaller uploads are multiplexed with HTTP/2
+constexpr long     http2MaxHostConnections = 4;
+constexpr unsigned http2MinCurlVersion = 0x080100; // 8.1.0, older libcurl runs HTTP/1.1 with --http2
+constexpr std::size_t bulkDeleteMaxPaths = 10000; // swift bulk-delete middleware default
+constexpr std::size_t listingPageSize = 10000; // swift container listing default limit
+constexpr uint64_t copyMinSize = 1048576ULL; // smaller new files are uploaded, a server side copy costs as many requests
+constexpr std::size_t copyMaxCandidates = 4; // crypted copy candidates checked with a HEAD
+constexpr uint64_t chunkedFileSizeMin = 1048576ULL; // smaller files are uploaded whole with --chunked
+constexpr std::size_t chunkIndexCheckCount = 16; // known chunks checked with a HEAD before the local index is trusted
+constexpr uint64_t packSizeTarget = 67108864ULL; // 64 Mo. Pack objects of --pack-small-files are uploaded when full
+constexpr uint64_t archiveBatchBytes = 16777216ULL; // 16 Mo. --archive-small-files batches are sent when full
+constexpr std::size_t archiveBatchMaxFiles = 1000; // swift bulk middleware max_failed_extractions default
+constexpr std::size_t compressSampleSize = 65536; // first block of a file, compressed to tell if the file is worth it
+constexpr uint64_t compressRatioMax = 90; // % : files whose sample doesn't shrink more are stored as is
+constexpr uint64_t readCacheFileMax = 16777216ULL; // 16 Mo. Larger files are read again by --read-cache uploads
+constexpr std::size_t ioPieceSize = 262144; // 256 Ko, the read unit of CFileReader, also fed per file and per round to the multi buffer md5
+constexpr std::size_t rotationalDeviceReaders = 2; // files read at once from a spinning disk by --device-readers auto
+constexpr int uploadPartsMax = 16; // --upload-parts : chunks of a file stored at once, each one held in memory
+constexpr uint64_t deadlineSampleMin = 256 * 1024; // --deadline : smaller uploads are bound by the latency, they don't measure the throughput
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
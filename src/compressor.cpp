@@ -0,0 +1,146 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "compressor.h"
+#include "common.h"
+#include <zlib.h>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CCompressor::CImpl
+{
+public:
+	CImpl() : _started(false) { memset(&_z, 0, sizeof(_z)); }
+	~CImpl() { end(); }
+
+	void end() {
+		if (_started)
+			deflateEnd(&_z);
+		_started = false;
+	}
+
+	bool deflate(std::vector<uint8_t> & dst, const void * pSrc, std::size_t srcSize, int flush)
+	{
+		_z.next_in  = reinterpret_cast<Bytef*>(const_cast<void*>(pSrc));
+		_z.avail_in = static_cast<uInt>(srcSize);
+		for (;;)
+		{
+			const std::size_t offset = dst.size();
+			dst.resize(offset + std::max<std::size_t>(deflateBound(&_z, _z.avail_in), 16384));
+			_z.next_out  = dst.data() + offset;
+			_z.avail_out = static_cast<uInt>(dst.size() - offset);
+			const int r = ::deflate(&_z, flush);
+			dst.resize(dst.size() - _z.avail_out);
+
+			if (r == Z_STREAM_ERROR) {
+				LOGE("zlib deflate error {}", r);
+				return false;
+			}
+
+			if (flush == Z_FINISH) {
+				if (r == Z_STREAM_END)
+					return true;
+			} else if ((_z.avail_in == 0) && (_z.avail_out != 0))
+				return true;
+		}
+	}
+
+public:
+	z_stream _z;
+	bool     _started;
+};
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+CCompressor::CCompressor()
+:	_p(new CImpl)
+{
+}
+
+CCompressor::~CCompressor()
+{
+	delete _p;
+}
+
+bool CCompressor::start(int level)
+{
+	_p->end();
+	memset(&_p->_z, 0, sizeof(_p->_z));
+
+	// 15 + 16 : gzip wrapper, so a stored object is a regular .gz file
+	if (deflateInit2(&_p->_z, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		LOGE("zlib initialisation error (level {})", level);
+		return false;
+	}
+	_p->_started = true;
+	return true;
+}
+
+bool CCompressor::update(std::vector<uint8_t> & dst, const void * pSrc, std::size_t srcSize)
+{
+	assert(_p->_started);
+	return (srcSize == 0) || _p->deflate(dst, pSrc, srcSize, Z_NO_FLUSH);
+}
+
+bool CCompressor::finalize(std::vector<uint8_t> & dst)
+{
+	assert(_p->_started);
+	const bool bOk = _p->deflate(dst, nullptr, 0, Z_FINISH);
+	_p->end();
+	return bOk;
+}
+
+bool CCompressor::compress(std::vector<uint8_t> & dst, const void * pSrc, std::size_t srcSize, int level)
+{
+	dst.clear();
+	return start(level) && update(dst, pSrc, srcSize) && finalize(dst);
+}
+
+bool CCompressor::isCompressible(const void * pSample, std::size_t sampleSize, int level)
+{
+	if (sampleSize == 0)
+		return false;
+
+	// the lowest level is enough to tell, and fast
+	std::vector<uint8_t> z;
+	CCompressor c;
+	if (!c.compress(z, pSample, sampleSize, std::min(level, 1)))
+		return false;
+
+	return (z.size() * 100) <= (sampleSize * compressRatioMax);
+}
+
+bool CCompressor::compressIfWorth(std::string & data, int level)
+{
+	if ((level == 0) || !isCompressible(data.data(), std::min(data.size(), compressSampleSize), level))
+		return false;
+
+	std::vector<uint8_t> z;
+	CCompressor c;
+	if ((!c.compress(z, data.data(), data.size(), level)) || (z.size() >= data.size()))
+		return false;
+
+	data.assign(z.begin(), z.end());
+	return true;
+}
@@ -0,0 +1,69 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*
+
+--compress LEVEL : file contents are gzip compressed before encryption.
+Objects are restored with 'gunzip', after 'openssl enc -d' when crypted.
+
+*/
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CCompressor
+{
+public:
+	CCompressor();
+	virtual ~CCompressor();
+
+public:
+	bool start(int level);
+	bool update(std::vector<uint8_t> & dst, const void * pSrc, std::size_t srcSize);
+	bool finalize(std::vector<uint8_t> & dst);
+
+	// whole buffer at once : dst receives a complete gzip file
+	bool compress(std::vector<uint8_t> & dst, const void * pSrc, std::size_t srcSize, int level);
+
+	// false when a sample of the file (its first block) doesn't shrink
+	// enough : media, archives, already compressed or crypted data
+	static bool isCompressible(const void * pSample, std::size_t sampleSize, int level);
+
+	// small files held in memory : data is replaced by its compression when
+	// worth it. Returns true then
+	static bool compressIfWorth(std::string & data, int level);
+
+private:
+	CCompressor(const CCompressor &) = delete;
+	CCompressor & operator=(const CCompressor &) = delete;
+
+private:
+	class CImpl;
+	CImpl *  _p;
+};
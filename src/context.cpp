@@ -63,26 +63,116 @@ CContext::CContext(int argc, char ** argv)
 	_console->set_level(spdlog::level::trace);
 #endif
 	_options = COptions::get( argc, argv );
+	if (_options && _options->_http2)
+		_curlLib.enableHttp2(http2MaxHostConnections);
+	if (_options)
+		_readCache.init(_options->_readCacheMax);
+	if (_options && _options->shaped())
+		_shaper.reset(new CShaper(_options->_uploadRate, _options->_requestRate, _options->_rateFile));
+
+	// files are hashed, then uploaded, in the disk order. Without a
+	// content fingerprint, hashing reads nothing
+	if (_options && (_options->_readOrder != EReadOrder::scan)) {
+		auto key = [](const CAsset * p) { return p->getReadKey(); };
+		if (_options->contentFingerPrint())
+			_localMd5Queue.setOrder(key);
+		_todoQueue.setOrder(key);
+	}
+
+	// --upload-order : the checked files wait for an upload thread by
+	// priority, instead of the read order
+	if (_options && (_options->_uploadOrder != EUploadOrder::scan)) {
+		const uint64_t top = std::numeric_limits<uint64_t>::max();
+		switch (_options->_uploadOrder) {
+			case EUploadOrder::largest : _todoQueue.setPriority([top](const CAsset * p) { return top - p->getSrcHash()._len; }); break;
+			case EUploadOrder::smallest: _todoQueue.setPriority([](const CAsset * p) { return p->getSrcHash()._len; }); break;
+			case EUploadOrder::newest  : _todoQueue.setPriority([top](const CAsset * p) { return top - p->getLocalLastModifTime(); }); break;
+			case EUploadOrder::scan    : break;
+		}
+	}
+
+	// pending files and readers counted by device, a slow disk doesn't hold
+	// the threads the other ones could use
+	if (_options) {
+		const COptions * o = _options;
+		auto device = [](const CAsset * p) { return p->getDevice(); };
+		auto limit  = [o](uint64_t d) { return o->deviceReaders(d); };
+		if (_options->contentFingerPrint())
+			_localMd5Queue.setDevice(device, limit);
+		_todoQueue.setDevice(device, limit);
+	}
 }
 
 bool CContext::getCredentials()
 {
 	assert( _options);
-	if (_options->_authToken.empty())
-		_cr = ::getCredentials(_options->_hubicLogin, _options->_hubicPassword, _options->_curlVerbose);
+	if (_options->_authToken.empty()) {
 	
-	else {
+		CGetCredentialSettings settings;
+		settings._login = _options->_hubicLogin;
+		settings._pwd   = _options->_hubicPassword;
+		
+		bf::path cachePath;
+		if (_options->_cacheCredentials)
+			cachePath = _options->_stateDir / fmt::format("credentials-{}.json", NMD5::computeMd5(_options->_hubicLogin).hex());
+		
+		if (!_credentials.init(settings, _options->_curlVerbose, cachePath)) {
+			LOGC("Can't get credentials. Application will now exit.");
+			return false;
+		}
+	
+	} else {
 		//const std::string s = R"c(
 		//{"token":"48c8f44f3c34473aa1927adcaa3a31a3","endpoint":"https://lb1040.hubic.ovh.net/v1/AUTH_47e7e0fe42913821a6365ad2e220bcc5","expires":"2015-03-20T01:15:51+01:00"}
 		//)c";
 	
-		_cr.fromJson(
+		CCredentials cr;
+		cr.fromJson(
 			"{\"token\":\"" + _options->_authToken + "\",\"endpoint\":\"" + _options->_authEndpoint + "\",\"expires\":\"2015-03-20T01:15:51+01:00\"}"
 		);
+		_credentials.initFixed(cr);
 	}
+
 	return true;
 }
 
+bool CContext::openChunkIndex()
+{
+	assert( _options);
+	if (!_options->_chunked)
+		return true;
+
+	// one index per container
+	const std::string key = _credentials.get().endpoint() + "/" + _options->_dstContainer;
+	if (!_chunkIndex.open( _options->_stateDir / fmt::format("chunks-{}.idx", NMD5::computeMd5(key).hex()) ))
+		return false;
+
+	// known chunks are not checked again : the index is dropped when a sample
+	// of it isn't in the container any more, see CChunkIndex
+	CRequest rq(_options->_curlVerbose);
+	for (const auto & id : _chunkIndex.sample(chunkIndexCheckCount))
+	{
+		rq.setHeaders(_credentials.authHeaders());
+		rq.head(fmt::format("{}/{}/{}/{}/{}", _credentials.get().endpoint(), _options->_dstContainer, chunkPrefix, id.substr(0, 2), id));
+		if (rq.getHttpResponseCode() != 200) {
+			LOGW("chunk index : known chunk '{}' not found in the container [http response : {}]. Every chunk is checked again", id, rq.getHttpResponseCode());
+			_chunkIndex.clear();
+			break;
+		}
+	}
+	return true;
+}
+
+bool CContext::openFingerprintIndex()
+{
+	assert( _options);
+	if (!_options->_fastFingerPrint)
+		return true;
+
+	// one index per source folder, paths are relative to it
+	return _fingerprintIndex.open( _options->_stateDir / fmt::format("fingerprints-{}.idx", NMD5::computeMd5(_options->_srcFolder.string()).hex()) );
+}
+
 void CContext::abort()
 {
 	if (_aborted)
@@ -29,9 +29,14 @@
 #include "common.h"
 #include "options.h"
 #include "curl.h"
+#include "request.h"
 #include "auth.h"
 #include "queue.h"
 #include "asset.h"
+#include "chunkIndex.h"
+#include "fingerprintIndex.h"
+#include "readCache.h"
+#include "shaper.h"
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -41,13 +46,21 @@ public:
 	CContext(int argc, char ** argv);
 	bool crypted() const { return _options ? _options->crypted() : false; }
 	bool getCredentials();
+	bool openChunkIndex();
+	bool openFingerprintIndex();
 	bool aborted() { return _aborted; }
+	// --deadline passed : nothing new is started, the run ends cleanly
+	bool deadlineReached() const { return _options && (_options->_deadline != 0) && (std::time(nullptr) >= _options->_deadline); }
 	void abort();
 
 public:
 	const COptions * _options;
 	
-	CCredentials _cr;
+	CCredentialProvider _credentials;
+	CChunkIndex         _chunkIndex;
+	CFingerprintIndex   _fingerprintIndex;
+	CReadCache          _readCache;
+	std::unique_ptr<CShaper> _shaper; // --upload-rate, --request-rate. null without limit
 	
 	CTQueue<CAsset> _localMd5Queue;
 	CTQueue<CAsset> _localMd5DoneQueue;
@@ -91,3 +91,33 @@ bool CCredentials::fromJson(const std::string & j)
 
 }
 
+std::string CCredentials::toJson() const
+{
+	jsonxx::Object root;
+	root << "token"    << _token;
+	root << "endpoint" << _endpoint;
+	root << "expires"  << _expires;
+	return root.json();
+}
+
+std::time_t CCredentials::expiresTime() const
+{
+	// ISO 8601 as returned by hubic : 2015-03-20T01:15:51+01:00
+	struct tm t;
+	memset(&t, 0, sizeof(t));
+	char sign('+');
+	int offH(0), offM(0);
+	const int n = sscanf(_expires.c_str(), "%4d-%2d-%2dT%2d:%2d:%2d%c%2d:%2d",
+		&t.tm_year, &t.tm_mon, &t.tm_mday, &t.tm_hour, &t.tm_min, &t.tm_sec, &sign, &offH, &offM);
+	if (n < 6)
+		return 0;
+
+	t.tm_year -= 1900;
+	t.tm_mon  -= 1;
+	std::time_t res = timegm(&t);
+	if (n == 9) {
+		const std::time_t offset = 3600 * offH + 60 * offM;
+		res += (sign == '-') ? offset : -offset;
+	}
+	return res;
+}
@@ -25,6 +25,7 @@
 #pragma once
 
 #include <string>
+#include <ctime>
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -36,11 +37,14 @@ public:
 	CCredentials & operator=(const CCredentials & src);
 	void clear();
 	bool fromJson(const std::string & j);
+	std::string toJson() const;
+	bool isValid() const { return !(_token.empty() || _endpoint.empty()); }
 	
 public:
 	std::string token   () const { return _token   ; }
 	std::string endpoint() const { return _endpoint; }
 	std::string expires () const { return _expires ; }
+	std::time_t expiresTime() const; // 0 if unknown
 
 private:
 	std::string _token   ;
@@ -0,0 +1,351 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "cryptGcm.h"
+#include "common.h"
+#include <cassert>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	constexpr char        gcmMagic[] = "HUBKGCM1";
+	constexpr std::size_t gcmNonceSize = 12;
+	constexpr std::size_t gcmKeySize   = 32;
+	constexpr std::size_t gcmSaltSize  = 16;
+	constexpr int         gcmIterations = 100000;
+
+	void putU32(uint8_t * p, uint32_t v) { for (int i=3; i>=0; --i, v >>= 8) p[i] = static_cast<uint8_t>(v); }
+	void putU64(uint8_t * p, uint64_t v) { for (int i=7; i>=0; --i, v >>= 8) p[i] = static_cast<uint8_t>(v); }
+	uint32_t getU32(const uint8_t * p) { return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3]; }
+
+	// the pbkdf2 master key is computed once per password
+	bool getMasterKey(uint8_t * key, const std::string & pwd)
+	{
+		static std::mutex s_m;
+		static std::string s_pwd;
+		static uint8_t s_key[gcmKeySize];
+		static bool s_valid(false);
+
+		std::lock_guard<std::mutex> lock(s_m);
+		if ((!s_valid) || (s_pwd != pwd)) {
+			static const std::string salt("hubic-backup gcm1");
+			s_valid = PKCS5_PBKDF2_HMAC(pwd.data(), static_cast<int>(pwd.size()),
+				reinterpret_cast<const unsigned char*>(salt.data()), static_cast<int>(salt.size()),
+				gcmIterations, EVP_sha256(), gcmKeySize, s_key) == 1;
+			s_pwd = pwd;
+		}
+		memcpy(key, s_key, gcmKeySize);
+		return s_valid;
+	}
+
+	bool getFileKey(uint8_t * key, const std::string & pwd, const uint8_t * salt)
+	{
+		uint8_t master[gcmKeySize];
+		unsigned int len(0);
+		return getMasterKey(master, pwd) &&
+			(HMAC(EVP_sha256(), master, gcmKeySize, salt, gcmSaltSize, key, &len) != nullptr) &&
+			(len == gcmKeySize);
+	}
+
+	// encrypts (or decrypts and checks) one chunk. dst holds len + tag bytes
+	// when encrypting, src holds them when decrypting
+	bool cryptChunk(bool bEncrypt, uint8_t * dst, const uint8_t * key, const uint8_t * header, uint64_t index, bool bLast, const uint8_t * src, std::size_t len)
+	{
+		uint8_t nonce[gcmNonceSize];
+		putU32(nonce, bLast ? 1 : 0);
+		putU64(nonce + 4, index);
+
+		EVP_CIPHER_CTX * ctx = EVP_CIPHER_CTX_new();
+		if (ctx == nullptr)
+			return false;
+
+		int outl(0);
+		bool bOk =
+			(EVP_CipherInit_ex(ctx, EVP_aes_256_gcm(), nullptr, nullptr, nullptr, bEncrypt ? 1 : 0) == 1) &&
+			(EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, gcmNonceSize, nullptr) == 1) &&
+			(EVP_CipherInit_ex(ctx, nullptr, nullptr, key, nonce, bEncrypt ? 1 : 0) == 1) &&
+			(EVP_CipherUpdate(ctx, nullptr, &outl, header, gcmHeaderSize) == 1) &&
+			(EVP_CipherUpdate(ctx, dst, &outl, src, static_cast<int>(len)) == 1);
+
+		if (bOk && bEncrypt)
+			bOk = (EVP_CipherFinal_ex(ctx, dst + len, &outl) == 1) &&
+				(EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, gcmTagSize, dst + len) == 1);
+
+		else if (bOk)
+			bOk = (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, gcmTagSize, const_cast<uint8_t*>(src + len)) == 1) &&
+				(EVP_CipherFinal_ex(ctx, dst + len, &outl) == 1);
+
+		EVP_CIPHER_CTX_free(ctx);
+		return bOk;
+	}
+
+	// f(i) for i in [0, n) on up to numThread threads, the calling one included
+	template<typename F>
+	bool parallelFor(std::size_t n, int numThread, F f)
+	{
+		const std::size_t threadCount = std::max<std::size_t>(1, std::min<std::size_t>(n, numThread));
+		std::vector<char> results(n, 0);
+		auto work = [&](std::size_t t) {
+			for (std::size_t i=t; i<n; i+=threadCount)
+				results[i] = f(i) ? 1 : 0;
+		};
+
+		std::vector<std::thread> threads;
+		for (std::size_t t=1; t<threadCount; ++t)
+			threads.push_back(std::thread(work, t));
+		work(0);
+		for (auto & t : threads)
+			t.join();
+
+		return std::all_of(results.begin(), results.end(), [](char r) { return r != 0; });
+	}
+
+	// the chunks sealed at once, with their offsets in the plain and crypted data
+	struct CChunkBatch
+	{
+		CChunkBatch(std::size_t plainSize, std::size_t chunkSize, std::size_t count)
+		{
+			for (std::size_t i=0, pos=0; i<count; ++i, pos+=chunkSize)
+				_lengths.push_back(std::min(chunkSize, plainSize - pos));
+		}
+		std::vector<std::size_t> _lengths;
+	};
+}
+
+uint64_t getGcmCryptedSize(uint64_t uncryptedSize)
+{
+	const uint64_t chunkCount = std::max<uint64_t>(1, (uncryptedSize + gcmChunkSize - 1) / gcmChunkSize);
+	return gcmHeaderSize + uncryptedSize + chunkCount * gcmTagSize;
+}
+
+bool getChunkIdKey(uint8_t * key, const std::string & pwd)
+{
+	// file keys are hmacs of 16 bytes salts : this label can't match one
+	static const std::string label("hubk chunk ids");
+	uint8_t master[gcmKeySize];
+	unsigned int len(0);
+	return getMasterKey(master, pwd) &&
+		(HMAC(EVP_sha256(), master, gcmKeySize, reinterpret_cast<const unsigned char*>(label.data()), label.size(), key, &len) != nullptr) &&
+		(len == chunkIdKeySize);
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CGcmCryptEngine::CImpl
+{
+public:
+	CImpl(int numThread) : _numThread(numThread), _index(0) {}
+
+	// seals the 'count' first chunks of _in. The last one is flagged with bLast
+	bool seal(std::vector<uint8_t> & dst, std::size_t count, bool bLast)
+	{
+		const CChunkBatch batch(_in.size(), gcmChunkSize, count);
+		std::vector<std::size_t> srcOffsets, dstOffsets;
+		std::size_t srcPos(0), dstPos(dst.size());
+		for (const auto len : batch._lengths) {
+			srcOffsets.push_back(srcPos);
+			dstOffsets.push_back(dstPos);
+			srcPos += len;
+			dstPos += len + gcmTagSize;
+		}
+		dst.resize(dstPos);
+
+		const bool bOk = parallelFor(count, _numThread, [&](std::size_t i) {
+			return cryptChunk(true, dst.data() + dstOffsets[i], _key, _header, _index + i, bLast && (i + 1 == count), _in.data() + srcOffsets[i], batch._lengths[i]);
+		});
+
+		_in.erase(_in.begin(), _in.begin() + srcPos);
+		_index += count;
+		return bOk;
+	}
+
+public:
+	int      _numThread;
+	uint8_t  _key[gcmKeySize];
+	uint8_t  _header[gcmHeaderSize];
+	uint64_t _index;
+	std::vector<uint8_t> _in;
+};
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+CGcmCryptEngine::CGcmCryptEngine(int numThread)
+:	_p(new CImpl(std::max(1, numThread)))
+{
+}
+
+CGcmCryptEngine::~CGcmCryptEngine()
+{
+	delete _p;
+}
+
+bool CGcmCryptEngine::encryptStart(std::vector<uint8_t> & dst, const std::string & pwd)
+{
+	uint8_t * h = _p->_header;
+	memcpy(h, gcmMagic, 8);
+	putU32(h + 8, gcmChunkSize);
+	putU32(h + 12, 0);
+	if (RAND_bytes(h + 16, gcmSaltSize) != 1)
+		return false;
+
+	_p->_index = 0;
+	_p->_in.clear();
+	if (!getFileKey(_p->_key, pwd, h + 16)) {
+		LOGE("gcm key derivation failed");
+		return false;
+	}
+
+	dst.assign(h, h + gcmHeaderSize);
+	return true;
+}
+
+bool CGcmCryptEngine::update(std::vector<uint8_t> & dst, const void * pSrc, std::size_t srcSize)
+{
+	dst.clear();
+	const uint8_t * p = reinterpret_cast<const uint8_t*>(pSrc);
+	_p->_in.insert(_p->_in.end(), p, p + srcSize);
+
+	// one chunk per thread at least, and some data left for the last chunk
+	const std::size_t fullCount = _p->_in.empty() ? 0 : (_p->_in.size() - 1) / gcmChunkSize;
+	if (fullCount < static_cast<std::size_t>(_p->_numThread))
+		return true;
+
+	return _p->seal(dst, fullCount, false);
+}
+
+bool CGcmCryptEngine::finalize(std::vector<uint8_t> & dst)
+{
+	dst.clear();
+	const std::size_t count = std::max<std::size_t>(1, (_p->_in.size() + gcmChunkSize - 1) / gcmChunkSize);
+	return _p->seal(dst, count, true);
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CGcmDecryptEngine::CImpl
+{
+public:
+	CImpl(int numThread) : _numThread(numThread), _chunkSize(0), _index(0) {}
+
+	// opens the 'count' first stored chunks of _in
+	bool open(std::vector<uint8_t> & dst, std::size_t count, bool bLast)
+	{
+		const CChunkBatch batch(_in.size(), _chunkSize + gcmTagSize, count);
+		std::vector<std::size_t> srcOffsets, dstOffsets;
+		std::size_t srcPos(0), dstPos(dst.size());
+		for (const auto len : batch._lengths) {
+			if (len < gcmTagSize)
+				return false;
+			srcOffsets.push_back(srcPos);
+			dstOffsets.push_back(dstPos);
+			srcPos += len;
+			dstPos += len - gcmTagSize;
+		}
+		dst.resize(dstPos);
+
+		const bool bOk = parallelFor(count, _numThread, [&](std::size_t i) {
+			return cryptChunk(false, dst.data() + dstOffsets[i], _key, _header, _index + i, bLast && (i + 1 == count), _in.data() + srcOffsets[i], batch._lengths[i] - gcmTagSize);
+		});
+
+		_in.erase(_in.begin(), _in.begin() + srcPos);
+		_index += count;
+		return bOk;
+	}
+
+public:
+	int         _numThread;
+	std::string _pwd;
+	std::size_t _chunkSize; // 0 until the header is read
+	uint8_t     _key[gcmKeySize];
+	uint8_t     _header[gcmHeaderSize];
+	uint64_t    _index;
+	std::vector<uint8_t> _in;
+};
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+CGcmDecryptEngine::CGcmDecryptEngine(int numThread)
+:	_p(new CImpl(std::max(1, numThread)))
+{
+}
+
+CGcmDecryptEngine::~CGcmDecryptEngine()
+{
+	delete _p;
+}
+
+bool CGcmDecryptEngine::decryptStart(const std::string & pwd)
+{
+	_p->_pwd = pwd;
+	_p->_chunkSize = 0;
+	_p->_index = 0;
+	_p->_in.clear();
+	return true;
+}
+
+bool CGcmDecryptEngine::update(std::vector<uint8_t> & dst, const void * pSrc, std::size_t srcSize)
+{
+	dst.clear();
+	const uint8_t * p = reinterpret_cast<const uint8_t*>(pSrc);
+	_p->_in.insert(_p->_in.end(), p, p + srcSize);
+
+	if (_p->_chunkSize == 0) {
+		if (_p->_in.size() < gcmHeaderSize)
+			return true;
+
+		memcpy(_p->_header, _p->_in.data(), gcmHeaderSize);
+		_p->_in.erase(_p->_in.begin(), _p->_in.begin() + gcmHeaderSize);
+		_p->_chunkSize = getU32(_p->_header + 8);
+		if ((memcmp(_p->_header, gcmMagic, 8) != 0) || (_p->_chunkSize == 0)) {
+			LOGE("not a gcm1 crypted file");
+			return false;
+		}
+		if (!getFileKey(_p->_key, _p->_pwd, _p->_header + 16)) {
+			LOGE("gcm key derivation failed");
+			return false;
+		}
+	}
+
+	const std::size_t storedChunkSize = _p->_chunkSize + gcmTagSize;
+	const std::size_t fullCount = _p->_in.empty() ? 0 : (_p->_in.size() - 1) / storedChunkSize;
+	if (fullCount < static_cast<std::size_t>(_p->_numThread))
+		return true;
+
+	return _p->open(dst, fullCount, false);
+}
+
+bool CGcmDecryptEngine::finalize(std::vector<uint8_t> & dst)
+{
+	dst.clear();
+	if (_p->_chunkSize == 0)
+		return false;
+
+	const std::size_t storedChunkSize = _p->_chunkSize + gcmTagSize;
+	const std::size_t count = std::max<std::size_t>(1, (_p->_in.size() + storedChunkSize - 1) / storedChunkSize);
+	return _p->open(dst, count, true);
+}
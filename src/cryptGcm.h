@@ -0,0 +1,111 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*
+
+'gcm1' crypt format (--crypt-format gcm). Unlike aes-256-cbc, each chunk of
+a file is encrypted on its own, so the chunks of one file are encrypted by
+several threads at once.
+
+	header : "HUBKGCM1" | chunk size (u32 be) | 0 (u32) | salt (16 bytes)
+	chunks : aes-256-gcm(chunk) | tag (16 bytes)   ... one at least
+
+	master key = pbkdf2-hmac-sha256(password, "hubic-backup gcm1", 100000, 32)
+	file key   = hmac-sha256(master key, salt)
+	chunk ids key = hmac-sha256(master key, "hubk chunk ids")   (--chunked, see chunkStore.h)
+	nonce      = flags (u32 be, 1 for the last chunk) | chunk index (u64 be)
+
+The 32 header bytes are the additional authenticated data of each chunk.
+The last chunk flag makes a truncated file fail to decrypt. Objects are
+decrypted with 'hubk-decrypt'.
+
+*/
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+constexpr std::size_t gcmHeaderSize = 32;
+constexpr std::size_t gcmTagSize    = 16;
+constexpr std::size_t gcmChunkSize  = 1048576; // 1 Mo
+
+constexpr std::size_t chunkIdKeySize = 32;
+
+uint64_t getGcmCryptedSize(uint64_t uncryptedSize);
+
+// the secret keying the ids of crypted chunks, from the password
+bool getChunkIdKey(uint8_t * key, const std::string & pwd);
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CGcmCryptEngine
+{
+public:
+	CGcmCryptEngine(int numThread = 1);
+	virtual ~CGcmCryptEngine();
+
+public:
+	bool encryptStart(std::vector<uint8_t> & dst, const std::string & pwd);
+
+	// appends the crypted full chunks to dst. Input is buffered until the
+	// next chunk starts : the last one is only known at finalize
+	bool update(std::vector<uint8_t> & dst, const void * pSrc, std::size_t srcSize);
+	bool finalize(std::vector<uint8_t> & dst);
+
+private:
+	CGcmCryptEngine(const CGcmCryptEngine &) = delete;
+	CGcmCryptEngine & operator=(const CGcmCryptEngine &) = delete;
+
+private:
+	class CImpl;
+	CImpl *  _p;
+};
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CGcmDecryptEngine
+{
+public:
+	CGcmDecryptEngine(int numThread = 1);
+	virtual ~CGcmDecryptEngine();
+
+public:
+	bool decryptStart(const std::string & pwd);
+
+	// false on a bad header or an authentication failure
+	bool update(std::vector<uint8_t> & dst, const void * pSrc, std::size_t srcSize);
+	bool finalize(std::vector<uint8_t> & dst);
+
+private:
+	CGcmDecryptEngine(const CGcmDecryptEngine &) = delete;
+	CGcmDecryptEngine & operator=(const CGcmDecryptEngine &) = delete;
+
+private:
+	class CImpl;
+	CImpl *  _p;
+};
@@ -23,6 +23,7 @@
 /*************************************************************************/
 
 #include "crypto.h"
+#include "cryptGcm.h"
 #include "common.h"
 #include <cassert>
 #include <openssl/evp.h>
@@ -164,6 +165,14 @@ NMD5::CDigest getCryptoKey(const std::string & pwd)
 	);
 }
 
+// "Salted__" + salt, then aes-256-cbc with pkcs padding
+uint64_t getCryptedSize(uint64_t uncryptedSize, ECryptFormat format)
+{
+	if (format == ECryptFormat::gcm)
+		return getGcmCryptedSize(uncryptedSize);
+	return 16 + ((uncryptedSize / 16) + 1) * 16;
+}
+
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 bool CCryptoContextImpl::init( const std::string & pass, bool salted)
@@ -349,3 +358,17 @@ bool CCryptEngine::finalize(std::vector<uint8_t> & dst)
 	
 	return bRes;
 }
+
+bool CCryptEngine::encrypt(std::vector<uint8_t> & dst, const void * src, std::size_t srcSize, CCryptoContext * ctx)
+{
+	if (!encryptStart(dst, ctx))
+		return false;
+
+	std::vector<uint8_t> part;
+	bool bRes = (srcSize == 0) || update(part, src, srcSize);
+	dst.insert(dst.end(), part.begin(), part.end());
+
+	bRes = finalize(part) && bRes;
+	dst.insert(dst.end(), part.begin(), part.end());
+	return bRes;
+}
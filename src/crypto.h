@@ -50,7 +50,16 @@ protected: // private management
 	CCryptoContext() {}
 };
 
+// --crypt-format. cbc is the 'openssl enc' compatible default, gcm is
+// described in cryptGcm.h
+enum class ECryptFormat
+{
+	cbc,
+	gcm
+};
+
 NMD5::CDigest getCryptoKey(const std::string & pwd);
+uint64_t getCryptedSize(uint64_t uncryptedSize, ECryptFormat format = ECryptFormat::cbc);
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -66,6 +75,9 @@ public:
 	std::size_t neededSize( std::size_t srcSize) const;
 	bool update(std::vector<uint8_t> & dst, const void * pSrc, std::size_t srcSize);
 	bool finalize(std::vector<uint8_t> & dst);
+
+	// whole buffer at once : dst receives a complete crypted file
+	bool encrypt(std::vector<uint8_t> & dst, const void * pSrc, std::size_t srcSize, CCryptoContext * ctx);
 	
 private:
 	class CImpl;
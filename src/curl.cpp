@@ -26,32 +26,246 @@
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+struct CCurlMultiplexer::SJob
+{
+	SJob(CURL * p) : _p(p), _res(CURLE_OK), _done(false) {}
+	CURL   * _p;
+	CURLcode _res;
+	bool     _done;
+};
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+CCurlMultiplexer::CCurlMultiplexer(long maxHostConnections)
+:	_multi(curl_multi_init())
+,	_stop(false)
+{
+	assert(_multi);
+	curl_multi_setopt(_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+	curl_multi_setopt(_multi, CURLMOPT_MAX_HOST_CONNECTIONS, maxHostConnections);
+	_thread = std::thread(&CCurlMultiplexer::run, this);
+}
+
+CCurlMultiplexer::~CCurlMultiplexer()
+{
+	_stop = true;
+#if LIBCURL_VERSION_NUM >= 0x074400 // 7.68.0
+	curl_multi_wakeup(_multi);
+#endif
+	if (_thread.joinable())
+		_thread.join();
+
+	curl_multi_cleanup(_multi);
+}
+
+CURLcode CCurlMultiplexer::perform(CURL * p)
+{
+	SJob job(p);
+	std::unique_lock<std::mutex> lock(_m);
+	_pending.push_back(&job);
+#if LIBCURL_VERSION_NUM >= 0x074400 // 7.68.0
+	curl_multi_wakeup(_multi);
+#endif
+	_cv.wait(lock, [&job]() { return job._done; });
+	return job._res;
+}
+
+void CCurlMultiplexer::run()
+{
+	for (;;)
+	{
+		_m.lock();
+		for (auto pJob : _pending) {
+			_running[pJob->_p] = pJob;
+			curl_multi_add_handle(_multi, pJob->_p);
+		}
+		_pending.clear();
+		const bool bIdle = _running.empty();
+		_m.unlock();
+
+		if (bIdle && _stop)
+			break;
+
+		int stillRunning(0);
+		curl_multi_perform(_multi, &stillRunning);
+
+		int msgCount(0);
+		while (CURLMsg * msg = curl_multi_info_read(_multi, &msgCount))
+		{
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+
+			CURL * p = msg->easy_handle;
+			const CURLcode res = msg->data.result;
+			curl_multi_remove_handle(_multi, p);
+
+			_m.lock();
+			auto i = _running.find(p);
+			assert( i != _running.end());
+			i->second->_res = res;
+			i->second->_done = true;
+			_running.erase(i);
+			_m.unlock();
+			_cv.notify_all();
+		}
+
+#if LIBCURL_VERSION_NUM >= 0x074400 // 7.68.0
+		curl_multi_poll(_multi, nullptr, 0, 100, nullptr);
+#else
+		curl_multi_wait(_multi, nullptr, 0, 5, nullptr);
+#endif
+	}
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static CCurlLibrary * s_pLibrary(nullptr);
+
+CCurlLibrary * CCurlLibrary::get()
+{
+	return s_pLibrary;
+}
+
 CCurlLibrary::CCurlLibrary()
+:	_share(nullptr)
+,	_requestCount(0)
+,	_connectCount(0)
+,	_multiplexer(nullptr)
 {
 	CURLcode c = curl_global_init(CURL_GLOBAL_ALL);
 	if (c) {
 		std::cerr << "can't init curl" << std::endl;
 		exit(EXIT_FAILURE);
 	}
+
+	_share = curl_share_init();
+	if (_share) {
+		curl_share_setopt(_share, CURLSHOPT_LOCKFUNC  , CCurlLibrary::lock);
+		curl_share_setopt(_share, CURLSHOPT_UNLOCKFUNC, CCurlLibrary::unlock);
+		curl_share_setopt(_share, CURLSHOPT_USERDATA  , this);
+		curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+		// not the connections : libcurl doesn't support a connection used by
+		// concurrent threads. Each pooled handle keeps its own warm ones
+	}
+
+	assert(s_pLibrary == nullptr);
+	s_pLibrary = this;
 }
 
 CCurlLibrary::~CCurlLibrary()
 {
+	s_pLibrary = nullptr;
+
+	delete _multiplexer;
+	_multiplexer = nullptr;
+
+	// easy handles must be released before the share handle they use
+	for (auto p : _pool)
+		curl_easy_cleanup(p);
+	_pool.clear();
+
+	if (_share)
+		curl_share_cleanup(_share);
+
 	curl_global_cleanup();
 }
 
+void CCurlLibrary::lock(CURL * , curl_lock_data data, curl_lock_access , void * userptr)
+{
+	reinterpret_cast<CCurlLibrary*>(userptr)->_shareLocks[data].lock();
+}
+
+void CCurlLibrary::unlock(CURL * , curl_lock_data data, void * userptr)
+{
+	reinterpret_cast<CCurlLibrary*>(userptr)->_shareLocks[data].unlock();
+}
+
+void CCurlLibrary::enableHttp2(long maxHostConnections)
+{
+	if (_multiplexer)
+		return;
+
+	curl_version_info_data * v = curl_version_info(CURLVERSION_NOW);
+	if ((v == nullptr) || ((v->features & CURL_VERSION_HTTP2) == 0)) {
+		LOGW("libcurl is built without HTTP/2 support. Using HTTP/1.1");
+		return;
+	}
+
+	// libcurl 7.88 leaves a stream stalled when its last frames are read along
+	// with another stream's, until the server closes the idle connection (3 mn
+	// with nghttpx). Not seen with 8.14
+	if (v->version_num < http2MinCurlVersion) {
+		LOGW("libcurl {} multiplexes HTTP/2 streams unreliably. Using HTTP/1.1", v->version);
+		return;
+	}
+
+	_multiplexer = new CCurlMultiplexer(maxHostConnections);
+}
+
+CURL * CCurlLibrary::acquire()
+{
+	CURL * p(nullptr);
+	_poolMutex.lock();
+	if (!_pool.empty()) {
+		p = _pool.back();
+		_pool.pop_back();
+	}
+	_poolMutex.unlock();
+
+	if (p == nullptr)
+		p = curl_easy_init();
+
+	if (p && _share)
+		curl_easy_setopt(p, CURLOPT_SHARE, _share);
+
+	return p;
+}
+
+void CCurlLibrary::release(CURL * p)
+{
+	// keep the handle (and its caches) alive for the next user
+	curl_easy_reset(p);
+	_poolMutex.lock();
+	_pool.push_back(p);
+	_poolMutex.unlock();
+}
+
+void CCurlLibrary::onPerformed(long newConnectCount)
+{
+	_requestCount++;
+	if (newConnectCount > 0)
+		_connectCount += newConnectCount;
+}
+
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
 CCurl::CCurl()
-:	_p(curl_easy_init())
+:	_p(CCurlLibrary::get() ? CCurlLibrary::get()->acquire() : curl_easy_init())
 {
 }
 
 CCurl::~CCurl()
 {
-	if (_p) curl_easy_cleanup(_p);
+	if (!_p)
+		return;
+
+	if (CCurlLibrary::get())
+		CCurlLibrary::get()->release(_p);
+	else
+		curl_easy_cleanup(_p);
+}
+
+void CCurl::reset() const
+{
+	assert( _p);
+	curl_easy_reset(_p);
+
+	// reset also drops the share handle
+	if (CCurlLibrary::get() && CCurlLibrary::get()->share())
+		curl_easy_setopt(_p, CURLOPT_SHARE, CCurlLibrary::get()->share());
 }
 
 
@@ -80,22 +294,28 @@ bf::path CCurl::escapePath(const bf::path & path) const
 
 size_t CCurl::wfString(void *ptr, size_t size, size_t nmemb, std::string * s)
 {
-	std::vector<char> v;
-	v.reserve(1 + size*nmemb);
-	for (size_t i=0; i<size*nmemb; ++i)
-		v.push_back(((char*)ptr)[i]);
-	v.push_back('\0');
-	(*s) += v.data();
-	
+	s->append(static_cast<const char*>(ptr), size*nmemb);
 	return size*nmemb;
 }
 
-CURLcode CCurl::perform(std::string & response) const
+CURLcode CCurl::perform(std::string & response, bool bMultiplexed) const
 {
 	assert(_p);
 	response.clear();
 	setopt(CURLOPT_WRITEFUNCTION, wfString);
  	setopt(CURLOPT_WRITEDATA, &response);
+
+	// multiplexed transfers use the connections of the multi handle only,
+	// driven by its thread
+	CCurlLibrary * pLib = CCurlLibrary::get();
+	if (bMultiplexed && pLib && pLib->multiplexer()) {
+		setopt(CURLOPT_SHARE, static_cast<CURLSH*>(nullptr));
+		const CURLcode res = pLib->multiplexer()->perform(_p);
+		if (pLib->share())
+			setopt(CURLOPT_SHARE, pLib->share());
+		return res;
+	}
+
 	return perform();
 }
 
@@ -25,14 +25,81 @@
 #pragma once
 
 #include "common.h"
+#include <condition_variable>
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// Drives a curl multi handle from its own thread so requests issued by
+// several worker threads can be multiplexed over a few HTTP/2 connections.
+// perform() blocks the calling thread until its transfer is done.
+
+class CCurlMultiplexer
+{
+public:
+	CCurlMultiplexer(long maxHostConnections);
+	~CCurlMultiplexer();
+
+public:
+	CURLcode perform(CURL * p);
+
+private:
+	void run();
+
+private:
+	struct SJob;
+
+private:
+	CURLM                  * _multi;
+	std::thread              _thread;
+	std::mutex               _m;
+	std::condition_variable  _cv;
+	std::list<SJob*>         _pending;
+	std::map<CURL*, SJob*>   _running;
+	std::atomic_bool         _stop;
+};
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Process wide curl state : the library initialisation, a share handle
+// (dns cache and ssl sessions) used by the easy handles out of the HTTP/2
+// multiplexer, and a pool of long lived easy handles checked out by CCurl
+// instances, each one with its own connections.
+
 class CCurlLibrary
 {
+public:
+	static CCurlLibrary * get();
+
 public:
 	CCurlLibrary();
 	virtual ~CCurlLibrary();
+
+public:
+	CURLSH * share() const { return _share; }
+	void enableHttp2(long maxHostConnections);
+	bool http2() const { return _multiplexer != nullptr; }
+	CCurlMultiplexer * multiplexer() const { return _multiplexer; }
+
+public:
+	CURL * acquire();
+	void release(CURL * p);
+	void onPerformed(long newConnectCount);
+
+	uint64_t getRequestCount() const { return _requestCount; }
+	uint64_t getConnectCount() const { return _connectCount; }
+
+private:
+	static void lock(CURL * handle, curl_lock_data data, curl_lock_access access, void * userptr);
+	static void unlock(CURL * handle, curl_lock_data data, void * userptr);
+
+private:
+	CURLSH              * _share;
+	std::mutex            _shareLocks[CURL_LOCK_DATA_LAST];
+	std::mutex            _poolMutex;
+	std::vector<CURL *>   _pool;
+	std::atomic<uint64_t> _requestCount;
+	std::atomic<uint64_t> _connectCount;
+	CCurlMultiplexer    * _multiplexer;
 };
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -43,13 +110,13 @@ public:
 	CCurl();
 	virtual ~CCurl();
 	operator CURL *() const { return _p; }
-	void reset( ) const { assert( _p); curl_easy_reset(_p); }
+	void reset( ) const;
 
 
 public:
 	template<typename T> CURLcode setopt(CURLoption option, T v) const { assert(_p); return curl_easy_setopt(_p, option, v); }
 	CURLcode perform() const { assert(_p); return curl_easy_perform(_p); }
-	CURLcode perform(std::string & response) const;
+	CURLcode perform(std::string & response, bool bMultiplexed = false) const;
 
 public:
 	std::string escapeString( const std::string & src) const;
@@ -58,6 +125,10 @@ public:
 public:
 	static size_t wfString(void *ptr, size_t size, size_t nmemb, std::string * s);
 	
+private:
+	CCurl(const CCurl &) = delete;
+	CCurl & operator=(const CCurl &) = delete;
+
 private:
 	CURL * _p;
 };
@@ -0,0 +1,215 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "deadline.h"
+#include "../thirdparty/jsonxx/jsonxx.h"
+#include <fstream>
+#include <sstream>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// the statuses kept by the checkpoint : a plain upload, whatever the next run finds
+static const char * statusName(BACKUP_ITEM_STATUS s)
+{
+	switch (s) {
+		case BACKUP_ITEM_STATUS::TO_BE_CREATED         : return "created";
+		case BACKUP_ITEM_STATUS::UPDATE_CONTENT_CHANGED: return "changed";
+		case BACKUP_ITEM_STATUS::UPDATE_PWD_CHANGED    : return "password";
+		default: break;
+	}
+	return nullptr;
+}
+
+static bool parseStatus(const std::string & name, BACKUP_ITEM_STATUS & s)
+{
+	for (auto i : {BACKUP_ITEM_STATUS::TO_BE_CREATED, BACKUP_ITEM_STATUS::UPDATE_CONTENT_CHANGED, BACKUP_ITEM_STATUS::UPDATE_PWD_CHANGED})
+		if (name == statusName(i)) {
+			s = i;
+			return true;
+		}
+	return false;
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+CDeadline::CDeadline(CContext & ctx)
+:	CContextual(ctx)
+,	_measuredBytes(0)
+,	_measuredSeconds(0)
+,	_deferredCount(0)
+,	_resumedCount(0)
+{
+	// what changes how the listed files are stored
+	_settings = NMD5::computeMd5(_ctx._options->storageSettings()).hex();
+}
+
+bool CDeadline::fits(uint64_t len) const
+{
+	if (!enabled())
+		return true;
+	if (_ctx.deadlineReached())
+		return false;
+
+	std::lock_guard<std::mutex> lock(_m);
+	if ((_measuredBytes == 0) || (_measuredSeconds <= 0))
+		return true;
+
+	const double left = std::chrono::duration<double>(std::chrono::system_clock::from_time_t(_ctx._options->_deadline) - std::chrono::system_clock::now()).count();
+	return (len * _measuredSeconds / _measuredBytes) < left;
+}
+
+void CDeadline::onUploaded(uint64_t len, double seconds)
+{
+	if (len < deadlineSampleMin)
+		return;
+
+	std::lock_guard<std::mutex> lock(_m);
+	_measuredBytes   += len;
+	_measuredSeconds += seconds;
+}
+
+void CDeadline::defer(CAsset * p)
+{
+	_deferredCount++;
+	LOGD("deferred to the next run '{}'", p->getRelativePath().string());
+
+	// copies, links and packs are cheap, the next run finds them again
+	const char * status = statusName(p->getBackupStatus());
+	p->setBackupStatus(BACKUP_ITEM_STATUS::IGNORED);
+	if (status == nullptr)
+		return;
+
+	boost::system::error_code ec;
+	const uint64_t size = bf::file_size(p->getFullPath(), ec);
+	if (ec)
+		return;
+
+	std::lock_guard<std::mutex> lock(_m);
+	_deferred[p->getRelativePath().string()] = fmt::format("{} {} {}", status, size, p->getLocalLastModifTime());
+}
+
+void CDeadline::load()
+{
+	std::lock_guard<std::mutex> lock(_m);
+	_known.clear();
+	_deferred.clear();
+
+	const bf::path path = _ctx._options->stateFile("checkpoint");
+	std::string local;
+	{
+		std::ifstream f(path.c_str());
+		std::stringstream ss;
+		ss << f.rdbuf();
+		local = ss.str();
+	}
+	if (local.empty())
+		return;
+
+	jsonxx::Object checkpoint;
+	if ((!checkpoint.parse(local)) || (!checkpoint.has<jsonxx::Object>("files"))) {
+		LOGW("checkpoint : can't read '{}'", path.string());
+		return;
+	}
+
+	if ((!checkpoint.has<jsonxx::String>("settings")) || (checkpoint.get<jsonxx::String>("settings") != _settings)) {
+		LOGI("checkpoint : the storage settings changed, every file is checked");
+		return;
+	}
+
+	for (const auto & i : checkpoint.get<jsonxx::Object>("files").kv_map())
+		if (i.second->is<jsonxx::String>())
+			_known[i.first] = i.second->get<jsonxx::String>();
+
+	LOGI("checkpoint : {} file(s) left by the previous run", _known.size());
+}
+
+bool CDeadline::resume(CAsset * p)
+{
+	// seen by this run : deferred again, or not listed anymore
+	std::string entry;
+	{
+		std::lock_guard<std::mutex> lock(_m);
+		const auto i = _known.find(p->getRelativePath().string());
+		if (i == _known.end())
+			return false;
+		entry = i->second;
+		_known.erase(i);
+	}
+
+	std::vector<std::string> fields;
+	boost::algorithm::split(fields, entry, boost::is_any_of(" "));
+	BACKUP_ITEM_STATUS s;
+	if ((fields.size() != 3) || !parseStatus(fields[0], s))
+		return false;
+
+	boost::system::error_code ec;
+	CHash h;
+	h._computed = true;
+	h._len = bf::file_size(p->getFullPath(), ec);
+	if (ec || (fields[1] != std::to_string(h._len)) || (fields[2] != std::to_string(p->getLocalLastModifTime())))
+		return false;
+
+	// the md5 is computed by the upload
+	p->setSrcHash(h);
+	p->setBackupStatus(s);
+	_resumedCount++;
+	LOGD("resumed from the checkpoint '{}'", p->getRelativePath().string());
+	return true;
+}
+
+void CDeadline::save(bool bComplete)
+{
+	std::lock_guard<std::mutex> lock(_m);
+	const bf::path path = _ctx._options->stateFile("checkpoint");
+	boost::system::error_code ec;
+	if (bComplete) {
+		bf::remove(path, ec);
+		return;
+	}
+
+	// the listed files this run didn't reach are still to do
+	std::map<std::string, std::string> left(_known);
+	for (const auto & i : _deferred)
+		left[i.first] = i.second;
+
+	jsonxx::Object files;
+	for (const auto & i : left)
+		files << i.first << i.second;
+
+	jsonxx::Object checkpoint;
+	checkpoint << "version" << 1;
+	checkpoint << "settings" << _settings;
+	checkpoint << "files" << files;
+
+	bf::create_directories(path.parent_path(), ec);
+	std::ofstream f(path.c_str(), std::ios::out | std::ios::trunc);
+	f << checkpoint.json();
+	f.close();
+	if (!f) {
+		LOGW("can't write the checkpoint '{}'", path.string());
+		return;
+	}
+
+	LOGI("checkpoint : {} file(s) left for the next run", left.size());
+}
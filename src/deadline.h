@@ -0,0 +1,95 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#pragma once
+
+#include "context.h"
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+
+Backup window (--deadline) and checkpoint
+
+Before the deadline, an upload starts only when it should end in time, at
+the throughput measured on the uploads of the run. A file that wouldn't is
+deferred. Once the deadline is passed, the scan and the checks stop, the
+uploads in flight end, and nothing else is started : every file still
+waiting is deferred. Deletions, and the folder summaries, wait for a
+complete run.
+
+The deferred files whose upload was decided are written to the state folder,
+one file by source and destination :
+	checkpoint-<md5>.json
+	{ "version": 1, "settings": "<md5>", "files": { "<relative path>": "<status> <size> <mtime>", ... } }
+'settings' sums up the options that change how files are stored (see
+COptions::storageSettings). On the next run, with or without --deadline, a
+listed file whose size and modification date didn't change is queued for
+upload as soon as it is scanned, without its md5 pass nor HEAD request, ahead
+of the files still being checked. The checkpoint is removed by a complete run, and kept as is by an aborted one.
+A stopped run keeps the listed files it didn't reach.
+
+*/
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CDeadline
+:	public CContextual
+{
+public:
+	CDeadline(CContext & ctx);
+
+public:
+	bool enabled() const { return _ctx._options->_deadline != 0; }
+
+	// the upload of 'len' bytes would end before the deadline. Always true
+	// before the first measure, on an upload of deadlineSampleMin bytes at
+	// least. Thread safe
+	bool fits(uint64_t len) const;
+	void onUploaded(uint64_t len, double seconds);
+
+	// the file is left for the next run, its status becomes IGNORED. Thread safe
+	void defer(CAsset * p);
+	uint64_t deferredCount() const { return _deferredCount; }
+
+	// checkpoint. resume() sets the size and status of a listed, unchanged
+	// file. Thread safe
+	void load();
+	bool resume(CAsset * p);
+	void save(bool bComplete);
+	uint64_t resumedCount() const { return _resumedCount; }
+
+private:
+
+private:
+	std::string _settings;
+
+	mutable std::mutex _m;
+	uint64_t _measuredBytes; // uploads of this run, by thread
+	double   _measuredSeconds;
+	std::map<std::string, std::string> _known;    // previous run, not seen yet
+	std::map<std::string, std::string> _deferred; // this run
+	std::atomic<uint64_t> _deferredCount;
+	std::atomic<uint64_t> _resumedCount;
+};
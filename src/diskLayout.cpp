@@ -0,0 +1,132 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "diskLayout.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/sysmacros.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool NDiskLayout::isRotational(const bf::path & path)
+{
+	struct stat st;
+	return (stat(path.c_str(), &st) == 0) && isRotational(st.st_dev);
+}
+
+bool NDiskLayout::isRotational(uint64_t device)
+{
+#ifdef __linux__
+	// a partition has no queue folder, its disk has
+	const dev_t d = static_cast<dev_t>(device);
+	const bf::path dev = fmt::format("/sys/dev/block/{}:{}", major(d), minor(d));
+	for (const auto & q : { dev / "queue" / "rotational", dev / ".." / "queue" / "rotational" }) {
+		FILE * f = fopen(q.c_str(), "r");
+		if (f == nullptr)
+			continue;
+
+		int rotational(0);
+		const bool bRead = (fscanf(f, "%d", &rotational) == 1);
+		fclose(f);
+		if (bRead)
+			return rotational == 1;
+	}
+#else
+	(void)device;
+#endif
+	return false;
+}
+
+uint64_t NDiskLayout::device(const std::string & path)
+{
+	struct stat st;
+	return (stat(path.c_str(), &st) == 0) ? st.st_dev : 0;
+}
+
+uint64_t NDiskLayout::inode(const std::string & path)
+{
+	struct stat st;
+	return (lstat(path.c_str(), &st) == 0) ? st.st_ino : 0;
+}
+
+uint64_t NDiskLayout::firstExtent(const std::string & path)
+{
+#ifdef __linux__
+	const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+
+	// room for one extent after the header
+	uint64_t buffer[(sizeof(fiemap) + sizeof(fiemap_extent)) / sizeof(uint64_t) + 1];
+	memset(buffer, 0, sizeof(buffer));
+	fiemap * m = reinterpret_cast<fiemap*>(buffer);
+	m->fm_start = 0;
+	m->fm_length = FIEMAP_MAX_OFFSET;
+	m->fm_extent_count = 1;
+	const int res = ioctl(fd, FS_IOC_FIEMAP, m);
+	close(fd);
+
+	if (res == 0)
+		return (m->fm_mapped_extents > 0) ? m->fm_extents[0].fe_physical : 0;
+#endif
+
+	// no FIEMAP support on this filesystem
+	return inode(path);
+}
+
+uint64_t NDiskLayout::readKey(EReadOrder o, const std::string & path)
+{
+	switch (o) {
+	case EReadOrder::scan   : return 0;
+	case EReadOrder::inode  : return inode(path);
+	case EReadOrder::extent : return firstExtent(path);
+	}
+	return 0;
+}
+
+const char * NDiskLayout::orderName(EReadOrder o)
+{
+	switch (o) {
+	case EReadOrder::scan   : return "scan";
+	case EReadOrder::inode  : return "inode";
+	case EReadOrder::extent : return "extent";
+	}
+	return "?";
+}
+
+bool NDiskLayout::parseOrder(const std::string & name, EReadOrder & o)
+{
+	for (auto c : { EReadOrder::scan, EReadOrder::inode, EReadOrder::extent })
+		if (name == orderName(c)) {
+			o = c;
+			return true;
+		}
+	return false;
+}
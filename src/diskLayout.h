@@ -0,0 +1,61 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#pragma once
+
+#include "common.h"
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// where files lie on their device, to read them in the disk order. On a
+// spinning disk, reading files in directory order seeks between each one
+
+enum class EReadOrder
+{
+	scan,   // directory scan order
+	inode,  // inode number, close to the allocation order on most filesystems
+	extent  // physical offset of the first extent (FIEMAP), else inode
+};
+
+namespace NDiskLayout
+{
+	// the device holding 'path' is a spinning disk
+	// (/sys/dev/block/<major>:<minor>/queue/rotational)
+	bool isRotational(const bf::path & path);
+	bool isRotational(uint64_t device);
+
+	// st_dev of 'path', 0 when it can't be read
+	uint64_t device(const std::string & path);
+
+	uint64_t inode(const std::string & path);
+
+	// physical offset of the first extent. Files with no extent (empty,
+	// inlined data) come first, with 0
+	uint64_t firstExtent(const std::string & path);
+
+	uint64_t readKey(EReadOrder o, const std::string & path);
+
+	const char * orderName(EReadOrder o);
+	bool parseOrder(const std::string & name, EReadOrder & o);
+}
@@ -0,0 +1,974 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "fileReader.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <condition_variable>
+#include <set>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HUBK_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#endif
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// O_DIRECT offsets, lengths and buffers are aligned on this
+constexpr std::size_t directAlign = 4096;
+
+static std::atomic<uint64_t> s_readBytes(0);
+static std::atomic<uint64_t> s_cachedBytes(0);
+static std::atomic<uint64_t> s_droppedBytes(0);
+static std::atomic<uint64_t> s_directBytes(0);
+static std::atomic<uint64_t> s_holeBytes(0);
+
+// completes short reads. An unaligned one is the end of the file : O_DIRECT
+// can't read further from there
+static int64_t preadFull(int fd, uint8_t * dst, std::size_t len, uint64_t offset)
+{
+	std::size_t done(0);
+	while (done < len) {
+		const ssize_t n = pread(fd, dst + done, len - done, offset + done);
+		if ((n < 0) && (errno == EINTR))
+			continue;
+		if (n < 0)
+			return -errno;
+		done += n;
+		if ((n == 0) || (n % directAlign))
+			break;
+	}
+	return done;
+}
+
+// mincore of the range : which pages are in the page cache
+static void residentPages(int fd, uint64_t offset, std::size_t len, std::vector<uint8_t> & res)
+{
+	res.clear();
+	void * p = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, offset);
+	if (p == MAP_FAILED)
+		return;
+
+	res.resize((len + directAlign - 1) / directAlign);
+	if (mincore(p, len, res.data()) != 0)
+		res.clear();
+	munmap(p, len);
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CFileReader::CBackend
+{
+public:
+	typedef std::vector<std::pair<std::size_t, int64_t>> done_list;
+
+public:
+	virtual ~CBackend() {}
+
+	// a file opened (fd) or closed (-1) in a slot
+	virtual void setFile(int slot, int fd) { (void)slot; (void)fd; }
+
+	// queues the read of a piece. Results are negative errno
+	virtual void read(std::size_t piece, int slot, int fd, uint8_t * dst, std::size_t len, uint64_t offset) = 0;
+	virtual void flush() {}
+
+	// waits for at least one completion
+	virtual void wait(done_list & done) = 0;
+
+	// false once the backend can't complete reads anymore : all its pending
+	// reads were given back as failed
+	virtual bool usable() const { return true; }
+};
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// reads when the completion is waited for : no read ahead, as fread
+class CSyncBackend : public CFileReader::CBackend
+{
+public:
+	void read(std::size_t piece, int, int fd, uint8_t * dst, std::size_t len, uint64_t offset) override
+	{
+		_queued.push_back(SRequest{piece, fd, dst, len, offset});
+	}
+
+	void wait(done_list & done) override
+	{
+		for (const auto & r : _queued)
+			done.push_back(std::make_pair(r._piece, preadFull(r._fd, r._dst, r._len, r._offset)));
+		_queued.clear();
+	}
+
+private:
+	struct SRequest
+	{
+		std::size_t _piece;
+		int         _fd;
+		uint8_t *   _dst;
+		std::size_t _len;
+		uint64_t    _offset;
+	};
+	std::vector<SRequest> _queued;
+};
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CThreadsBackend : public CFileReader::CBackend
+{
+public:
+	CThreadsBackend(std::size_t threadCount)
+	:	_bStop(false)
+	{
+		for (std::size_t i = 0; i < threadCount; i++)
+			_threads.push_back(std::thread(&CThreadsBackend::run, this));
+	}
+
+	~CThreadsBackend()
+	{
+		{
+			std::lock_guard<std::mutex> l(_m);
+			_bStop = true;
+		}
+		_cvRequest.notify_all();
+		for (auto & t : _threads)
+			t.join();
+	}
+
+	void read(std::size_t piece, int, int fd, uint8_t * dst, std::size_t len, uint64_t offset) override
+	{
+		{
+			std::lock_guard<std::mutex> l(_m);
+			_requests.push_back(SRequest{piece, fd, dst, len, offset});
+		}
+		_cvRequest.notify_one();
+	}
+
+	void wait(done_list & done) override
+	{
+		std::unique_lock<std::mutex> l(_m);
+		_cvDone.wait(l, [this]{ return !_done.empty(); });
+		done.insert(done.end(), _done.begin(), _done.end());
+		_done.clear();
+	}
+
+private:
+	void run()
+	{
+		std::unique_lock<std::mutex> l(_m);
+		for (;;) {
+			_cvRequest.wait(l, [this]{ return _bStop || !_requests.empty(); });
+			if (_bStop)
+				return;
+
+			const SRequest r = _requests.front();
+			_requests.pop_front();
+			l.unlock();
+			const int64_t res = preadFull(r._fd, r._dst, r._len, r._offset);
+			l.lock();
+			_done.push_back(std::make_pair(r._piece, res));
+			_cvDone.notify_one();
+		}
+	}
+
+private:
+	struct SRequest
+	{
+		std::size_t _piece;
+		int         _fd;
+		uint8_t *   _dst;
+		std::size_t _len;
+		uint64_t    _offset;
+	};
+
+	std::mutex               _m;
+	std::condition_variable  _cvRequest;
+	std::condition_variable  _cvDone;
+	std::deque<SRequest>     _requests;
+	done_list                _done;
+	bool                     _bStop;
+	std::vector<std::thread> _threads;
+};
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifdef HUBK_IO_URING
+
+// raw io_uring syscalls, no liburing dependency. The pieces buffers and the
+// slot files are registered once, when the kernel allows it
+class CUringBackend : public CFileReader::CBackend
+{
+public:
+	static CUringBackend * create(unsigned entries, uint8_t * buffers, std::size_t pieceSize, std::size_t pieceCount, std::size_t slotCount)
+	{
+		std::unique_ptr<CUringBackend> r(new CUringBackend());
+		if (!r->setup(entries))
+			return nullptr;
+
+		std::vector<iovec> iov(pieceCount);
+		for (std::size_t i = 0; i < pieceCount; i++) {
+			iov[i].iov_base = buffers + i * pieceSize;
+			iov[i].iov_len  = pieceSize;
+		}
+		r->_bFixedBuffers = (r->reg(IORING_REGISTER_BUFFERS, iov.data(), iov.size()) == 0);
+
+		std::vector<int> fds(slotCount, -1);
+		r->_bFixedFiles = (r->reg(IORING_REGISTER_FILES, fds.data(), fds.size()) == 0);
+		return r.release();
+	}
+
+	~CUringBackend()
+	{
+		if (_sq != MAP_FAILED)
+			munmap(_sq, _sqSize);
+		if ((_cq != MAP_FAILED) && (_cq != _sq))
+			munmap(_cq, _cqSize);
+		if (_sqes != MAP_FAILED)
+			munmap(_sqes, _sqesSize);
+		if (_fd >= 0)
+			::close(_fd);
+	}
+
+	void setFile(int slot, int fd) override
+	{
+		if (!_bFixedFiles)
+			return;
+
+		io_uring_files_update u;
+		memset(&u, 0, sizeof(u));
+		u.offset = slot;
+		u.fds    = reinterpret_cast<uint64_t>(&fd);
+		if (reg(IORING_REGISTER_FILES_UPDATE, &u, 1) != 1)
+			_bFixedFiles = false;
+	}
+
+	void read(std::size_t piece, int slot, int fd, uint8_t * dst, std::size_t len, uint64_t offset) override
+	{
+		const unsigned tail = *_sqTail;
+		const unsigned i = tail & *_sqMask;
+		io_uring_sqe & e = _sqes[i];
+		memset(&e, 0, sizeof(e));
+		e.opcode    = _bFixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+		e.fd        = _bFixedFiles ? slot : fd;
+		e.flags     = _bFixedFiles ? IOSQE_FIXED_FILE : 0;
+		e.addr      = reinterpret_cast<uint64_t>(dst);
+		e.len       = len;
+		e.off       = offset;
+		e.buf_index = _bFixedBuffers ? piece : 0;
+		e.user_data = piece;
+		_sqArray[i] = i;
+		__atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+		_toSubmit++;
+		_outstanding.insert(piece);
+	}
+
+	bool usable() const override { return !_bBroken; }
+
+	void flush() override
+	{
+		while (_toSubmit > 0) {
+			const int n = enter(_toSubmit, 0, 0);
+			if (n < 0)
+				break;
+			_toSubmit -= n;
+		}
+	}
+
+	void wait(done_list & done) override
+	{
+		for (;;) {
+			reap(done);
+			if (!done.empty())
+				return;
+
+			const int n = enter(_toSubmit, 1, IORING_ENTER_GETEVENTS);
+			if (n < 0) {
+				// this runs on upload threads : no exception, the reads
+				// fail and the reader replaces the ring
+				const int err = errno;
+				LOGE("io_uring_enter error {}, {} read(s) failed", err, _outstanding.size());
+				for (auto piece : _outstanding)
+					done.push_back(std::make_pair(piece, static_cast<int64_t>(-err)));
+				_outstanding.clear();
+				_toSubmit = 0;
+				_bBroken = true;
+				return;
+			}
+			if (n > 0)
+				_toSubmit -= std::min<unsigned>(n, _toSubmit);
+		}
+	}
+
+private:
+	CUringBackend()
+	:	_fd(-1)
+	,	_sq(MAP_FAILED)
+	,	_cq(MAP_FAILED)
+	,	_sqes(reinterpret_cast<io_uring_sqe*>(MAP_FAILED))
+	,	_sqSize(0)
+	,	_cqSize(0)
+	,	_sqesSize(0)
+	,	_toSubmit(0)
+	,	_bFixedBuffers(false)
+	,	_bFixedFiles(false)
+	,	_bBroken(false)
+	{
+	}
+
+	bool setup(unsigned entries)
+	{
+		io_uring_params p;
+		memset(&p, 0, sizeof(p));
+		_fd = syscall(__NR_io_uring_setup, entries, &p);
+		if (_fd < 0)
+			return false;
+
+		_sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+		_cqSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+		if (p.features & IORING_FEAT_SINGLE_MMAP)
+			_sqSize = _cqSize = std::max(_sqSize, _cqSize);
+
+		_sq = mmap(nullptr, _sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+		if (_sq == MAP_FAILED)
+			return false;
+
+		_cq = (p.features & IORING_FEAT_SINGLE_MMAP) ? _sq : mmap(nullptr, _cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+		if (_cq == MAP_FAILED)
+			return false;
+
+		_sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+		_sqes = reinterpret_cast<io_uring_sqe*>(mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES));
+		if (_sqes == MAP_FAILED)
+			return false;
+
+		uint8_t * sq = reinterpret_cast<uint8_t*>(_sq);
+		uint8_t * cq = reinterpret_cast<uint8_t*>(_cq);
+		_sqTail  = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+		_sqMask  = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+		_sqArray = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+		_cqHead  = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+		_cqTail  = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+		_cqMask  = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+		_cqes    = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+		return true;
+	}
+
+	int reg(unsigned opcode, void * arg, unsigned count)
+	{
+		return syscall(__NR_io_uring_register, _fd, opcode, arg, count);
+	}
+
+	int enter(unsigned toSubmit, unsigned minComplete, unsigned flags)
+	{
+		int n;
+		do {
+			n = syscall(__NR_io_uring_enter, _fd, toSubmit, minComplete, flags, nullptr, 0);
+		} while ((n < 0) && ((errno == EINTR) || (errno == EAGAIN) || (errno == EBUSY)));
+		return n;
+	}
+
+	void reap(done_list & done)
+	{
+		unsigned head = *_cqHead;
+		const unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			const io_uring_cqe & c = _cqes[head & *_cqMask];
+			done.push_back(std::make_pair(static_cast<std::size_t>(c.user_data), static_cast<int64_t>(c.res)));
+			_outstanding.erase(static_cast<std::size_t>(c.user_data));
+		}
+		__atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+	}
+
+private:
+	int            _fd;
+	void *         _sq;
+	void *         _cq;
+	io_uring_sqe * _sqes;
+	std::size_t    _sqSize;
+	std::size_t    _cqSize;
+	std::size_t    _sqesSize;
+	unsigned *     _sqTail;
+	unsigned *     _sqMask;
+	unsigned *     _sqArray;
+	unsigned *     _cqHead;
+	unsigned *     _cqTail;
+	unsigned *     _cqMask;
+	io_uring_cqe * _cqes;
+	unsigned       _toSubmit;
+	bool           _bFixedBuffers;
+	bool           _bFixedFiles;
+	bool           _bBroken;
+	std::set<std::size_t> _outstanding; // pieces queued or in flight
+};
+
+#endif
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool CFileReader::supported(EIoEngine e)
+{
+	if (e != EIoEngine::uring)
+		return true;
+
+#ifdef HUBK_IO_URING
+	// io_uring may be disabled by the kernel or a seccomp filter
+	static const bool bUring = [] {
+		io_uring_params p;
+		memset(&p, 0, sizeof(p));
+		const int fd = syscall(__NR_io_uring_setup, 2, &p);
+		if (fd < 0)
+			return false;
+		::close(fd);
+		return true;
+	}();
+	return bUring;
+#else
+	return false;
+#endif
+}
+
+EIoEngine CFileReader::bestEngine()
+{
+	return supported(EIoEngine::uring) ? EIoEngine::uring : EIoEngine::threads;
+}
+
+const char * CFileReader::engineName(EIoEngine e)
+{
+	switch (e) {
+	case EIoEngine::sync    : return "sync";
+	case EIoEngine::threads : return "threads";
+	case EIoEngine::uring   : return "uring";
+	}
+	return "?";
+}
+
+bool CFileReader::parseEngine(const std::string & name, EIoEngine & e)
+{
+	for (auto c : { EIoEngine::sync, EIoEngine::threads, EIoEngine::uring })
+		if (name == engineName(c)) {
+			e = c;
+			return true;
+		}
+	return false;
+}
+
+bool CFileReader::readFile(const std::string & path, std::string & data, ECacheMode m, std::size_t max)
+{
+	data.clear();
+	CFileReader r(EIoEngine::sync, 1, ioPieceSize, 1, m);
+	const int slot = r.open(path);
+	if (slot < 0)
+		return false;
+
+	while ((!r.eof(slot)) && (data.size() < max)) {
+		const uint8_t * p(nullptr);
+		std::size_t len(0);
+		if (!r.next(slot, p, len))
+			return false;
+		data.append(reinterpret_cast<const char*>(p), std::min(len, max - data.size()));
+	}
+	return true;
+}
+
+CFileReader::SStats CFileReader::stats()
+{
+	SStats s;
+	s._read    = s_readBytes;
+	s._cached  = s_cachedBytes;
+	s._dropped = s_droppedBytes;
+	s._direct  = s_directBytes;
+	s._holes   = s_holeBytes;
+	return s;
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+CFileReader::CFileReader(EIoEngine e, std::size_t depth, std::size_t pieceSize, std::size_t slotCount, ECacheMode m)
+:	_engine(e)
+,	_cacheMode(m)
+,	_depth(e == EIoEngine::sync ? 1 : std::max<std::size_t>(depth, 1))
+,	_pieceSize(pieceSize)
+,	_buffers(nullptr)
+,	_inFlight(0)
+,	_cursor(0)
+{
+	// besides the read ahead, each slot may hold the piece given to its
+	// consumer and the one it waits for
+	const std::size_t pieceCount = _depth + 2 * slotCount;
+	assert( _pieceSize % directAlign == 0 );
+	void * p(nullptr);
+	if (posix_memalign(&p, 4096, pieceCount * _pieceSize) != 0)
+		throw std::bad_alloc();
+	_buffers = reinterpret_cast<uint8_t*>(p);
+
+	_pieces.resize(pieceCount);
+	for (std::size_t i = pieceCount; i > 0; i--)
+		_free.push_back(i - 1);
+
+	_slots.resize(slotCount);
+	for (auto & s : _slots) {
+		s._bUsed = false;
+		s._fd = -1;
+		s._held = -1;
+	}
+
+#ifdef HUBK_IO_URING
+	if (_engine == EIoEngine::uring) {
+		_backend.reset(CUringBackend::create(_depth, _buffers, _pieceSize, pieceCount, slotCount));
+		if (!_backend) {
+			LOGD("io_uring unavailable, using read threads");
+			_engine = EIoEngine::threads;
+		}
+	}
+#else
+	if (_engine == EIoEngine::uring)
+		_engine = EIoEngine::threads;
+#endif
+
+	if (_engine == EIoEngine::threads)
+		_backend.reset(new CThreadsBackend(std::min<std::size_t>(_depth, 8)));
+	else if (_engine == EIoEngine::sync)
+		_backend.reset(new CSyncBackend());
+}
+
+CFileReader::~CFileReader()
+{
+	for (std::size_t i = 0; i < _slots.size(); i++)
+		close(i);
+	_backend.reset();
+	free(_buffers);
+}
+
+int CFileReader::open(const std::string & path)
+{
+	for (std::size_t i = 0; i < _slots.size(); i++) {
+		SSlot & s = _slots[i];
+		if (s._bUsed)
+			continue;
+
+		// O_DIRECT is refused by some filesystems (tmpfs...) : fadvise then
+		int fd(-1);
+		s._bDirect = false;
+		if (_cacheMode == ECacheMode::direct) {
+			fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+			s._bDirect = (fd >= 0);
+		}
+		if (fd < 0)
+			fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return -1;
+
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			::close(fd);
+			return -1;
+		}
+
+		// no kernel read ahead : the pages cached before a piece is read
+		// could not be told from the ones it would bring in. The reader
+		// keeps its own reads in flight instead
+		if ((_cacheMode != ECacheMode::normal) && !s._bDirect)
+			posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+
+		s._bUsed = true;
+		s._fd = fd;
+		s._mem = nullptr;
+		s._size = st.st_size;
+		s._submitOffset = s._readOffset = 0;
+		s._held = -1;
+		s._heldData = nullptr;
+		s._heldLen = s._heldPos = 0;
+		s._bEof = s._bError = false;
+		mapHoles(s, static_cast<uint64_t>(st.st_blocks) * 512);
+		skipHoles(s);
+		_backend->setFile(i, fd);
+		return i;
+	}
+	assert( false ); // more open files than slots
+	return -1;
+}
+
+int CFileReader::open(const void * data, std::size_t len)
+{
+	for (std::size_t i = 0; i < _slots.size(); i++) {
+		SSlot & s = _slots[i];
+		if (s._bUsed)
+			continue;
+
+		s._bUsed = true;
+		s._fd = -1;
+		s._bDirect = false;
+		s._mem = reinterpret_cast<const uint8_t*>(data);
+		s._size = len;
+		s._submitOffset = s._readOffset = 0;
+		s._held = -1;
+		s._heldData = nullptr;
+		s._heldLen = s._heldPos = 0;
+		s._bEof = s._bError = false;
+		s._holes.clear();
+		return i;
+	}
+	assert( false );
+	return -1;
+}
+
+// the holes of a sparse file, rounded to whole pieces. Files with as many
+// blocks as their size have none
+void CFileReader::mapHoles(SSlot & s, uint64_t allocated)
+{
+	s._holes.clear();
+	if (allocated >= s._size)
+		return;
+
+	uint64_t offset(0);
+	while (offset < s._size) {
+		const off_t data = lseek(s._fd, offset, SEEK_DATA);
+		if ((data < 0) && (errno != ENXIO)) {
+			s._holes.clear(); // no SEEK_DATA on this filesystem
+			return;
+		}
+
+		// ENXIO : a hole up to the end
+		const uint64_t end = (data < 0) ? s._size : std::min<uint64_t>(data, s._size);
+		const uint64_t begin = (offset + _pieceSize - 1) / _pieceSize * _pieceSize;
+		const uint64_t last  = (end == s._size) ? end : end / _pieceSize * _pieceSize;
+		if (begin < last)
+			s._holes.push_back(std::make_pair(begin, last));
+		if (end >= s._size)
+			break;
+
+		const off_t hole = lseek(s._fd, end, SEEK_HOLE);
+		if (hole < 0) {
+			s._holes.clear();
+			return;
+		}
+		offset = hole;
+	}
+
+	if (!s._holes.empty() && (_zeros.size() < _pieceSize))
+		_zeros.assign(_pieceSize, 0);
+}
+
+// the first hole ending after 'offset'
+const std::pair<uint64_t, uint64_t> * CFileReader::holeAfter(const SSlot & s, uint64_t offset) const
+{
+	auto i = std::upper_bound(s._holes.begin(), s._holes.end(), offset,
+		[](uint64_t o, const std::pair<uint64_t, uint64_t> & h) { return o < h.second; });
+	return (i == s._holes.end()) ? nullptr : &(*i);
+}
+
+// the next piece to submit is not in a hole
+void CFileReader::skipHoles(SSlot & s)
+{
+	const auto * h = holeAfter(s, s._submitOffset);
+	if (h && (h->first <= s._submitOffset))
+		s._submitOffset = h->second;
+}
+
+uint64_t CFileReader::holeLength(int slot) const
+{
+	const SSlot & s = _slots[slot];
+	const uint64_t pos = position(s);
+	const auto * h = holeAfter(s, pos);
+	return (h && (h->first <= pos)) ? h->second - pos : 0;
+}
+
+uint64_t CFileReader::dataLength(int slot) const
+{
+	const SSlot & s = _slots[slot];
+	const uint64_t pos = position(s);
+	const auto * h = holeAfter(s, pos);
+	const uint64_t end = h ? h->first : s._size;
+	return (end > pos) ? end - pos : 0;
+}
+
+void CFileReader::skipHole(int slot, uint64_t len)
+{
+	SSlot & s = _slots[slot];
+	assert( len <= holeLength(slot) );
+	const uint64_t pos = position(s);
+	releaseHeld(s);
+	s._readOffset = pos + len;
+	s_holeBytes += len;
+	if (s._readOffset >= s._size) {
+		s._bEof = true;
+		dropPending(s);
+	}
+}
+
+// pieces in flight must land before their buffer, or the file, are reused
+void CFileReader::dropPending(SSlot & s)
+{
+	while (!s._pending.empty()) {
+		const std::size_t i = s._pending.front();
+		while (!_pieces[i]._bDone)
+			waitCompletions();
+		s._pending.pop_front();
+		if (_pieces[i]._res > 0)
+			dropPages(s, _pieces[i]);
+		_free.push_back(i);
+		_inFlight--;
+	}
+}
+
+// the pages brought in by this piece, which were not cached before
+void CFileReader::dropPages(const SSlot & s, const SPiece & pc)
+{
+	if (pc._resident.empty() || (s._fd < 0))
+		return;
+
+	const std::size_t end = std::min<std::size_t>(pc._res, pc._len);
+	std::size_t run(0);
+	for (std::size_t page = 0; page * directAlign < end; page = run) {
+		run = page + 1;
+		if (pc._resident[page] & 1)
+			continue;
+		while ((run * directAlign < end) && !(pc._resident[run] & 1))
+			run++;
+
+		const std::size_t len = std::min(run * directAlign, end) - page * directAlign;
+		posix_fadvise(s._fd, pc._offset + page * directAlign, len, POSIX_FADV_DONTNEED);
+		s_droppedBytes += len;
+	}
+}
+
+void CFileReader::close(int slot)
+{
+	if ((slot < 0) || (static_cast<std::size_t>(slot) >= _slots.size()))
+		return;
+
+	SSlot & s = _slots[slot];
+	if (!s._bUsed)
+		return;
+
+	releaseHeld(s);
+	dropPending(s);
+	if (s._fd >= 0) {
+		_backend->setFile(slot, -1);
+		::close(s._fd);
+	}
+	s._fd = -1;
+	s._mem = nullptr;
+	s._bUsed = false;
+}
+
+void CFileReader::releaseHeld(SSlot & s)
+{
+	if (s._held >= 0) {
+		dropPages(s, _pieces[s._held]);
+		_free.push_back(s._held);
+	}
+	s._held = -1;
+	s._heldData = nullptr;
+	s._heldLen = s._heldPos = 0;
+}
+
+bool CFileReader::canSubmit(const SSlot & s) const
+{
+	return s._bUsed && (s._mem == nullptr) && !s._bEof && !s._bError && (s._submitOffset < s._size);
+}
+
+void CFileReader::submitPiece(std::size_t slot)
+{
+	SSlot & s = _slots[slot];
+	const std::size_t i = _free.back();
+	_free.pop_back();
+
+	SPiece & pc = _pieces[i];
+	pc._offset = s._submitOffset;
+	pc._len    = std::min<uint64_t>(_pieceSize, s._size - s._submitOffset);
+	pc._res    = 0;
+	pc._bDone  = false;
+	pc._resident.clear();
+	if ((_cacheMode != ECacheMode::normal) && !s._bDirect)
+		residentPages(s._fd, pc._offset, pc._len, pc._resident);
+
+	s._submitOffset += pc._len;
+	skipHoles(s);
+	s._pending.push_back(i);
+	_inFlight++;
+
+	// O_DIRECT reads whole blocks, the file end is a short read
+	const std::size_t len = s._bDirect ? (pc._len + directAlign - 1) / directAlign * directAlign : pc._len;
+	_backend->read(i, slot, s._fd, buffer(i), len, pc._offset);
+}
+
+// the waited slot first, then round robin up to the queue depth
+void CFileReader::submit(std::size_t slot)
+{
+	if (_slots[slot]._pending.empty() && canSubmit(_slots[slot])) {
+		assert( !_free.empty() );
+		submitPiece(slot);
+	}
+
+	while ((_engine != EIoEngine::sync) && (_inFlight < _depth) && !_free.empty()) {
+		bool bSubmitted(false);
+		for (std::size_t n = 0; (n < _slots.size()) && !bSubmitted; n++) {
+			const std::size_t i = _cursor++ % _slots.size();
+			if (canSubmit(_slots[i])) {
+				submitPiece(i);
+				bSubmitted = true;
+			}
+		}
+		if (!bSubmitted)
+			break;
+	}
+	_backend->flush();
+}
+
+void CFileReader::waitCompletions()
+{
+	CBackend::done_list done;
+	_backend->wait(done);
+	for (const auto & d : done) {
+		_pieces[d.first]._res   = d.second;
+		_pieces[d.first]._bDone = true;
+	}
+
+	// the files being read report an error, the next ones are read by threads.
+	// Closing the ring cancels what the kernel may still have in flight
+	if (!_backend->usable()) {
+		LOGW("io engine failed, using read threads");
+		_engine = EIoEngine::threads;
+		_backend.reset(new CThreadsBackend(std::min<std::size_t>(_depth, 8)));
+	}
+}
+
+bool CFileReader::nextPiece(int slot)
+{
+	SSlot & s = _slots[slot];
+	releaseHeld(s);
+	if (s._bError)
+		return false;
+
+	if (s._mem) {
+		s._heldData = s._mem + s._readOffset;
+		s._heldLen  = std::min<uint64_t>(_pieceSize, s._size - s._readOffset);
+		s._readOffset += s._heldLen;
+		s._bEof = (s._readOffset >= s._size);
+		return true;
+	}
+
+	// a hole : zeros, no read
+	const auto * h = holeAfter(s, s._readOffset);
+	if (h && (h->first <= s._readOffset)) {
+		s._heldData = _zeros.data();
+		s._heldLen  = std::min<uint64_t>(_pieceSize, h->second - s._readOffset);
+		s._readOffset += s._heldLen;
+		s_holeBytes += s._heldLen;
+		s._bEof = (s._readOffset >= s._size);
+		return true;
+	}
+
+	if (s._pending.empty() && !canSubmit(s)) {
+		s._bEof = true;
+		return true;
+	}
+
+	submit(slot);
+	const std::size_t i = s._pending.front();
+	while (!_pieces[i]._bDone)
+		waitCompletions();
+	s._pending.pop_front();
+	_inFlight--;
+
+	SPiece & pc = _pieces[i];
+	s._held     = i;
+	s._heldData = buffer(i);
+
+	// io_uring may complete a read in several parts
+	if ((pc._res > 0) && (static_cast<std::size_t>(pc._res) < pc._len) && (pc._res % directAlign == 0)) {
+		const std::size_t len = s._bDirect ? (pc._len - pc._res + directAlign - 1) / directAlign * directAlign : pc._len - pc._res;
+		const int64_t n = preadFull(s._fd, buffer(i) + pc._res, len, pc._offset + pc._res);
+		pc._res = (n < 0) ? n : pc._res + n;
+	}
+
+	if (pc._res < 0) {
+		s._bError = true;
+		releaseHeld(s);
+		dropPending(s);
+		return false;
+	}
+
+	// a short read before the listed end : the file was truncated
+	s._heldLen = std::min<std::size_t>(pc._res, pc._len);
+	s._readOffset = pc._offset + s._heldLen;
+
+	s_readBytes += s._heldLen;
+	if (s._bDirect)
+		s_directBytes += s._heldLen;
+	for (std::size_t page = 0; (page < pc._resident.size()) && (page * directAlign < s._heldLen); page++)
+		if (pc._resident[page] & 1)
+			s_cachedBytes += std::min(directAlign, s._heldLen - page * directAlign);
+
+	if ((s._heldLen < pc._len) || (s._readOffset >= s._size)) {
+		s._bEof = true;
+		dropPending(s);
+	}
+	return true;
+}
+
+bool CFileReader::next(int slot, const uint8_t *& data, std::size_t & len)
+{
+	const bool bRes = nextPiece(slot);
+	SSlot & s = _slots[slot];
+	data = s._heldData;
+	len  = s._heldLen;
+	s._heldPos = s._heldLen;
+	return bRes;
+}
+
+std::size_t CFileReader::read(int slot, void * dst, std::size_t len)
+{
+	uint8_t * p = reinterpret_cast<uint8_t*>(dst);
+	std::size_t n(0);
+	while (n < len) {
+		SSlot & s = _slots[slot];
+		if (s._heldPos < s._heldLen) {
+			const std::size_t k = std::min(len - n, s._heldLen - s._heldPos);
+			memcpy(p + n, s._heldData + s._heldPos, k);
+			s._heldPos += k;
+			n += k;
+			continue;
+		}
+		if (s._bEof || !nextPiece(slot) || (s._heldLen == 0))
+			break;
+	}
+	return n;
+}
+
+bool CFileReader::eof(int slot) const
+{
+	const SSlot & s = _slots[slot];
+	return s._bEof && (s._heldPos >= s._heldLen);
+}
+
+bool CFileReader::error(int slot) const
+{
+	return _slots[slot]._bError;
+}
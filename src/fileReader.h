@@ -0,0 +1,177 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#pragma once
+
+#include "common.h"
+#include <deque>
+#include <memory>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// how local files are read. sync : a blocking read when a piece is needed,
+// as fread did. threads : a pool of pread workers. uring : io_uring, with
+// registered buffers and files
+enum class EIoEngine
+{
+	sync,
+	threads,
+	uring
+};
+
+// what the reads leave in the page cache. fadvise : the pages the reader
+// brought in are dropped once consumed, the pages cached before stay. direct : O_DIRECT, the page cache is bypassed when the
+// filesystem allows it, else as fadvise
+enum class ECacheMode
+{
+	normal,
+	fadvise,
+	direct
+};
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// reads up to 'slotCount' files at once, by pieces. Up to 'depth' pieces are
+// read ahead, round robin across the open files, and delivered in order for
+// each file. Not thread safe : one reader by consumer thread
+
+class CFileReader
+{
+public:
+	static EIoEngine bestEngine();
+	static bool supported(EIoEngine e);
+	static const char * engineName(EIoEngine e);
+	static bool parseEngine(const std::string & name, EIoEngine & e);
+
+	// a whole file, or its first 'max' bytes, by blocking reads
+	static bool readFile(const std::string & path, std::string & data, ECacheMode m, std::size_t max = std::string::npos);
+
+	// bytes read from files by all the readers. cached : already in the page
+	// cache, dropped : dropped after use. Only known with a cache neutral mode.
+	// holes : zeros of sparse files, given without reading
+	struct SStats
+	{
+		uint64_t _read;
+		uint64_t _cached;
+		uint64_t _dropped;
+		uint64_t _direct;
+		uint64_t _holes;
+	};
+	static SStats stats();
+
+public:
+	CFileReader(EIoEngine e, std::size_t depth, std::size_t pieceSize, std::size_t slotCount = 1, ECacheMode m = ECacheMode::normal);
+	~CFileReader();
+
+public:
+	EIoEngine engine() const { return _engine; }
+
+	// a slot on the file, or -1
+	int open(const std::string & path);
+
+	// a slot on an in memory content, which must outlive the slot
+	int open(const void * data, std::size_t len);
+
+	void close(int slot);
+
+	// the next piece. No copy : valid until the next call on this slot.
+	// len is 0 at the end of the file. false on read error
+	bool next(int slot, const uint8_t *& data, std::size_t & len);
+
+	// fread like : copies up to len bytes, 0 at the end or on error
+	std::size_t read(int slot, void * dst, std::size_t len);
+
+	// the last piece was delivered
+	bool eof(int slot) const;
+	bool error(int slot) const;
+
+	// sparse files : the holes (SEEK_HOLE) covering whole pieces are not
+	// read, next() and read() give zeros for them. From the next byte to
+	// read, the length of the hole there, and the data before the next hole
+	uint64_t holeLength(int slot) const;
+	uint64_t dataLength(int slot) const;
+
+	// skips 'len' bytes of the hole at the next byte to read
+	void skipHole(int slot, uint64_t len);
+
+	class CBackend;
+
+private:
+	struct SPiece
+	{
+		uint64_t    _offset;
+		std::size_t _len;
+		int64_t     _res;
+		bool        _bDone;
+		std::vector<uint8_t> _resident; // pages cached before the read (fadvise)
+	};
+
+	struct SSlot
+	{
+		bool            _bUsed;
+		int             _fd;
+		bool            _bDirect;
+		const uint8_t * _mem;
+		uint64_t        _size;
+		uint64_t        _submitOffset;
+		uint64_t        _readOffset;
+		std::deque<std::size_t> _pending;
+		int             _held; // piece given to the consumer, -1 when none
+		const uint8_t * _heldData;
+		std::size_t     _heldLen;
+		std::size_t     _heldPos;
+		bool            _bEof;
+		bool            _bError;
+		std::vector<std::pair<uint64_t, uint64_t>> _holes; // [begin, end), by piece
+	};
+
+private:
+	uint8_t * buffer(std::size_t piece) { return _buffers + piece * _pieceSize; }
+	void mapHoles(SSlot & s, uint64_t allocated);
+	const std::pair<uint64_t, uint64_t> * holeAfter(const SSlot & s, uint64_t offset) const;
+	void skipHoles(SSlot & s);
+	uint64_t position(const SSlot & s) const { return s._readOffset - (s._heldLen - s._heldPos); }
+	bool canSubmit(const SSlot & s) const;
+	void submitPiece(std::size_t slot);
+	void submit(std::size_t slot);
+	void waitCompletions();
+	void releaseHeld(SSlot & s);
+	void dropPending(SSlot & s);
+	void dropPages(const SSlot & s, const SPiece & pc);
+	bool nextPiece(int slot);
+
+private:
+	EIoEngine   _engine;
+	ECacheMode  _cacheMode;
+	std::size_t _depth;
+	std::size_t _pieceSize;
+	uint8_t *   _buffers;
+	std::vector<SPiece>      _pieces;
+	std::vector<std::size_t> _free;
+	std::vector<SSlot>       _slots;
+	std::size_t _inFlight;
+	std::size_t _cursor; // round robin
+	std::unique_ptr<CBackend> _backend;
+	std::vector<uint8_t>      _zeros; // a piece of hole
+};
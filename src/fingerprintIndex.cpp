@@ -0,0 +1,118 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "fingerprintIndex.h"
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static std::string toLine(const std::string & path, const CFingerprint & fp)
+{
+	return fmt::format("{:016x} {} {} {}", fp._xxh64, fp._len, fp._md5.hex(), path);
+}
+
+bool CFingerprintIndex::open(const bf::path & path)
+{
+	std::lock_guard<std::mutex> lock(_m);
+	_fingerprints.clear();
+
+	boost::system::error_code ec;
+	bf::create_directories(path.parent_path(), ec);
+
+	// the last line of a file wins
+	std::size_t lineCount(0);
+	{
+		std::ifstream f(path.c_str());
+		std::string line;
+		while (std::getline(f, line))
+		{
+			std::vector<std::string> fields;
+			boost::algorithm::split(fields, line, boost::is_any_of(" "));
+			if (fields.size() < 4)
+				continue;
+
+			CFingerprint fp;
+			fp._xxh64 = strtoull(fields[0].c_str(), nullptr, 16);
+			fp._len   = strtoull(fields[1].c_str(), nullptr, 10);
+			fp._md5   = NMD5::CDigest::fromString(fields[2]);
+			const std::size_t pathPos = fields[0].size() + fields[1].size() + fields[2].size() + 3;
+			_fingerprints[line.substr(pathPos)] = fp;
+			lineCount++;
+		}
+	}
+
+	// rewritten when most lines are outdated
+	if (lineCount > 2 * _fingerprints.size() + 1000) {
+		std::ofstream f(path.c_str(), std::ios::out | std::ios::trunc);
+		for (const auto & i : _fingerprints)
+			f << toLine(i.first, i.second) << std::endl;
+	}
+
+	_file.open(path.c_str(), std::ios::out | std::ios::app);
+	if (!_file.is_open()) {
+		LOGE("can't open fingerprint index '{}'", path.string());
+		return false;
+	}
+
+	LOGI("fingerprint index : {} known file(s)", _fingerprints.size());
+	return true;
+}
+
+bool CFingerprintIndex::find(const bf::path & relativePath, CFingerprint & fp) const
+{
+	std::lock_guard<std::mutex> lock(_m);
+	const auto i = _fingerprints.find(relativePath.string());
+	if (i == _fingerprints.end())
+		return false;
+
+	fp = i->second;
+	return true;
+}
+
+void CFingerprintIndex::set(const bf::path & relativePath, const CFingerprint & fp)
+{
+	std::lock_guard<std::mutex> lock(_m);
+	CFingerprint & known = _fingerprints[relativePath.string()];
+	if ((known._len == fp._len) && (known._xxh64 == fp._xxh64) && (known._md5 == fp._md5))
+		return;
+
+	known = fp;
+	_file << toLine(relativePath.string(), fp) << std::endl;
+}
+
+void CFingerprintIndex::setMd5(const bf::path & relativePath, uint64_t len, const NMD5::CDigest & md5)
+{
+	std::lock_guard<std::mutex> lock(_m);
+	const auto i = _fingerprints.find(relativePath.string());
+	if ((i == _fingerprints.end()) || i->second._md5.isValid() || (i->second._len != len) || !md5.isValid())
+		return;
+
+	i->second._md5 = md5;
+	_file << toLine(relativePath.string(), i->second) << std::endl;
+}
+
+std::size_t CFingerprintIndex::size() const
+{
+	std::lock_guard<std::mutex> lock(_m);
+	return _fingerprints.size();
+}
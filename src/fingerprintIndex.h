@@ -0,0 +1,68 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#pragma once
+
+#include "common.h"
+#include "md5.h"
+#include <unordered_map>
+#include <fstream>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// --fingerprint-fast : last known xxh64 and md5 of each source file. A file
+// whose size and xxh64 didn't change keeps its md5, which is then compared
+// to the stored object as with --fingerprint-md5. Loaded from and appended
+// to a local file of the state folder, one line per file :
+//
+//	<xxh64 hex> <size> <md5 hex> <relative path>
+//
+// A same size file whose xxh64 changed is not read again for its md5 : its
+// entry is set with a null md5, which its upload fills in.
+
+struct CFingerprint
+{
+	CFingerprint() : _len(0), _xxh64(0), _md5() {}
+
+	uint64_t      _len;
+	uint64_t      _xxh64;
+	NMD5::CDigest _md5;
+};
+
+class CFingerprintIndex
+{
+public:
+	bool open(const bf::path & path);
+	bool find(const bf::path & relativePath, CFingerprint & fp) const;
+	void set(const bf::path & relativePath, const CFingerprint & fp);
+
+	// the md5 of an entry set without it (content changed), once uploaded
+	void setMd5(const bf::path & relativePath, uint64_t len, const NMD5::CDigest & md5);
+	std::size_t size() const;
+
+private:
+	mutable std::mutex _m;
+	std::unordered_map<std::string, CFingerprint> _fingerprints;
+	std::ofstream _file;
+};
@@ -0,0 +1,235 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "folderSummaries.h"
+#include "../thirdparty/jsonxx/jsonxx.h"
+#include <fstream>
+#include <sstream>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// json keys can't be empty : "." is the source folder
+static std::string folderKey(const bf::path & relPath)
+{
+	return relPath.empty() ? std::string(".") : relPath.string();
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+CFolderSummaries::CFolderSummaries(CContext & ctx, const CRemoteLs & remoteLs, const CPackStore & packStore)
+:	CContextual(ctx)
+,	_remoteLs(remoteLs)
+,	_packStore(packStore)
+,	_knownClean(false)
+,	_unchangedFolderCount(0)
+,	_skippedFileCount(0)
+{
+	// what changes the stored objects of unchanged files
+	_seed = _ctx._options->storageSettings();
+}
+
+NMD5::CDigest CFolderSummaries::mix(const NMD5::CDigest & d) const
+{
+	return d.isValid() ? NMD5::computeMd5(_seed + d.hex()) : NMD5::CDigest();
+}
+
+std::string CFolderSummaries::manifestUrl() const
+{
+	CCurl curl;
+	return fmt::format("{}/{}/{}/{}/summaries.json", _ctx._credentials.get().endpoint(), _ctx._options->_dstContainer, summaryPrefix, curl.escapePath(_ctx._options->_dstFolder).string());
+}
+
+void CFolderSummaries::load()
+{
+	std::lock_guard<std::mutex> lock(_m);
+	_known.clear();
+	_knownClean = false;
+	_knownFolders.clear();
+	_folders.clear();
+	_cleanTrees.clear();
+	if (!enabled())
+		return;
+
+	const bf::path path = _ctx._options->stateFile("folders");
+	std::string local;
+	{
+		std::ifstream f(path.c_str());
+		std::stringstream ss;
+		ss << f.rdbuf();
+		local = ss.str();
+	}
+
+	// written back by a complete run only
+	boost::system::error_code ec;
+	bf::remove(path, ec);
+
+	if (local.empty()) {
+		LOGI("folder summaries : no previous complete run");
+		return;
+	}
+
+	CRequest rq(_ctx._options->_curlVerbose);
+	rq.setHeaders(_ctx._credentials.authHeaders());
+	rq.get(manifestUrl());
+	if ((rq.getHttpResponseCode() != 200) || (rq.getResponse() != local)) {
+		LOGI("folder summaries : the container manifest differs from the local one [http response : {}]", rq.getHttpResponseCode());
+		return;
+	}
+
+	jsonxx::Object manifest;
+	if ((!manifest.parse(local)) || (!manifest.has<jsonxx::Object>("folders"))) {
+		LOGW("folder summaries : can't read the manifest");
+		return;
+	}
+
+	for (const auto & i : manifest.get<jsonxx::Object>("folders").kv_map())
+	{
+		if (!i.second->is<jsonxx::String>())
+			continue;
+
+		const std::string & v = i.second->get<jsonxx::String>();
+		const std::string::size_type sep = v.find(' ');
+		CSummary s;
+		s._own  = NMD5::CDigest::fromString(v.substr(0, sep));
+		s._tree = (sep == std::string::npos) ? NMD5::CDigest() : NMD5::CDigest::fromString(v.substr(sep + 1));
+		_knownFolders[i.first] = s;
+	}
+
+	_known = local;
+	_knownClean = manifest.has<jsonxx::Boolean>("clean") && manifest.get<jsonxx::Boolean>("clean");
+	LOGI("folder summaries : {} known folder(s)", _knownFolders.size());
+}
+
+bool CFolderSummaries::unchanged(const CAsset * pFolder, const NMD5::CDigest & own)
+{
+	assert( pFolder && pFolder->isFolder() );
+	if (!own.isValid())
+		return false;
+
+	{
+		std::lock_guard<std::mutex> lock(_m);
+		const auto i = _knownFolders.find(folderKey(pFolder->getRelativePath()));
+		if ((i == _knownFolders.end()) || (!i->second._own.isValid()) || (i->second._own != mix(own)))
+			return false;
+	}
+
+	// a backup may have been deleted from the container since
+	uint64_t fileCount(0);
+	for (std::size_t i=0; i<pFolder->childCount(); ++i)
+	{
+		const CAsset * p = pFolder->childAt(i);
+		if (p->isFolder())
+			continue;
+
+		CPackEntry e;
+		const bf::path relPath = p->getRelativePath();
+		if ((!_remoteLs.exists(relPath)) && !(_packStore.enabled() && _packStore.find(relPath, e)))
+			return false;
+		fileCount++;
+	}
+
+	_unchangedFolderCount++;
+	_skippedFileCount += fileCount;
+	return true;
+}
+
+void CFolderSummaries::set(const CAsset * pFolder, const NMD5::CDigest & own, const NMD5::CDigest & tree)
+{
+	assert( pFolder && pFolder->isFolder() );
+	CSummary s;
+	s._own  = mix(own);
+	s._tree = mix(tree);
+
+	const std::string key = folderKey(pFolder->getRelativePath());
+	std::lock_guard<std::mutex> lock(_m);
+	_folders[key] = s;
+
+	const auto i = _knownFolders.find(key);
+	if (_knownClean && s._tree.isValid() && (i != _knownFolders.end()) && (i->second._tree == s._tree))
+		_cleanTrees.insert(key);
+}
+
+bool CFolderSummaries::inCleanTree(const bf::path & relPath) const
+{
+	std::lock_guard<std::mutex> lock(_m);
+	if (_cleanTrees.empty())
+		return false;
+
+	for (bf::path p = relPath.parent_path(); ; p = p.parent_path())
+	{
+		if (_cleanTrees.find(folderKey(p)) != _cleanTrees.end())
+			return true;
+		if (p.empty())
+			break;
+	}
+	return false;
+}
+
+bool CFolderSummaries::save(bool bClean)
+{
+	if (!enabled())
+		return true;
+
+	std::string json;
+	{
+		std::lock_guard<std::mutex> lock(_m);
+		jsonxx::Object folders;
+		for (const auto & i : _folders)
+			if (i.second._own.isValid())
+				folders << i.first << fmt::format("{} {}", i.second._own.hex(), i.second._tree.isValid() ? i.second._tree.hex() : std::string("-"));
+
+		jsonxx::Object manifest;
+		manifest << "version" << static_cast<jsonxx::Number>(1);
+		manifest << "clean"   << bClean;
+		manifest << "folders" << folders;
+		json = manifest.json();
+	}
+
+	// the container already holds it
+	if (json != _known)
+	{
+		CRequest rq(_ctx._options->_curlVerbose);
+		rq.setHeaders(_ctx._credentials.uploadHeaders());
+		rq.addHeader("Content-Type", "application/json");
+		rq.put(manifestUrl(), json.data(), json.size());
+		if (rq.getHttpResponseCode() != 201) {
+			LOGW("Error uploading the folder summaries [http response : {}]", rq.getHttpResponseCode());
+			return false;
+		}
+	}
+
+	const bf::path path = _ctx._options->stateFile("folders");
+	boost::system::error_code ec;
+	bf::create_directories(path.parent_path(), ec);
+	std::ofstream f(path.c_str(), std::ios::out | std::ios::trunc);
+	f << json;
+	f.close();
+	if (!f) {
+		LOGW("can't write the folder summaries '{}'", path.string());
+		return false;
+	}
+
+	LOGD("folder summaries : {} folder(s) saved", _folders.size());
+	return true;
+}
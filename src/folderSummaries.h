@@ -0,0 +1,106 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#pragma once
+
+#include "context.h"
+#include "remoteLs.h"
+#include "packStore.h"
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+
+Folder summaries (--folder-summaries)
+
+With the last modification date finger print, the source scan sums up each
+folder by two digests :
+	own  : md5 of the name, size and last modification date of its files
+	tree : md5 of its own digest, and of the name and tree digest of each
+	       of its sub folders (a Merkle tree of the source folder)
+Both are mixed with the settings that change how files are stored.
+
+After a complete run, they are written to the state folder and to a
+manifest object at the container root :
+	.hubk-folders/<destination folder>/summaries.json
+	{ "version": 1, "clean": true, "folders": { "<relative path>": "<own> <tree>", ... } }
+The source folder itself is ".". 'clean' is set when the run deleted the backups of the deleted files.
+
+The summaries are only trusted when both copies are the same. The local copy
+is removed when loaded, so an interrupted run leaves nothing to trust. The
+files of a folder whose own digest didn't change, and which are all in the
+remote listing or in a pack, are up to date without being checked one by one.
+With --del-non-existing and a clean manifest, the backups under a tree that
+didn't change are not looked for deletion.
+
+*/
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CFolderSummaries
+:	public CContextual
+{
+public:
+	CFolderSummaries(CContext & ctx, const CRemoteLs & remoteLs, const CPackStore & packStore);
+
+public:
+	bool enabled() const { return _ctx._options->_folderSummaries; }
+
+	void load();
+	bool save(bool bClean);
+
+	// thread safe. The files of an unchanged folder are counted as skipped
+	bool unchanged(const CAsset * pFolder, const NMD5::CDigest & own);
+	void set(const CAsset * pFolder, const NMD5::CDigest & own, const NMD5::CDigest & tree);
+
+	// the remote object is under a tree that didn't change since a clean run
+	bool inCleanTree(const bf::path & relPath) const;
+
+	uint64_t unchangedFolderCount() const { return _unchangedFolderCount; }
+	uint64_t skippedFileCount() const { return _skippedFileCount; }
+
+private:
+	struct CSummary
+	{
+		NMD5::CDigest _own;
+		NMD5::CDigest _tree;
+	};
+
+	NMD5::CDigest mix(const NMD5::CDigest & d) const;
+	std::string manifestUrl() const;
+
+private:
+	const CRemoteLs  & _remoteLs;
+	const CPackStore & _packStore;
+	std::string _seed;
+
+	mutable std::mutex _m;
+	std::string                     _known;        // trusted manifest, as stored
+	bool                            _knownClean;
+	std::map<std::string, CSummary> _knownFolders;
+	std::map<std::string, CSummary> _folders;      // this run
+	std::set<std::string>           _cleanTrees;
+	std::atomic<uint64_t> _unchangedFolderCount;
+	std::atomic<uint64_t> _skippedFileCount;
+};
@@ -0,0 +1,118 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+/*
+
+Restores an object stored with --crypt-format gcm :
+
+	hubk-decrypt -k <password> [input [output]]
+
+stdin and stdout are used when no file is given. Objects crypted with the
+default aes-256-cbc format are decrypted by openssl :
+
+	openssl aes-256-cbc -d -md md5 -k <password> -in <input> -out <output>
+
+*/
+
+#include "cryptGcm.h"
+#include "common.h"
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int usage()
+{
+	fprintf(stderr, "usage : hubk-decrypt -k <password> [input [output]]\n");
+	return 1;
+}
+
+int main(int argc, char ** argv)
+{
+	auto console = spdlog::stderr_logger_mt(configConsoleName);
+	console->set_pattern("%v");
+
+	std::string password;
+	std::vector<std::string> files;
+	for (int i=1; i < argc; i++) {
+		if ((strcmp(argv[i], "-k") == 0) && (i + 1 < argc))
+			password = argv[++i];
+		else
+			files.push_back(argv[i]);
+	}
+	if (password.empty() || (files.size() > 2))
+		return usage();
+
+	FILE * in  = (files.size() > 0) ? fopen(files[0].c_str(), "rb") : stdin;
+	if (in == nullptr) {
+		LOGE("can't open '{}'", files[0]);
+		return 1;
+	}
+	FILE * out = (files.size() > 1) ? fopen(files[1].c_str(), "wb") : stdout;
+	if (out == nullptr) {
+		LOGE("can't create '{}'", files[1]);
+		return 1;
+	}
+
+	const int numThread = std::max(1u, std::thread::hardware_concurrency());
+	CGcmDecryptEngine decryptor(numThread);
+	decryptor.decryptStart(password);
+
+	std::vector<uint8_t> readed((gcmChunkSize + gcmTagSize) * numThread), decrypted;
+	bool bOk(true), bFirst(true);
+	for (;;) {
+		const std::size_t n = fread(readed.data(), 1, readed.size(), in);
+		if (n == 0)
+			break;
+
+		if (bFirst && (n >= 8) && (memcmp(readed.data(), "Salted__", 8) == 0)) {
+			LOGE("aes-256-cbc crypted object, decrypt it with : openssl aes-256-cbc -d -md md5 -k <password>");
+			return 1;
+		}
+		bFirst = false;
+
+		bOk = decryptor.update(decrypted, readed.data(), n);
+		if (!bOk)
+			break;
+		fwrite(decrypted.data(), 1, decrypted.size(), out);
+	}
+
+	if (bOk) {
+		bOk = decryptor.finalize(decrypted);
+		if (bOk)
+			fwrite(decrypted.data(), 1, decrypted.size(), out);
+	}
+
+	if (in != stdin)
+		fclose(in);
+	if ((fflush(out) != 0) || ((out != stdout) && (fclose(out) != 0)))
+		bOk = false;
+
+	if (!bOk) {
+		LOGE("decryption failed : wrong password, corrupted or truncated object");
+		return 1;
+	}
+	return 0;
+}
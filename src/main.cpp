@@ -24,11 +24,19 @@
 
 #include "common.h"
 #include "md5.h"
+#include "md5Multi.h"
+#include "xxh64.h"
 #include "uploader.h"
+#include "archiveUploader.h"
+#include "chunkStore.h"
+#include "packStore.h"
+#include "folderSummaries.h"
+#include "deadline.h"
 #include "srcFileList.h"
 #include "process.h"
 #include "remoteLs.h"
 #include "context.h"
+#include "../thirdparty/jsonxx/jsonxx.h"
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -37,7 +45,7 @@ class CMySourceParser
 ,	public CSourceParser
 {
 public:
-	CMySourceParser(CContext & ctx);
+	CMySourceParser(CContext & ctx, CFolderSummaries & summaries, CDeadline & deadline, const CPackStore & packStore);
 	~CMySourceParser();
 
 	void start();
@@ -52,16 +60,26 @@ protected:
 	virtual void onStart() override;
 	virtual void onNewAsset(CAsset * p) override;
 	virtual void onDone() override;
+	virtual void onFolderListed(CAsset * p, const NMD5::CDigest & own) override;
+	virtual void onFolderDone(CAsset * p, const NMD5::CDigest & own, const NMD5::CDigest & tree) override;
 
 private:
+	CFolderSummaries & _summaries;
+	CDeadline        & _deadline;
+	const CPackStore & _packStore;
+	bool             _bUnchangedFolder; // the folder whose entries are given to onNewAsset
 	std::thread      _thread;
 	std::atomic_bool _done;
 };
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-CMySourceParser::CMySourceParser(CContext & ctx)
+CMySourceParser::CMySourceParser(CContext & ctx, CFolderSummaries & summaries, CDeadline & deadline, const CPackStore & packStore)
 :	CContextual(ctx)
+,	_summaries(summaries)
+,	_deadline(deadline)
+,	_packStore(packStore)
+,	_bUnchangedFolder(false)
 ,	_done(false)
 {
 }
@@ -91,8 +109,46 @@ void CMySourceParser::onStart()
 	_ctx._remoteMd5Queue.resetDone();
 }
 
+void CMySourceParser::onFolderListed(CAsset * p, const NMD5::CDigest & own)
+{
+	_bUnchangedFolder = _summaries.enabled() && _summaries.unchanged(p, own);
+	if (_bUnchangedFolder)
+		LOGD("unchanged folder '{}'", p->getRelativePath().string());
+}
+
+void CMySourceParser::onFolderDone(CAsset * p, const NMD5::CDigest & own, const NMD5::CDigest & tree)
+{
+	if (_summaries.enabled())
+		_summaries.set(p, own, tree);
+}
+
 void CMySourceParser::onNewAsset(CAsset * p)
 {
+	// file of an unchanged folder : up to date, without md5 pass nor HEAD
+	if (_bUnchangedFolder && !p->isFolder()) {
+		boost::system::error_code ec;
+		CHash h;
+		h._computed = true;
+		h._len = bf::file_size(p->getFullPath(), ec);
+		p->setSrcHash(h);
+		p->setBackupStatus(BACKUP_ITEM_STATUS::UP_TO_DATE);
+		_ctx._todoQueue.add(p);
+		return;
+	}
+
+	// left by the previous run, unchanged : uploaded without being checked again.
+	// Other links are still copied from their first link once it's stored, as
+	// the status updater decides for the files it checks
+	if (!p->isFolder() && _deadline.resume(p)) {
+		if (p->getLinkPrimary() && (!_packStore.packable(p->getSrcHash()._len)))
+			p->setBackupStatus(BACKUP_ITEM_STATUS::TO_BE_LINKED);
+		_ctx._todoQueue.add(p);
+		return;
+	}
+
+	if ((_ctx._options->_readOrder != EReadOrder::scan) && !p->isFolder())
+		p->setReadKey(NDiskLayout::readKey(_ctx._options->_readOrder, p->getFullPath().string()));
+
 	_ctx._localMd5Queue.add(p);
 	_ctx._remoteMd5Queue.add(p);
 }
@@ -106,7 +162,7 @@ void CMySourceParser::onDone()
 
 bool CMySourceParser::abort()
 {
-	return _ctx.aborted();
+	return _ctx.aborted() || _ctx.deadlineReached();
 }
 
 void CMySourceParser::parse()
@@ -123,6 +179,8 @@ void CMySourceParser::parse()
 	_done = true;
 	LOGI("source file count : {}", getSrcFileCount());
 	LOGI("skipped file count : {}", getExcludeFileCount());
+	if (getLinkFileCount() > 0)
+		LOGI("hard link count : {} (besides the first link of each file)", getLinkFileCount());
 }
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -132,72 +190,166 @@ class CLocalMd5Process
 ,	public CProcess
 {
 public:
-	CLocalMd5Process(CContext & ctx);
+	CLocalMd5Process(CContext & ctx, const CRemoteLs & remoteLs);
 
 private:
-	virtual bool abort() override { return _ctx.aborted(); }
+	virtual bool abort() override { return _ctx.aborted() || _ctx.deadlineReached(); }
 	virtual bool process(CAsset * p) override;
+	virtual std::size_t batchSize() const override;
+	virtual bool processBatch(std::vector<CAsset*> & batch) override;
 	virtual void onDone() override;
 
+	bool checkSize(CAsset * p);
+	bool computeMd5s(const std::vector<CAsset*> & files);
+	bool likelyUploaded(CAsset * p, const CHash & h) const;
+	void keepContent(CAsset * p, const CHash & h, std::string & content, bool bComplete);
+	CFileReader & reader();
+
+private:
+	const CRemoteLs &   _remoteLs;
+	const NMD5::EEngine _md5Engine;
 };
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-CLocalMd5Process::CLocalMd5Process(CContext & ctx)
+CLocalMd5Process::CLocalMd5Process(CContext & ctx, const CRemoteLs & remoteLs)
 :	CContextual(ctx)
 ,	CProcess(ctx._localMd5Queue,ctx._localMd5DoneQueue)
+,	_remoteLs(remoteLs)
+,	_md5Engine(NMD5::CMultiComputer::bestEngine())
+{
+}
+
+// new file, or listed etag which is the plain md5 and differs. Crypted or
+// compressed objects are only known after their HEAD : they are expected to
+// be up to date
+bool CLocalMd5Process::likelyUploaded(CAsset * p, const CHash & h) const
+{
+	const auto i = _remoteLs.objects().find(p->getRelativePath());
+	if (i == _remoteLs.objects().end())
+		return true;
+
+	return (!_ctx.crypted()) && (_ctx._options->_compressLevel == 0) && (i->second._etag != h._md5);
+}
+
+// --read-cache : the content read by the md5 pass, reserved before reading,
+// is kept for the upload or released
+void CLocalMd5Process::keepContent(CAsset * p, const CHash & h, std::string & content, bool bComplete)
+{
+	if (bComplete && likelyUploaded(p, h))
+		_ctx._readCache.put(p, std::move(content));
+	else
+		_ctx._readCache.release(h._len);
+}
+
+// one reader by hashing thread, with a slot by md5 lane
+CFileReader & CLocalMd5Process::reader()
 {
+	static thread_local std::unique_ptr<CFileReader> r;
+	if (!r)
+		r.reset(new CFileReader(_ctx._options->_ioEngine, _ctx._options->_ioDepth, ioPieceSize, batchSize(), _ctx._options->_cacheMode));
+	return *r;
+}
+
+bool CLocalMd5Process::checkSize(CAsset * p)
+{
+	const uint64_t sz= bf::file_size(p->getFullPath());
+	if ((sz >= fileSizeMax) && (!_ctx._options->_chunked)) {
+		LOGE("file '{}' is more than 5Go.", p->getFullPath());
+		_ctx.abort();
+		return false;
+	}
+	return true;
 }
 
 bool CLocalMd5Process::process( CAsset * p)
 {
+	// other link of a file : hashed as its first link, by the status updater
+	if (p->getLinkPrimary())
+		return true;
+
 	bool bRes(true);
 	if (!p->isFolder()) {
 		
 		const uint64_t sz= bf::file_size(p->getFullPath());
-		if (sz >= fileSizeMax) {
-			LOGE("file '{}' is more than 5Go.", p->getFullPath());
-			_ctx.abort();
+		if (!checkSize(p))
 			return false;
-		}
 		
-		if (_ctx._options->_forceComputeLocalMd5)
+		if (_ctx._options->contentFingerPrint())
 		{
-			// we have to compute local md5 to compare
+			// we have to compute local md5 to compare. With the fast finger
+			// print, the md5 of a file whose xxh64 didn't change is known
+			const bool bFast = _ctx._options->_fastFingerPrint;
+			CFingerprint known;
+			const bool bKnown = bFast && _ctx._fingerprintIndex.find(p->getRelativePath(), known) && (known._len == sz) && known._md5.isValid();
 	
-			FILE* f = fopen( p->getFullPath().c_str(), "rb");
-			if (f == nullptr) {
+			CFileReader & r = reader();
+			const int slot = r.open(p->getFullPath().string());
+			if (slot < 0) {
 				LOGE("file open error '{}'", p->getFullPath());
 				_ctx.abort();
 				return false;
 			}
 			
+			// with --read-cache, the file is copied in a buffer kept for its upload
+			const bool bCache = _ctx._readCache.enabled() && _ctx._readCache.reserve(sz);
+			std::string content(bCache ? sz : 0, '\0');
+
 			NMD5::CComputer c;
+			CXxh64 xxh;
 			c.init();
-			uint64_t reste( sz );
-			std::vector<uint8_t> buffer(1024*1024*1); // 1Mo
-			while (reste && (!abort()))
+			uint64_t total(0);
+			while ((!r.eof(slot)) && (!abort()))
 			{
-				const uint64_t readed = fread(buffer.data(),1,buffer.size(), f);
-				if (ferror( f )) {
-					fclose(f);
+				const uint8_t * data(nullptr);
+				std::size_t readed(0);
+				if (!r.next(slot, data, readed)) {
+					r.close(slot);
+					if (bCache)
+						_ctx._readCache.release(sz);
 					LOGE("file read error '{}'", p->getFullPath());
 					_ctx.abort();
 					return false;
 				}
 				
-				reste -= readed;
-				if (readed)
-					c.feed( buffer.data(), readed);
+				if (bCache && (total + readed <= sz))
+					memcpy(&content[total], data, readed);
+				total += readed;
+				if (readed && !bKnown)
+					c.feed( data, readed);
+				if (readed && bFast)
+					xxh.feed( data, readed);
 			}
 			c.done();
-			fclose(f);
+			r.close(slot);
+			const bool bComplete = (total == sz); // else changed since listed
 			
 			//LOGD("computing md5 of {}", p->getFullPath().string());
 			CHash h;
 			h._computed= true;
 			h._len = sz;
 			h._md5 = c.getDigest();
+
+			if (bKnown && (xxh.digest() == known._xxh64))
+				h._md5 = known._md5;
+
+			else if (bKnown && bCache && bComplete)
+				h._md5 = NMD5::computeMd5(content);
+
+			// same size, other content : the md5 stays unknown, the file is
+			// updated and its upload computes the md5 while it streams it
+			else if (bKnown)
+				h._md5 = NMD5::CDigest();
+
+			if (bFast) {
+				CFingerprint fp;
+				fp._len   = sz;
+				fp._xxh64 = xxh.digest();
+				fp._md5   = h._md5;
+				_ctx._fingerprintIndex.set(p->getRelativePath(), fp);
+			}
+			if (bCache)
+				keepContent(p, h, content, bComplete);
 			p->setSrcHash(h);
 		
 		} else {
@@ -212,6 +364,134 @@ bool CLocalMd5Process::process( CAsset * p)
 	return bRes;
 }
 
+// with md5 fingerprints, files are hashed by simd lanes batches
+std::size_t CLocalMd5Process::batchSize() const
+{
+	return _ctx._options->_forceComputeLocalMd5 ? NMD5::CMultiComputer::laneCount(_md5Engine) : 1;
+}
+
+bool CLocalMd5Process::processBatch(std::vector<CAsset*> & batch)
+{
+	if (batch.size() < 2)
+		return CProcess::processBatch(batch);
+
+	std::vector<CAsset*> files;
+	for (auto p : batch) {
+		if (p->isFolder() || p->getLinkPrimary())
+			continue;
+		if (!checkSize(p))
+			return false;
+		files.push_back(p);
+	}
+	return computeMd5s(files);
+}
+
+// one lane per file, all read by pieces and hashed in lockstep. A lane is
+// released as soon as its file ends
+bool CLocalMd5Process::computeMd5s(const std::vector<CAsset*> & files)
+{
+	struct SLane {
+		CAsset * _p;
+		int      _slot;
+		uint64_t _len;
+		uint64_t _size;
+		bool     _bCache;
+		std::string _content; // --read-cache
+	};
+
+	// the reader keeps pieces of all the lanes in flight
+	CFileReader & r = reader();
+	NMD5::CMultiComputer c(_md5Engine);
+	std::vector<SLane> lanes(std::min(c.laneCount(), files.size()));
+	for (auto & l : lanes) {
+		l._p = nullptr;
+		l._slot = -1;
+		l._bCache = false;
+	}
+
+	bool bRes(true);
+	std::size_t next(0), busyCount(0);
+	do {
+		for (std::size_t i = 0; i < lanes.size(); i++) {
+			SLane & l = lanes[i];
+			if (l._p || (next >= files.size()) || !bRes)
+				continue;
+
+			l._p   = files[next++];
+			l._len = 0;
+			l._slot = r.open( l._p->getFullPath().string() );
+			if (l._slot < 0) {
+				LOGE("file open error '{}'", l._p->getFullPath());
+				bRes = false;
+				break;
+			}
+			l._size   = bf::file_size(l._p->getFullPath());
+			l._bCache = _ctx._readCache.enabled() && _ctx._readCache.reserve(l._size);
+			if (l._bCache)
+				l._content.assign(l._size, '\0');
+			c.init(i);
+			busyCount++;
+		}
+
+		for (std::size_t i = 0; (i < lanes.size()) && bRes; i++) {
+			SLane & l = lanes[i];
+			if (l._p == nullptr)
+				continue;
+
+			// the piece stays valid until the next one of this slot, after update()
+			const uint8_t * data(nullptr);
+			std::size_t readed(0);
+			if (!r.next(l._slot, data, readed)) {
+				LOGE("file read error '{}'", l._p->getFullPath());
+				bRes = false;
+				break;
+			}
+			if (l._bCache && (l._len + readed <= l._size))
+				memcpy(&l._content[l._len], data, readed);
+			l._len += readed;
+			c.feed(i, data, readed);
+		}
+		if (!bRes)
+			break;
+		c.update();
+
+		for (std::size_t i = 0; i < lanes.size(); i++) {
+			SLane & l = lanes[i];
+			if ((l._p == nullptr) || !r.eof(l._slot))
+				continue;
+
+			// the size stated before reading, as a single file does : the
+			// content is only kept when the reads match it
+			CHash h;
+			h._computed= true;
+			h._len = l._size;
+			h._md5 = c.done(i);
+			if (l._bCache) {
+				keepContent(l._p, h, l._content, l._len == l._size);
+				std::string().swap(l._content);
+				l._bCache = false;
+			}
+			l._p->setSrcHash(h);
+
+			r.close(l._slot);
+			l._slot = -1;
+			l._p = nullptr;
+			busyCount--;
+		}
+	} while (((next < files.size()) || (busyCount > 0)) && (!abort()));
+
+	for (auto & l : lanes) {
+		if (l._slot >= 0)
+			r.close(l._slot);
+		if (l._bCache)
+			_ctx._readCache.release(l._size);
+	}
+
+	if (!bRes)
+		_ctx.abort();
+	return bRes && !abort();
+}
+
 void CLocalMd5Process::onDone()
 {
 	CProcess::onDone();
@@ -229,7 +509,7 @@ public:
 
 protected:
 	virtual bool process(CAsset * p) override;
-	virtual bool abort() override { return _ctx.aborted(); }
+	virtual bool abort() override { return _ctx.aborted() || _ctx.deadlineReached(); }
 	virtual void onDone() override;
 
 private:
@@ -252,10 +532,10 @@ bool CRemoteMd5Process::process(CAsset * p)
 	{
 		if ( _remoteLs.exists( p->getRelativePath()) )
 		{
-			const CCredentials & cr = _ctx._cr;
+			const CCredentials cr = _ctx._credentials.get();
 		
-			rq.addHeader(headerAuthToken, cr.token());
-			const std::string url( fmt::format("{}/{}/{}/{}", cr.endpoint(), _ctx._options->_dstContainer, _ctx._options->_dstFolder.string(), rq.escapePath(p->getRelativePath()).string()));
+			rq.setHeaders(_ctx._credentials.authHeaders());
+			const std::string url( fmt::format("{}/{}/{}", cr.endpoint(), _ctx._options->_dstContainer, (_ctx._options->_dstFolder / rq.escapePath(p->getRelativePath())).string()));
 			rq.head(url);
 			
 			if (rq.getHttpResponseCode() == 200) {
@@ -306,7 +586,7 @@ class CBackupStatusUpdater
 :	public CContextual
 {
 public:
-	CBackupStatusUpdater(CContext & context, const CRemoteLs & remoteLs);
+	CBackupStatusUpdater(CContext & context, const CRemoteLs & remoteLs, const CPackStore & packStore);
 	~CBackupStatusUpdater();
 
 	void start();
@@ -315,17 +595,21 @@ public:
 private:
 	void run();
 	CAsset * getNext(bool & remoteExists);
+	std::vector<CCopySource> findCopySources(CAsset * p) const;
+	BACKUP_ITEM_STATUS getPackedStatus(CAsset * p) const;
 
 private:
 	const CRemoteLs & _remoteLs;
+	const CPackStore & _packStore;
 	std::thread _thread;
 };
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-CBackupStatusUpdater::CBackupStatusUpdater(CContext & ctx, const CRemoteLs & remoteLs)
+CBackupStatusUpdater::CBackupStatusUpdater(CContext & ctx, const CRemoteLs & remoteLs, const CPackStore & packStore)
 :	CContextual(ctx)
 ,	_remoteLs(remoteLs)
+,	_packStore(packStore)
 {
 }
 
@@ -386,7 +670,15 @@ CAsset * CBackupStatusUpdater::getNext(bool & remoteExists)
 			return nullptr;
 		}
 		
-		if (_ctx._options->_forceComputeLocalMd5) {
+		// other link of a file : same content as its first link, once hashed
+		if (p->getLinkPrimary() && !p->getSrcHash()._computed) {
+			const CHash h = p->getLinkPrimary()->getSrcHash();
+			if (!h._computed)
+				continue;
+			p->setSrcHash(h);
+		}
+
+		if (_ctx._options->contentFingerPrint()) {
 			assert( p->getSrcHash()._computed);
 		}
 		
@@ -412,6 +704,47 @@ CAsset * CBackupStatusUpdater::getNext(bool & remoteExists)
 
 }
 
+// remote objects that may already hold the content of a new file, as for
+// a renamed or moved file. Matched on the stored size, then on the md5 when
+// the backup is not crypted and the local md5 is known
+std::vector<CCopySource> CBackupStatusUpdater::findCopySources(CAsset * p) const
+{
+	std::vector<CCopySource> result;
+	const CHash h = p->getSrcHash();
+	if (h._len < copyMinSize)
+		return result;
+
+	const uint64_t storedSize = _ctx.crypted() ? getCryptedSize(h._len, _ctx._options->_cryptFormat) : h._len;
+	for (const auto & i : _remoteLs.findBySize(storedSize))
+	{
+		if ((!_ctx.crypted()) && h._md5.isValid() && (i->second._etag != h._md5))
+			continue;
+
+		CCopySource s;
+		s._path = i->first;
+		s._etag = i->second._etag;
+		result.push_back(s);
+	}
+	return result;
+}
+
+// small file without loose object : up to date when its newest pack entry
+// has the same finger print and crypto key
+BACKUP_ITEM_STATUS CBackupStatusUpdater::getPackedStatus(CAsset * p) const
+{
+	CPackEntry e;
+	if (!_packStore.find(p->getRelativePath(), e))
+		return BACKUP_ITEM_STATUS::TO_BE_PACKED;
+
+	const CHash h = p->getSrcHash();
+	const bool sameFingerPrint = _ctx._options->contentFingerPrint()
+		? ((e._size == h._len) && (e._md5 == h._md5))
+		: ((e._size == h._len) && (e._mtime == p->getLocalLastModifTime()));
+
+	const NMD5::CDigest cryptoKey = _ctx.crypted() ? _ctx._options->_cryptoKey : NMD5::CDigest();
+	return (sameFingerPrint && (e._cryptoKey == cryptoKey)) ? BACKUP_ITEM_STATUS::UP_TO_DATE : BACKUP_ITEM_STATUS::TO_BE_PACKED;
+}
+
 void CBackupStatusUpdater::run()
 {
 	CUploader uploader(_ctx);
@@ -423,19 +756,29 @@ void CBackupStatusUpdater::run()
 		CAsset * p = getNext(remoteExists);
 		if (p) {
 			assert( !p->isFolder());
-			if (!remoteExists)
+			if ((!remoteExists) && _packStore.packable(p->getSrcHash()._len))
+				p->setBackupStatus(getPackedStatus(p));
+
+			else if (!remoteExists)
 			{
-				p->setBackupStatus(BACKUP_ITEM_STATUS::TO_BE_CREATED);
+				const std::vector<CCopySource> sources = findCopySources(p);
+				if (sources.empty())
+					p->setBackupStatus(BACKUP_ITEM_STATUS::TO_BE_CREATED);
+
+				else {
+					p->setCopySources(sources);
+					p->setBackupStatus(BACKUP_ITEM_STATUS::TO_BE_COPIED);
+				}
 				
 			} else {
 			
 				bool sameFingerPrint( false );
-				if (_ctx._options->_forceComputeLocalMd5) {
+				if (_ctx._options->contentFingerPrint()) {
 					// compare md5
 					const CHash localH = p->getSrcHash();
 					const CHash remoteH= p->getDstHash();
 					assert( remoteH._computed && localH._computed );
-					sameFingerPrint= (localH == remoteH);
+					sameFingerPrint= localH._md5.isValid() && (localH == remoteH); // unknown : content changed
 					
 				} else {
 					// compare last modified date
@@ -461,12 +804,21 @@ void CBackupStatusUpdater::run()
 				} else // 'md5' or 'last modfied date' are differents
 					p->setBackupStatus(BACKUP_ITEM_STATUS::UPDATE_CONTENT_CHANGED);
 			}
+
+			// other link of a file : copied from the object of its first link.
+			// Not for a packable size : a new first link has no loose object,
+			// its pack is written later. Archived sizes are archived as well
+			const BACKUP_ITEM_STATUS s = p->getBackupStatus();
+			if (p->getLinkPrimary() && (!_packStore.packable(p->getSrcHash()._len)) && (
+				(s == BACKUP_ITEM_STATUS::TO_BE_CREATED) || (s == BACKUP_ITEM_STATUS::TO_BE_COPIED) ||
+				(s == BACKUP_ITEM_STATUS::UPDATE_CONTENT_CHANGED) || (s == BACKUP_ITEM_STATUS::UPDATE_PWD_CHANGED)))
+				p->setBackupStatus(BACKUP_ITEM_STATUS::TO_BE_LINKED);
 		
 			_ctx._todoQueue.add(p);
 			LOGD("{} {}", (int) p->getBackupStatus(), p->getRelativePath());
 		}
 		
-		if (_ctx.aborted())
+		if (_ctx.aborted() || _ctx.deadlineReached())
 			break;
 		
 		std::this_thread::sleep_for(std::chrono::milliseconds(1));
@@ -482,7 +834,7 @@ class CSynchronizer
 :	public CContextual
 {
 public:
-	CSynchronizer(CContext & context);
+	CSynchronizer(CContext & context, CPackStore & packStore, CArchiveUploader & archiver, CDeadline & deadline);
 	~CSynchronizer();
 
 	void start();
@@ -492,12 +844,33 @@ public:
 	uint64_t getUploadingFileCount() const { return _uploadingFileCount ; }
 	uint64_t getUploadedFileCount () const { return _uploadedFileCount ; }
 	uint64_t getTotalUploadedBytes() const { return _totalUploadedBytes; }
+	uint64_t getCopiedFileCount   () const { return _copiedFileCount   ; }
+	uint64_t getLinkedFileCount   () const { return _linkedFileCount   ; }
+	uint64_t getTotalDedupBytes   () const { return _totalDedupBytes   ; }
+
+	// end of run stragglers, once done : seconds from the first upload thread
+	// out of work to the last one, and idle seconds summed over the threads
+	double getTailSeconds() const;
+	double getTailIdleSeconds() const;
 
 private:
 	void run();
+	bool admits(const CAsset * p) const;
+	bool parkLink(CAsset * p);
+	void releaseLinks(const CAsset * pPrimary);
 
 private:
+	CPackStore & _packStore;
+	CArchiveUploader & _archiver;
+	CDeadline & _deadline;
 	std::vector<std::thread> _threads;
+	mutable std::mutex _endsMutex;
+	std::vector<std::chrono::steady_clock::time_point> _threadEnds;
+	std::mutex _linksMutex;
+	std::map<const CAsset*, std::vector<CAsset*>> _parkedLinks; // by first link
+	std::atomic<uint64_t> _copiedFileCount;
+	std::atomic<uint64_t> _linkedFileCount;
+	std::atomic<uint64_t> _totalDedupBytes;
 	std::atomic<uint64_t> _upToDateFileCount;
 	std::atomic<uint64_t> _uploadingFileCount;
 	std::atomic<uint64_t> _uploadedFileCount;
@@ -507,12 +880,18 @@ private:
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-CSynchronizer::CSynchronizer(CContext & ctx)
+CSynchronizer::CSynchronizer(CContext & ctx, CPackStore & packStore, CArchiveUploader & archiver, CDeadline & deadline)
 :	CContextual(ctx)
+,	_packStore(packStore)
+,	_archiver(archiver)
+,	_deadline(deadline)
+,	_copiedFileCount   (0)
+,	_linkedFileCount   (0)
+,	_totalDedupBytes   (0)
 ,	_upToDateFileCount (0)
 ,	_uploadingFileCount(0)
-,	_totalUploadedBytes(0)
 ,	_uploadedFileCount (0)
+,	_totalUploadedBytes(0)
 {
 }
 
@@ -530,6 +909,10 @@ void CSynchronizer::start()
 	_uploadingFileCount= 0;
 	_totalUploadedBytes= 0;
 	_uploadedFileCount = 0;
+	_copiedFileCount   = 0;
+	_linkedFileCount   = 0;
+	_totalDedupBytes   = 0;
+	_threadEnds.clear();
 
 	for (int i=0; i<_ctx._options->_numThreadUpload; ++i)
 		_threads.push_back( std::thread( &CSynchronizer::run, this) );
@@ -542,25 +925,122 @@ void CSynchronizer::waitDone()
 			t.join();
 }
 
+double CSynchronizer::getTailSeconds() const
+{
+	std::lock_guard<std::mutex> lock(_endsMutex);
+	if (_threadEnds.empty())
+		return 0;
+	const auto range = std::minmax_element(_threadEnds.begin(), _threadEnds.end());
+	return std::chrono::duration<double>(*range.second - *range.first).count();
+}
+
+double CSynchronizer::getTailIdleSeconds() const
+{
+	std::lock_guard<std::mutex> lock(_endsMutex);
+	if (_threadEnds.empty())
+		return 0;
+	const auto last = *std::max_element(_threadEnds.begin(), _threadEnds.end());
+	double idle(0);
+	for (const auto & t : _threadEnds)
+		idle += std::chrono::duration<double>(last - t).count();
+	return idle;
+}
+
 static std::string uploadLabel(BACKUP_ITEM_STATUS s)
 {
 	switch ( s ) {
 		case BACKUP_ITEM_STATUS::UPDATE_CONTENT_CHANGED: return "Uploading content changed";
 		case BACKUP_ITEM_STATUS::UPDATE_PWD_CHANGED: return "Uploading password changed";
 		case BACKUP_ITEM_STATUS::TO_BE_CREATED: return "Uploading creating";
+		case BACKUP_ITEM_STATUS::TO_BE_COPIED: return "Uploading creating (no copy source matched)";
+		case BACKUP_ITEM_STATUS::TO_BE_LINKED: return "Uploading creating (hard link copy failed)";
 		default: assert( false);
 	}
 	return "";
 }
 
+// --deadline : the file can be stored in time. Server side copies and packed
+// files are cheap, uploads are estimated from the measured throughput
+bool CSynchronizer::admits(const CAsset * p) const
+{
+	if (!_deadline.enabled())
+		return true;
+
+	switch ( p->getBackupStatus() )
+	{
+		case BACKUP_ITEM_STATUS::UP_TO_DATE:
+			return true;
+
+		case BACKUP_ITEM_STATUS::TO_BE_PACKED:
+		case BACKUP_ITEM_STATUS::TO_BE_LINKED:
+			return !_ctx.deadlineReached();
+
+		default:
+			return _archiver.accepts(p->getSrcHash()._len) ? !_ctx.deadlineReached() : _deadline.fits(p->getSrcHash()._len);
+	}
+}
+
+// other link of a file whose first link is not stored yet : out of the todo
+// queue until the first link is done with. Its read key and size are the
+// same as before, the queue would give it back at once
+bool CSynchronizer::parkLink(CAsset * p)
+{
+	const CAsset * pPrimary = p->getLinkPrimary();
+	std::lock_guard<std::mutex> lock(_linksMutex);
+	if (pPrimary->isStored())
+		return false;
+
+	// deferred meanwhile : the queue defers it as well
+	if (pPrimary->getBackupStatus() == BACKUP_ITEM_STATUS::IGNORED)
+		_ctx._todoQueue.add(p);
+	else
+		_parkedLinks[pPrimary].push_back(p);
+	return true;
+}
+
+// the first link is stored or deferred : its other links are queued again
+void CSynchronizer::releaseLinks(const CAsset * pPrimary)
+{
+	std::vector<CAsset*> links;
+	{
+		std::lock_guard<std::mutex> lock(_linksMutex);
+		const auto i = _parkedLinks.find(pPrimary);
+		if (i == _parkedLinks.end())
+			return;
+		links.swap(i->second);
+		_parkedLinks.erase(i);
+	}
+	for (auto p : links)
+		_ctx._todoQueue.add(p);
+}
+
 void CSynchronizer::run()
 {
 	CUploader uploader(_ctx);
+	CChunkedUploader chunkedUploader(_ctx);
 	CTQueue<CAsset> & todo = _ctx._todoQueue;
 
 	while ( (!todo.isEmpty()) || (!todo.done()) )
 	{
 		CAsset * p = todo.get();
+
+		// left for the next run, with the other links of a deferred file
+		if (p && ((!admits(p)) || ((p->getBackupStatus() == BACKUP_ITEM_STATUS::TO_BE_LINKED) && (p->getLinkPrimary()->getBackupStatus() == BACKUP_ITEM_STATUS::IGNORED)))) {
+			_deadline.defer(p);
+			_ctx._readCache.drop(p);
+			todo.release(p);
+			releaseLinks(p);
+			p = nullptr;
+		}
+
+		// other link of a file whose first link is not stored yet : later.
+		// Archived first links are only stored when their archive is sent
+		if (p && (p->getBackupStatus() == BACKUP_ITEM_STATUS::TO_BE_LINKED) && (!p->getLinkPrimary()->isStored()) &&
+			(!_archiver.accepts(p->getSrcHash()._len)) && parkLink(p)) {
+			todo.release(p);
+			p = nullptr;
+		}
+
 		if (p) {
 		
 			switch ( p->getBackupStatus() )
@@ -575,18 +1055,53 @@ void CSynchronizer::run()
 				case BACKUP_ITEM_STATUS::UP_TO_DATE:
 					LOGD("up to date '{}'", p->getRelativePath().string());
 					_upToDateFileCount++;
+					p->setStored(true);
 					break;
 			
+				case BACKUP_ITEM_STATUS::TO_BE_PACKED:
+					// stored, and counted, with its pack
+					LOGD("packing '{}'", p->getRelativePath().string());
+					if (_packStore.add(p) != CUploader::resOk)
+						_ctx.abort();
+					break;
+
+				case BACKUP_ITEM_STATUS::TO_BE_COPIED:
+					if (uploader.copy(p)) {
+						LOGD("copied server side '{}'", p->getRelativePath().string());
+						_copiedFileCount++;
+						p->setStored(true);
+						break;
+					}
+					// fall through : upload it
+
+				case BACKUP_ITEM_STATUS::TO_BE_LINKED:
+					if ((p->getBackupStatus() == BACKUP_ITEM_STATUS::TO_BE_LINKED) && (!_archiver.accepts(p->getSrcHash()._len)) && uploader.link(p)) {
+						LOGD("copied server side '{}' from its hard link '{}'", p->getRelativePath().string(), p->getLinkPrimary()->getRelativePath().string());
+						_linkedFileCount++;
+						p->setStored(true);
+						break;
+					}
+					// fall through : upload it
+
 				case BACKUP_ITEM_STATUS::UPDATE_CONTENT_CHANGED:
 				case BACKUP_ITEM_STATUS::UPDATE_PWD_CHANGED:
 				case BACKUP_ITEM_STATUS::TO_BE_CREATED: {
+					if (_archiver.accepts(p->getSrcHash()._len)) {
+						LOGD("{} '{}' (archive)", uploadLabel(p->getBackupStatus()), p->getRelativePath().string());
+						if (_archiver.add(p) != CUploader::resOk)
+							_ctx.abort();
+						break;
+					}
+
 					LOGD("{} '{}'", uploadLabel(p->getBackupStatus()), p->getRelativePath().string());
 					_uploadingFileCount ++;
-					CUploader::result_code r(uploader.upload(p));
+					const auto uploadStart = std::chrono::steady_clock::now();
+					const bool bChunked = _ctx._options->_chunked && (p->getSrcHash()._len >= chunkedFileSizeMin);
+					CUploader::result_code r(bChunked ? chunkedUploader.upload(p) : uploader.upload(p));
 					if ((r == CUploader::resRetry) && (!_ctx.aborted())) { // retry once if server internal error
 						std::this_thread::sleep_for(std::chrono::seconds(1));
 						LOGW("retrying uploading {}", p->getRelativePath().string());
-						r = uploader.upload(p);
+						r = bChunked ? chunkedUploader.upload(p) : uploader.upload(p);
 					}
 					
 					if (r != CUploader::resOk)
@@ -595,10 +1110,23 @@ void CSynchronizer::run()
 					else {
 						_uploadingFileCount --;
 						_uploadedFileCount++;
-						_totalUploadedBytes += uploader.uploadedByteCount();
+						p->setStored(true);
+						_totalUploadedBytes += bChunked ? chunkedUploader.uploadedByteCount() : uploader.uploadedByteCount();
+						_deadline.onUploaded(p->getSrcHash()._len, std::chrono::duration<double>(std::chrono::steady_clock::now() - uploadStart).count());
+						if (bChunked)
+							_totalDedupBytes += chunkedUploader.dedupByteCount();
 					}
 				} break;
 			}
+
+			// the md5 left unknown by the fast finger print, once uploaded
+			if (_ctx._options->_fastFingerPrint)
+				_ctx._fingerprintIndex.setMd5(p->getRelativePath(), p->getSrcHash()._len, p->getSrcHash()._md5);
+
+			// up to date or copied : the kept content was not needed
+			_ctx._readCache.drop(p);
+			todo.release(p);
+			releaseLinks(p);
 		}
 
 		if (_ctx.aborted())
@@ -607,6 +1135,10 @@ void CSynchronizer::run()
 		std::this_thread::sleep_for(std::chrono::milliseconds(1));
 	}
 	
+	{
+		std::lock_guard<std::mutex> lock(_endsMutex);
+		_threadEnds.push_back(std::chrono::steady_clock::now());
+	}
 	LOGD("{} DONE", __PRETTY_FUNCTION__);
 }
 
@@ -617,31 +1149,38 @@ class CBackupDeleter
 :	public CContextual
 {
 public:
-	CBackupDeleter(CContext & context, const CParser & parser, const CRemoteLs & remote);
+	CBackupDeleter(CContext & context, const CParser & parser, const CRemoteLs & remote, const CFolderSummaries & summaries);
 	~CBackupDeleter();
 
 	void start();
 	void waitDone();
 	uint64_t getDeletedFileCount() const { return _deletedFileCount; }
+	uint64_t getFailedFileCount() const { return _failedFileCount; }
 
 private:
 	void run();
-	CAsset * getNext(bool & remoteExists);
+	std::size_t getBulkDeleteLimit() const;
+	bool bulkDelete(std::vector<std::string>::const_iterator begin, std::vector<std::string>::const_iterator end);
+	void parallelDelete(std::vector<std::string>::const_iterator begin, std::vector<std::string>::const_iterator end);
 
 private:
 	const CParser   & _parser;
 	const CRemoteLs & _remote;
+	const CFolderSummaries & _summaries;
 	std::thread _thread;
 	std::atomic<uint64_t> _deletedFileCount;
+	std::atomic<uint64_t> _failedFileCount;
 };
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-CBackupDeleter::CBackupDeleter(CContext & ctx, const CParser & parser, const CRemoteLs & remote)
+CBackupDeleter::CBackupDeleter(CContext & ctx, const CParser & parser, const CRemoteLs & remote, const CFolderSummaries & summaries)
 :	CContextual(ctx)
 ,	_parser(parser)
 ,	_remote(remote)
+,	_summaries(summaries)
 ,	_deletedFileCount(0)
+,	_failedFileCount(0)
 {
 }
 
@@ -654,6 +1193,7 @@ void CBackupDeleter::start()
 {
 	assert(!_thread.joinable());
 	_deletedFileCount = 0;
+	_failedFileCount = 0;
 	_thread= std::thread( &CBackupDeleter::run, this);
 }
 
@@ -663,6 +1203,124 @@ void CBackupDeleter::waitDone()
 		_thread.join();
 }
 
+// max paths per bulk-delete request as advertised by the cluster /info
+// document. 0 when the bulk-delete middleware is not available
+std::size_t CBackupDeleter::getBulkDeleteLimit() const
+{
+	const std::string endpoint = _ctx._credentials.get().endpoint();
+	const std::string::size_type i = endpoint.find("/v1/");
+	if (i == std::string::npos)
+		return 0;
+
+	CRequest rq(_ctx._options->_curlVerbose);
+	rq.get(endpoint.substr(0, i) + "/info");
+	if (rq.getHttpResponseCode() != 200)
+		return 0;
+
+	jsonxx::Object info;
+	if ((!info.parse(rq.getResponse())) || (!info.has<jsonxx::Object>("bulk_delete")))
+		return 0;
+
+	const jsonxx::Object & bulk = info.get<jsonxx::Object>("bulk_delete");
+	std::size_t limit = bulkDeleteMaxPaths;
+	if (bulk.has<jsonxx::Number>("max_deletes_per_request"))
+		limit = std::min(limit, static_cast<std::size_t>(bulk.get<jsonxx::Number>("max_deletes_per_request")));
+	return limit;
+}
+
+// deletes [begin, end) with a single POST ?bulk-delete. Per object errors are
+// reported and counted. Returns false when the request itself failed
+bool CBackupDeleter::bulkDelete(std::vector<std::string>::const_iterator begin, std::vector<std::string>::const_iterator end)
+{
+	std::string body;
+	for (auto i = begin; i != end; ++i)
+		body += fmt::format("/{}/{}\n", _ctx._options->_dstContainer, *i);
+
+	CRequest rq(_ctx._options->_curlVerbose);
+	rq.setHeaders(_ctx._credentials.authHeaders());
+	rq.addHeader("Content-Type", "text/plain");
+	rq.addHeader("Accept", "application/json");
+	rq.setPostData(body);
+	const std::string url = fmt::format("{}?bulk-delete", _ctx._credentials.get().endpoint());
+	LOGD("bulk deleting {} backup(s)", std::distance(begin, end));
+	if ((rq.post(url) != CURLE_OK) || (rq.getHttpResponseCode() != 200))
+	{
+		LOGW("bulk delete failed [http response : {}]", rq.getHttpResponseCode());
+		return false;
+	}
+
+	// the middleware may send whitespaces to keep the connection alive
+	jsonxx::Object result;
+	if (!result.parse(boost::algorithm::trim_copy(rq.getResponse())))
+	{
+		LOGW("bulk delete : can't parse response '{}'", rq.getResponse());
+		return false;
+	}
+
+	// failed without telling which objects : the batch is deleted one by one
+	const bool bErrors = result.has<jsonxx::Array>("Errors") && (result.get<jsonxx::Array>("Errors").size() > 0);
+	if (result.has<jsonxx::String>("Response Status") && !boost::algorithm::starts_with(result.get<jsonxx::String>("Response Status"), "2")) {
+		LOGW("bulk delete : {}", result.get<jsonxx::String>("Response Status"));
+		if (!bErrors)
+			return false;
+	}
+
+	if (result.has<jsonxx::Number>("Number Deleted"))
+		_deletedFileCount += static_cast<uint64_t>(result.get<jsonxx::Number>("Number Deleted"));
+
+	if (result.has<jsonxx::Number>("Number Not Found") && (result.get<jsonxx::Number>("Number Not Found") > 0))
+		LOGD("bulk delete : {} backup(s) already deleted", result.get<jsonxx::Number>("Number Not Found"));
+
+	if (result.has<jsonxx::Array>("Errors"))
+	{
+		const jsonxx::Array & errors = result.get<jsonxx::Array>("Errors");
+		for (std::size_t i=0; i<errors.size(); ++i) {
+			if (!errors.has<jsonxx::Array>(i))
+				continue;
+			const jsonxx::Array & e = errors.get<jsonxx::Array>(i);
+			LOGE("Failed to delete '{}' [{}]",
+				e.has<jsonxx::String>(0) ? e.get<jsonxx::String>(0) : std::string("?"),
+				e.has<jsonxx::String>(1) ? e.get<jsonxx::String>(1) : std::string("?"));
+			_failedFileCount++;
+		}
+	}
+
+	return true;
+}
+
+// one DELETE per object, spread over the delete threads
+void CBackupDeleter::parallelDelete(std::vector<std::string>::const_iterator begin, std::vector<std::string>::const_iterator end)
+{
+	std::atomic<std::size_t> next(0);
+	const std::size_t count = std::distance(begin, end);
+
+	auto worker = [&]() {
+		CRequest rq(_ctx._options->_curlVerbose);
+		for (std::size_t i = next++; (i < count) && (!_ctx.aborted()); i = next++)
+		{
+			rq.setHeaders(_ctx._credentials.authHeaders());
+			const std::string url= fmt::format("{}/{}/{}", _ctx._credentials.get().endpoint(), _ctx._options->_dstContainer, *(begin + i));
+			LOGD("deleting backup '{}'", url);
+			rq.del(url);
+			switch (rq.getHttpResponseCode()) {
+				case 204: _deletedFileCount++; break;
+				case 404: break; // already gone
+				default :
+					LOGE("Failed to delete '{}' [http response : {}]", url, rq.getHttpResponseCode());
+					_failedFileCount++;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	const std::size_t threadCount = std::max(1, std::min<int>(_ctx._options->_numThreadDelete, count));
+	for (std::size_t i=1; i<threadCount; ++i)
+		threads.push_back( std::thread(worker) );
+	worker();
+	for (auto & t : threads)
+		t.join();
+}
+
 void CBackupDeleter::run()
 {
 	if (! _ctx._options->_removeNonExistingFiles )
@@ -672,28 +1330,34 @@ void CBackupDeleter::run()
 	const CAsset * pRoot( _parser.getRoot() );
 	assert( pRoot );
 	
-	CRequest rq(_ctx._options->_curlVerbose);
-	for (const auto & p : _remote.paths())
+	// escaped object names, relative to the container. Nothing was deleted
+	// under a tree that didn't change since a clean run
+	std::vector<std::string> objects;
+	const CCurl curl;
+	uint64_t skipped(0);
+	for (const auto & o : _remote.objects()) {
+		if (_summaries.enabled() && _summaries.inCleanTree(o.first))
+			skipped++;
+		else if (pRoot->find(o.first) == nullptr)
+			objects.push_back( (_ctx._options->_dstFolder / curl.escapePath(o.first)).string() );
+	}
+	if (skipped > 0)
+		LOGD("{} backup(s) in unchanged folders, not looked for deletion", skipped);
+
+	if (objects.empty()) {
+		LOGD("{} DONE", __PRETTY_FUNCTION__);
+		return;
+	}
+
+	const std::size_t bulkLimit = getBulkDeleteLimit();
+	LOGD("{} backup(s) to delete. bulk delete {}", objects.size(), bulkLimit ? fmt::format("by {}", bulkLimit) : "not available");
+
+	for (auto i = objects.cbegin(); (i != objects.cend()) && (!_ctx.aborted()); )
 	{
-		const CAsset * pLocal = pRoot->find(p);
-		if (pLocal == nullptr)
-		{
-			rq.addHeader(headerAuthToken, _ctx._cr.token());
-			const std::string url= fmt::format("{}/{}/{}", _ctx._cr.endpoint(), _ctx._options->_dstContainer, (_ctx._options->_dstFolder / rq.escapePath(p)).string() );
-			LOGD("deleting backup '{}'", url); //p.string());
-			rq.del(url);
-			if ( rq.getHttpResponseCode() != 204 )
-			{
-				LOGE("Failed to delete '{}' [http response : {}]", url, rq.getHttpResponseCode());
-				_ctx.abort();
-			}
-			else {
-				_deletedFileCount++;
-			}
-		}
-		
-		if (_ctx.aborted())
-			break;
+		const auto batchEnd = (bulkLimit == 0) ? objects.cend() : i + std::min<std::size_t>(bulkLimit, std::distance(i, objects.cend()));
+		if ((bulkLimit == 0) || !bulkDelete(i, batchEnd))
+			parallelDelete(i, batchEnd);
+		i = batchEnd;
 	}
 
 	LOGD("{} DONE", __PRETTY_FUNCTION__);
@@ -788,7 +1452,10 @@ void CLogNotifier::report()
 	LOGI("{} file(s) uploading", _synchronizer.getUploadingFileCount() );
 	LOGI("{} file(s) uploaded", _synchronizer.getUploadedFileCount() );
 	LOGI("{} uploaded", getMemSizeLib( _synchronizer.getTotalUploadedBytes() ) );
+	LOGI("{} file(s) copied server side", _synchronizer.getCopiedFileCount() );
 	LOGI("{} deleted", _deleter.getDeletedFileCount() );
+	if (_deleter.getFailedFileCount())
+		LOGW("{} deletion(s) failed", _deleter.getFailedFileCount() );
 }
 
 void CLogNotifier::run()
@@ -817,13 +1484,31 @@ int main(int argc, char ** argv)
 	if (!context.getCredentials())
 		return EXIT_FAILURE;
 
+	if (!context.openChunkIndex())
+		return EXIT_FAILURE;
+
+	if (!context.openFingerprintIndex())
+		return EXIT_FAILURE;
+
 	CRemoteLs remoteLs;
-	remoteLs.build( context._options->_dstFolder, context._cr );
-	LOGI("Remote file list build [ {} files ] ", remoteLs.paths().size());
-	
-	CMySourceParser srcParser(context); // fill local and remote queues
-	CLocalMd5Process md5LocalEngine(context); // consume local queue and feed localDone queue
-	CBackupStatusUpdater bStatusUpdater( context, remoteLs); // consume localMd5Done and feed todo queue
+	remoteLs.build( context._options->_dstContainer, context._options->_dstFolder, context._credentials );
+	LOGI("Remote file list build [ {} files ] ", remoteLs.objects().size());
+
+	CPackStore packStore(context);
+	if (packStore.enabled() && !packStore.load())
+		return EXIT_FAILURE;
+
+	// before the scan, which skips the unchanged folders
+	CFolderSummaries summaries(context, remoteLs, packStore);
+	summaries.load();
+
+	// files left by a run stopped at its deadline
+	CDeadline deadline(context);
+	deadline.load();
+
+	CMySourceParser srcParser(context, summaries, deadline, packStore); // fill local and remote queues
+	CLocalMd5Process md5LocalEngine(context, remoteLs); // consume local queue and feed localDone queue
+	CBackupStatusUpdater bStatusUpdater( context, remoteLs, packStore); // consume localMd5Done and feed todo queue
 	
 	srcParser.start();
 	md5LocalEngine.start(context._options->_numThreadLocalMd5);
@@ -832,31 +1517,100 @@ int main(int argc, char ** argv)
 	md5RemoteEngine.start(context._options->_numThreadRemoteMd5);
 	bStatusUpdater.start();
 	
-	CSynchronizer synchronizer(context);
-	CBackupDeleter deleter(context, srcParser, remoteLs);
+	CArchiveUploader archiver(context);
+	archiver.init();
+
+	CSynchronizer synchronizer(context, packStore, archiver, deadline);
+	CBackupDeleter deleter(context, srcParser, remoteLs, summaries);
 	CLogNotifier logNotifier(srcParser, synchronizer, deleter);
 	
 	synchronizer.start();
 	logNotifier.start();
 
 	srcParser.waitDone();
-	
-	// here, as the source parser ended,
-	// we can check for destination files to be deleted
-	deleter.start();
-	
 	synchronizer.waitDone();
+
+	// stopped by --deadline : the source tree may be partial, and some files
+	// are not stored
+	const bool bStopped = context.deadlineReached() || (deadline.deferredCount() > 0);
+	if (bStopped)
+		LOGI("Backup window over. Deletions and clean up are left for a complete run");
+
+	if (archiver.enabled() && !context.aborted() && (archiver.flush() != CUploader::resOk))
+		context.abort();
+
+	// the last pack is partial. Packs are only compacted after a complete
+	// run, when every live entry is known
+	if (packStore.enabled() && !context.aborted()) {
+		if (!packStore.flush())
+			context.abort();
+		else if (!bStopped)
+			packStore.collectGarbage(srcParser.getRoot());
+	}
+	
+	// here, as the source parser and the uploads ended, we can check for
+	// destination files to be deleted. Not before : they may be the source
+	// of a server side copy
+	if (!bStopped)
+		deleter.start();
 	deleter.waitDone();
 	logNotifier.waitDone();
 
+	// only a complete run is summed up
+	if (summaries.enabled() && !context.aborted() && !bStopped)
+		summaries.save(context._options->_removeNonExistingFiles && (deleter.getFailedFileCount() == 0));
+
+	if (!context.aborted())
+		deadline.save(!bStopped);
+
 	// print infos
 	
 	LOGI("------ Summary ------" );
 	LOGI("{} uptodate file(s)", synchronizer.getUpToDateFileCount() );
+	if (summaries.enabled())
+		LOGI("{} of them in {} unchanged folder(s), not checked one by one", summaries.skippedFileCount(), summaries.unchangedFolderCount() );
 	LOGI("{} file(s) uploading", synchronizer.getUploadingFileCount() );
 	LOGI("{} file(s) uploaded", synchronizer.getUploadedFileCount() );
+	if (deadline.resumedCount() > 0)
+		LOGI("{} file(s) left by the previous run, queued without being checked again", deadline.resumedCount() );
 	LOGI("{} uploaded", getMemSizeLib( synchronizer.getTotalUploadedBytes() ) );
+	LOGI("{} file(s) copied server side", synchronizer.getCopiedFileCount() );
+	if (deadline.deferredCount() > 0)
+		LOGI("{} file(s) deferred to the next run", deadline.deferredCount() );
+	if (synchronizer.getLinkedFileCount() > 0)
+		LOGI("{} hard link(s) copied server side from their first link", synchronizer.getLinkedFileCount() );
+	if (context._options->_numThreadUpload > 1)
+		LOGI("{:.1f} s of upload thread idle time at the end, {:.1f} s from the first thread out of work to the last one", synchronizer.getTailIdleSeconds(), synchronizer.getTailSeconds() );
+	if (context._shaper)
+		LOGI("{:.1f} s waited for the rate limits, summed over the threads", context._shaper->waitedSeconds() );
+	if (context._options->_chunked)
+		LOGI("{} already stored (chunks)", getMemSizeLib( synchronizer.getTotalDedupBytes() ) );
+	if (archiver.enabled()) {
+		LOGI("{} file(s) uploaded in archives", archiver.archivedFileCount() );
+		LOGI("{} file(s) uploaded one by one after an archive error", archiver.fallbackFileCount() );
+		LOGI("{} uploaded (archives)", getMemSizeLib( archiver.uploadedByteCount() ) );
+	}
+	const CFileReader::SStats io = CFileReader::stats();
+	LOGI("{} read from local files", getMemSizeLib( io._read ) );
+	if (io._holes > 0)
+		LOGI("{} of sparse file holes, not read", getMemSizeLib( io._holes ) );
+	if (context._options->_cacheMode == ECacheMode::direct)
+		LOGI("{} read with O_DIRECT", getMemSizeLib( io._direct ) );
+	if ((context._options->_cacheMode != ECacheMode::normal) && (io._direct < io._read))
+		LOGI("{} already in the page cache, {} dropped from it after use", getMemSizeLib( io._cached ), getMemSizeLib( io._dropped ) );
+	if (context._readCache.enabled())
+		LOGI("{} file(s) uploaded from the read cache ({})", context._readCache.hitCount(), getMemSizeLib( context._readCache.hitBytes() ) );
+	if (packStore.enabled()) {
+		LOGI("{} file(s) packed", packStore.packedFileCount() );
+		if (packStore.failedFileCount() > 0)
+			LOGW("{} file(s) not stored : pack upload failed", packStore.failedFileCount() );
+		LOGI("{} uploaded (packs)", getMemSizeLib( packStore.uploadedByteCount() ) );
+	}
 	LOGI("{} deleted", deleter.getDeletedFileCount() );
+	if (deleter.getFailedFileCount())
+		LOGW("{} deletion(s) failed", deleter.getFailedFileCount() );
+	if (CCurlLibrary::get())
+		LOGI("{} http request(s) using {} connection(s)", CCurlLibrary::get()->getRequestCount(), CCurlLibrary::get()->getConnectCount() );
 
 	return EXIT_SUCCESS;
 }
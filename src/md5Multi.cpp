@@ -0,0 +1,369 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "md5Multi.h"
+#include "common.h"
+#include <cassert>
+
+namespace NMD5 {
+
+	//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	constexpr std::size_t laneMax = 16;
+
+	// one row per md5 register, one column per lane
+	typedef uint32_t TStates[4][laneMax];
+	typedef void (*TKernel)(TStates & st, const uint8_t * const * p, std::size_t blocks);
+
+	// gcc vector extensions : the same code gives the scalar, sse2, avx2 and
+	// avx512 kernels. Helpers are always inlined, so they are compiled with
+	// the target of the kernel calling them
+	typedef uint32_t v4u  __attribute__((vector_size(16)));
+	typedef uint32_t v8u  __attribute__((vector_size(32)));
+	typedef uint32_t v16u __attribute__((vector_size(64)));
+
+#define MD5_INLINE inline __attribute__((always_inline))
+
+	// the helpers return vectors but are always inlined : no abi issue.
+	// Reported at the end of the file, so not popped
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+	template<int S, class V> MD5_INLINE V rotl(const V & x) { return (x << S) | (x >> (32 - S)); }
+
+	template<class V> MD5_INLINE V F(const V & b, const V & c, const V & d) { return d ^ (b & (c ^ d)); }
+	template<class V> MD5_INLINE V G(const V & b, const V & c, const V & d) { return c ^ (d & (b ^ c)); }
+	template<class V> MD5_INLINE V H(const V & b, const V & c, const V & d) { return b ^ c ^ d; }
+	template<class V> MD5_INLINE V I(const V & b, const V & c, const V & d) { return c ^ (b | ~d); }
+
+	template<int S, class V> MD5_INLINE void step(V & a, const V & b, const V & f, const V & x, uint32_t k)
+	{
+		a = b + rotl<S>(a + f + x + k);
+	}
+
+	template<class V, std::size_t L>
+	MD5_INLINE void md5Lanes(TStates & st, const uint8_t * const * p, std::size_t blocks)
+	{
+		static_assert(sizeof(V) == L * sizeof(uint32_t), "");
+
+		V a, b, c, d;
+		memcpy(&a, st[0], sizeof(V));
+		memcpy(&b, st[1], sizeof(V));
+		memcpy(&c, st[2], sizeof(V));
+		memcpy(&d, st[3], sizeof(V));
+
+		for (std::size_t blk = 0; blk < blocks; blk++)
+		{
+			// transpose : word i of every lane in x[i]
+			alignas(64) uint32_t w[16][L];
+			for (std::size_t l = 0; l < L; l++) {
+				uint32_t m[16];
+				memcpy(m, p[l] + blk * 64, 64);
+				for (int i = 0; i < 16; i++)
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+					w[i][l] = __builtin_bswap32(m[i]);
+#else
+					w[i][l] = m[i];
+#endif
+			}
+			V x[16];
+			memcpy(x, w, sizeof(x));
+
+			const V aa(a), bb(b), cc(c), dd(d);
+
+			step< 7>(a, b, F(b, c, d), x[ 0], 0xd76aa478); step<12>(d, a, F(a, b, c), x[ 1], 0xe8c7b756);
+			step<17>(c, d, F(d, a, b), x[ 2], 0x242070db); step<22>(b, c, F(c, d, a), x[ 3], 0xc1bdceee);
+			step< 7>(a, b, F(b, c, d), x[ 4], 0xf57c0faf); step<12>(d, a, F(a, b, c), x[ 5], 0x4787c62a);
+			step<17>(c, d, F(d, a, b), x[ 6], 0xa8304613); step<22>(b, c, F(c, d, a), x[ 7], 0xfd469501);
+			step< 7>(a, b, F(b, c, d), x[ 8], 0x698098d8); step<12>(d, a, F(a, b, c), x[ 9], 0x8b44f7af);
+			step<17>(c, d, F(d, a, b), x[10], 0xffff5bb1); step<22>(b, c, F(c, d, a), x[11], 0x895cd7be);
+			step< 7>(a, b, F(b, c, d), x[12], 0x6b901122); step<12>(d, a, F(a, b, c), x[13], 0xfd987193);
+			step<17>(c, d, F(d, a, b), x[14], 0xa679438e); step<22>(b, c, F(c, d, a), x[15], 0x49b40821);
+
+			step< 5>(a, b, G(b, c, d), x[ 1], 0xf61e2562); step< 9>(d, a, G(a, b, c), x[ 6], 0xc040b340);
+			step<14>(c, d, G(d, a, b), x[11], 0x265e5a51); step<20>(b, c, G(c, d, a), x[ 0], 0xe9b6c7aa);
+			step< 5>(a, b, G(b, c, d), x[ 5], 0xd62f105d); step< 9>(d, a, G(a, b, c), x[10], 0x02441453);
+			step<14>(c, d, G(d, a, b), x[15], 0xd8a1e681); step<20>(b, c, G(c, d, a), x[ 4], 0xe7d3fbc8);
+			step< 5>(a, b, G(b, c, d), x[ 9], 0x21e1cde6); step< 9>(d, a, G(a, b, c), x[14], 0xc33707d6);
+			step<14>(c, d, G(d, a, b), x[ 3], 0xf4d50d87); step<20>(b, c, G(c, d, a), x[ 8], 0x455a14ed);
+			step< 5>(a, b, G(b, c, d), x[13], 0xa9e3e905); step< 9>(d, a, G(a, b, c), x[ 2], 0xfcefa3f8);
+			step<14>(c, d, G(d, a, b), x[ 7], 0x676f02d9); step<20>(b, c, G(c, d, a), x[12], 0x8d2a4c8a);
+
+			step< 4>(a, b, H(b, c, d), x[ 5], 0xfffa3942); step<11>(d, a, H(a, b, c), x[ 8], 0x8771f681);
+			step<16>(c, d, H(d, a, b), x[11], 0x6d9d6122); step<23>(b, c, H(c, d, a), x[14], 0xfde5380c);
+			step< 4>(a, b, H(b, c, d), x[ 1], 0xa4beea44); step<11>(d, a, H(a, b, c), x[ 4], 0x4bdecfa9);
+			step<16>(c, d, H(d, a, b), x[ 7], 0xf6bb4b60); step<23>(b, c, H(c, d, a), x[10], 0xbebfbc70);
+			step< 4>(a, b, H(b, c, d), x[13], 0x289b7ec6); step<11>(d, a, H(a, b, c), x[ 0], 0xeaa127fa);
+			step<16>(c, d, H(d, a, b), x[ 3], 0xd4ef3085); step<23>(b, c, H(c, d, a), x[ 6], 0x04881d05);
+			step< 4>(a, b, H(b, c, d), x[ 9], 0xd9d4d039); step<11>(d, a, H(a, b, c), x[12], 0xe6db99e5);
+			step<16>(c, d, H(d, a, b), x[15], 0x1fa27cf8); step<23>(b, c, H(c, d, a), x[ 2], 0xc4ac5665);
+
+			step< 6>(a, b, I(b, c, d), x[ 0], 0xf4292244); step<10>(d, a, I(a, b, c), x[ 7], 0x432aff97);
+			step<15>(c, d, I(d, a, b), x[14], 0xab9423a7); step<21>(b, c, I(c, d, a), x[ 5], 0xfc93a039);
+			step< 6>(a, b, I(b, c, d), x[12], 0x655b59c3); step<10>(d, a, I(a, b, c), x[ 3], 0x8f0ccc92);
+			step<15>(c, d, I(d, a, b), x[10], 0xffeff47d); step<21>(b, c, I(c, d, a), x[ 1], 0x85845dd1);
+			step< 6>(a, b, I(b, c, d), x[ 8], 0x6fa87e4f); step<10>(d, a, I(a, b, c), x[15], 0xfe2ce6e0);
+			step<15>(c, d, I(d, a, b), x[ 6], 0xa3014314); step<21>(b, c, I(c, d, a), x[13], 0x4e0811a1);
+			step< 6>(a, b, I(b, c, d), x[ 4], 0xf7537e82); step<10>(d, a, I(a, b, c), x[11], 0xbd3af235);
+			step<15>(c, d, I(d, a, b), x[ 2], 0x2ad7d2bb); step<21>(b, c, I(c, d, a), x[ 9], 0xeb86d391);
+
+			a += aa; b += bb; c += cc; d += dd;
+		}
+
+		memcpy(st[0], &a, sizeof(V));
+		memcpy(st[1], &b, sizeof(V));
+		memcpy(st[2], &c, sizeof(V));
+		memcpy(st[3], &d, sizeof(V));
+	}
+
+#undef MD5_INLINE
+
+	static void kernelScalar(TStates & st, const uint8_t * const * p, std::size_t blocks) { md5Lanes<uint32_t, 1>(st, p, blocks); }
+
+#if defined(__x86_64__) || defined(__i386__)
+	__attribute__((target("sse2")))    static void kernelSse2  (TStates & st, const uint8_t * const * p, std::size_t blocks) { md5Lanes<v4u ,  4>(st, p, blocks); }
+	__attribute__((target("avx2")))    static void kernelAvx2  (TStates & st, const uint8_t * const * p, std::size_t blocks) { md5Lanes<v8u ,  8>(st, p, blocks); }
+	__attribute__((target("avx512f"))) static void kernelAvx512(TStates & st, const uint8_t * const * p, std::size_t blocks) { md5Lanes<v16u, 16>(st, p, blocks); }
+#endif
+
+	static TKernel getKernel(EEngine e)
+	{
+		switch (e) {
+#if defined(__x86_64__) || defined(__i386__)
+		case EEngine::sse2   : return kernelSse2;
+		case EEngine::avx2   : return kernelAvx2;
+		case EEngine::avx512 : return kernelAvx512;
+#endif
+		default              : return kernelScalar;
+		}
+	}
+
+	//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	EEngine CMultiComputer::bestEngine()
+	{
+		static const EEngine best = supportedEngines().back();
+		return best;
+	}
+
+	std::vector<EEngine> CMultiComputer::supportedEngines()
+	{
+		std::vector<EEngine> res { EEngine::scalar };
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("sse2"))
+			res.push_back(EEngine::sse2);
+		if (__builtin_cpu_supports("avx2"))
+			res.push_back(EEngine::avx2);
+		if (__builtin_cpu_supports("avx512f"))
+			res.push_back(EEngine::avx512);
+#endif
+		return res;
+	}
+
+	const char * CMultiComputer::engineName(EEngine e)
+	{
+		switch (e) {
+		case EEngine::scalar : return "scalar";
+		case EEngine::sse2   : return "sse2";
+		case EEngine::avx2   : return "avx2";
+		case EEngine::avx512 : return "avx512";
+		}
+		return "?";
+	}
+
+	std::size_t CMultiComputer::laneCount(EEngine e)
+	{
+		switch (e) {
+		case EEngine::scalar : return 1;
+		case EEngine::sse2   : return 4;
+		case EEngine::avx2   : return 8;
+		case EEngine::avx512 : return 16;
+		}
+		return 1;
+	}
+
+	//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	CMultiComputer::CMultiComputer(EEngine e)
+	:	_engine(e)
+	,	_lanes(laneCount(e))
+	{
+		for (auto & l : _lanes)
+			l._initialised = false;
+	}
+
+	// lane alone, for the blocks that can't be hashed in lockstep
+	static void hashLane(uint32_t * state, const uint8_t * p, std::size_t blocks)
+	{
+		TStates st;
+		for (int r = 0; r < 4; r++)
+			st[r][0] = state[r];
+		kernelScalar(st, &p, blocks);
+		for (int r = 0; r < 4; r++)
+			state[r] = st[r][0];
+	}
+
+	void CMultiComputer::init(std::size_t lane)
+	{
+		SLane & l = _lanes[lane];
+		l._initialised = true;
+		l._state[0] = 0x67452301;
+		l._state[1] = 0xefcdab89;
+		l._state[2] = 0x98badcfe;
+		l._state[3] = 0x10325476;
+		l._len      = 0;
+		l._p        = nullptr;
+		l._n        = 0;
+		l._tailLen  = 0;
+	}
+
+	void CMultiComputer::feed(std::size_t lane, const void * src, std::size_t len)
+	{
+		SLane & l = _lanes[lane];
+		assert(l._initialised);
+
+		// data fed twice without update
+		if (l._n) {
+			const std::size_t blocks = l._n / 64;
+			hashLane(l._state, l._p, blocks);
+			l._tailLen = l._n - blocks * 64;
+			memcpy(l._tail, l._p + blocks * 64, l._tailLen);
+			l._n = 0;
+		}
+
+		const uint8_t * p = reinterpret_cast<const uint8_t*>(src);
+		l._len += len;
+
+		// complete the partial block of the previous feed first
+		if (l._tailLen) {
+			const std::size_t k = std::min(len, 64 - l._tailLen);
+			memcpy(l._tail + l._tailLen, p, k);
+			l._tailLen += k;
+			p   += k;
+			len -= k;
+			if (l._tailLen < 64)
+				return;
+			hashLane(l._state, l._tail, 1);
+			l._tailLen = 0;
+		}
+
+		l._p = p;
+		l._n = len;
+	}
+
+	void CMultiComputer::update()
+	{
+		const TKernel kernel = getKernel(_engine);
+		const std::size_t laneCount = _lanes.size();
+
+		for (;;)
+		{
+			std::size_t blocks(std::numeric_limits<std::size_t>::max());
+			const uint8_t * any(nullptr);
+			for (const auto & l : _lanes)
+				if (l._initialised && (l._n >= 64)) {
+					blocks = std::min(blocks, l._n / 64);
+					any = l._p;
+				}
+			if (any == nullptr)
+				break;
+
+			// idle lanes hash a copy of an active one, their result is dropped
+			alignas(64) TStates st;
+			const uint8_t * p[laneMax];
+			for (std::size_t i = 0; i < laneCount; i++) {
+				const SLane & l = _lanes[i];
+				const bool bActive = l._initialised && (l._n >= 64);
+				for (int r = 0; r < 4; r++)
+					st[r][i] = l._state[r];
+				p[i] = bActive ? l._p : any;
+			}
+
+			kernel(st, p, blocks);
+
+			for (std::size_t i = 0; i < laneCount; i++) {
+				SLane & l = _lanes[i];
+				if (l._initialised && (l._n >= 64)) {
+					for (int r = 0; r < 4; r++)
+						l._state[r] = st[r][i];
+					l._p += blocks * 64;
+					l._n -= blocks * 64;
+				}
+			}
+		}
+
+		for (auto & l : _lanes)
+			if (l._n) {
+				memcpy(l._tail, l._p, l._n);
+				l._tailLen = l._n;
+				l._n = 0;
+			}
+	}
+
+	CDigest CMultiComputer::done(std::size_t lane)
+	{
+		SLane & l = _lanes[lane];
+		assert(l._initialised);
+
+		if (l._n)
+			feed(lane, nullptr, 0); // hashes the pending blocks
+
+		// 0x80, zeros, then the bit length : one or two blocks
+		uint8_t pad[128] = { 0 };
+		memcpy(pad, l._tail, l._tailLen);
+		pad[l._tailLen] = 0x80;
+		const std::size_t padLen = (l._tailLen + 9 <= 64) ? 64 : 128;
+		const uint64_t bitLen = l._len * 8;
+		for (int i = 0; i < 8; i++)
+			pad[padLen - 8 + i] = static_cast<uint8_t>(bitLen >> (8 * i));
+		hashLane(l._state, pad, padLen / 64);
+
+		CDigest res;
+		for (int r = 0; r < 4; r++)
+			for (int i = 0; i < 4; i++)
+				res.data()[4 * r + i] = static_cast<uint8_t>(l._state[r] >> (8 * i));
+
+		l._initialised = false;
+		return res;
+	}
+
+	//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	void computeMd5s(CDigest * res, const void * const * data, const std::size_t * len, std::size_t count)
+	{
+		CMultiComputer c;
+		for (std::size_t first = 0; first < count; first += c.laneCount())
+		{
+			const std::size_t n = std::min(c.laneCount(), count - first);
+			for (std::size_t i = 0; i < n; i++) {
+				c.init(i);
+				c.feed(i, data[first + i], len[first + i]);
+			}
+			c.update();
+			for (std::size_t i = 0; i < n; i++)
+				res[first + i] = c.done(i);
+		}
+	}
+
+}
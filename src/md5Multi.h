@@ -0,0 +1,93 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#pragma once
+
+#include "md5.h"
+
+namespace NMD5
+{
+	//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// md5 is serial within a stream. CMultiComputer hashes several independent
+	// streams at once, one per simd lane : 4 with sse2, 8 with avx2, 16 with
+	// avx512. The engine is chosen at runtime from the cpu features
+	enum class EEngine
+	{
+		scalar,
+		sse2,
+		avx2,
+		avx512
+	};
+
+	//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	class CMultiComputer
+	{
+	public:
+		static EEngine bestEngine();
+		static std::vector<EEngine> supportedEngines();
+		static const char * engineName(EEngine e);
+		static std::size_t laneCount(EEngine e);
+
+	public:
+		CMultiComputer(EEngine e = bestEngine());
+
+	public:
+		EEngine engine() const { return _engine; }
+		std::size_t laneCount() const { return laneCount(_engine); }
+
+		void init(std::size_t lane);
+		bool isInitialised(std::size_t lane) const { return _lanes[lane]._initialised; }
+
+		// no copy : the data must stay valid until the next update() or done()
+		void feed(std::size_t lane, const void * src, std::size_t len);
+
+		// hashes the full blocks fed to all the lanes, in lockstep
+		void update();
+
+		CDigest done(std::size_t lane);
+
+	private:
+		struct SLane
+		{
+			bool            _initialised;
+			uint32_t        _state[4];
+			uint64_t        _len;
+			const uint8_t * _p;
+			std::size_t     _n;
+			uint8_t         _tail[64];
+			std::size_t     _tailLen;
+		};
+
+	private:
+		EEngine            _engine;
+		std::vector<SLane> _lanes;
+	};
+
+	//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// md5 of 'count' buffers at once
+	void computeMd5s(CDigest * res, const void * const * data, const std::size_t * len, std::size_t count);
+}
@@ -27,6 +27,8 @@
 #include "options.h"
 #include "common.h"
 #include "crypto.h"
+#include "md5Multi.h"
+#include "shaper.h"
 
 //* ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -46,16 +48,41 @@ COptions::COptions()
 ,	_argv(nullptr)
 ,	_hubicLogin()
 ,	_hubicPassword()
+,	_cacheCredentials(true)
+,	_stateDir()
+,	_deadline(0)
 ,	_srcFolder()
 ,	_excludes()
 ,	_dstContainer()
 ,	_dstFolder()
 ,	_cryptoPassword()
+,	_cryptFormat(ECryptFormat::cbc)
 ,	_removeNonExistingFiles(false)
 ,	_forceComputeLocalMd5(false)
+,	_fastFingerPrint(false)
+,	_http2(false)
+,	_chunked(false)
+,	_packSmallFilesMax(0)
+,	_archiveSmallFilesMax(0)
+,	_readCacheMax(0)
+,	_ioEngine(CFileReader::bestEngine())
+,	_ioDepth(8)
+,	_cacheMode(ECacheMode::normal)
+,	_readOrder(EReadOrder::scan)
+,	_bRotational(false)
+,	_deviceReaders(-1)
+,	_folderSummaries(false)
+,	_uploadOrder(EUploadOrder::scan)
+,	_uploadParts(1)
+,	_compressLevel(0)
+,	_numThreadDelete(4)
+,	_uploadRate()
+,	_requestRate()
+,	_rateFile()
 ,	_numThreadUpload   (1)
 ,	_numThreadLocalMd5 (1)
 ,	_numThreadRemoteMd5(1)
+,	_numThreadCrypt    (1)
 ,	_authToken()
 ,	_authEndpoint()
 ,	_curlVerbose(false)
@@ -68,18 +95,42 @@ enum class EOptionFlag {
 		Help
 	,	Version
 	,	logLevel
+	,	stateDir
+	,	deadline
 	
 	,	hubicLogin
 	,	hubicPwd
+	,	noCredentialsCache
 	
 	,	srcFolder
 	,	excludes
 	,	fingerPrintMd5
+	,	fingerPrintFast
+	,	readCache
+	,	ioEngine
+	,	ioDepth
+	,	cacheNeutral
+	,	readOrder
+	,	deviceReaders
+	,	folderSummaries
 	,	dstContainer
 	,	dstFolder
 
 	,	cryptPassword
+	,	cryptFormat
 	,	removeNonExistingFiles
+	,	deleteThreads
+	,	chunked
+	,	packSmallFiles
+	,	archiveSmallFiles
+	,	compress
+	,	uploadOrder
+	,	uploadParts
+
+	,	http2
+	,	uploadRate
+	,	requestRate
+	,	rateFile
 };
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -89,6 +140,7 @@ enum class EOptionGroup {
 	,	auth
 	,	source
 	,	destination
+	,	network
 };
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -99,6 +151,7 @@ static const std::map<EOptionGroup, std::string> _g {
 	,	{ EOptionGroup::auth       , "auth" }
 	,	{ EOptionGroup::source     , "source" }
 	,	{ EOptionGroup::destination, "destination" }
+	,	{ EOptionGroup::network    , "network" }
 };
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -153,19 +206,43 @@ static const std::map<EOptionFlag, SOption> _o {
 		{EOptionFlag::Help         , { EOptionGroup::general    , "help"          , "this message"         , "h" }}
 	,	{EOptionFlag::Version      , { EOptionGroup::general    , "version"       , "display version infos", "v" }}
 	,	{EOptionFlag::logLevel     , { EOptionGroup::general    , "loglevel"      , "select the log level. (" + getSeverityList() + ")"  }}
+	,	{EOptionFlag::stateDir     , { EOptionGroup::general    , "state-dir"     , "folder where local state (credentials cache, indexes) is kept" }}
+	,	{EOptionFlag::deadline     , { EOptionGroup::general    , "deadline"      , "end of the backup window : HH:MM (local time) or a duration (90m, 2h). Uploads that can't end in time are left for the next run" }}
 	
 	,	{EOptionFlag::hubicLogin   , { EOptionGroup::auth       , "login"         , "hubic login"    , "l"}}
 	,	{EOptionFlag::hubicPwd     , { EOptionGroup::auth       , "pwd"           , "hubic password" , "p"}}
+	,	{EOptionFlag::noCredentialsCache, { EOptionGroup::auth  , "no-credentials-cache", "always authenticate. Don't reuse credentials from the previous run" }}
 	
 	,	{EOptionFlag::srcFolder    , { EOptionGroup::source     , "src"           , "source folder", "i" }}
 	,	{EOptionFlag::excludes     , { EOptionGroup::source     , "excludes"      , "optional exclude file list path", "x" }}
 	,	{EOptionFlag::fingerPrintMd5, { EOptionGroup::source     , "fingerprint-md5"      , "force local md5 computation to compare with destination file. CPU expansive" }}
+	,	{EOptionFlag::fingerPrintFast, { EOptionGroup::source    , "fingerprint-fast"     , "compare file contents by a fast xxh64 hash kept in the state folder. md5 is only computed for new or changed files" }}
+	,	{EOptionFlag::readCache    , { EOptionGroup::source     , "read-cache"           , "memory, in bytes, keeping the content of the changed files read by the md5 pass, so they are uploaded without a second read. 0 disables it" }}
+	,	{EOptionFlag::ioEngine     , { EOptionGroup::source     , "io-engine"            , "how files are read : auto, sync (blocking reads), threads (pread workers) or uring (io_uring)" }}
+	,	{EOptionFlag::ioDepth      , { EOptionGroup::source     , "io-depth"             , "256 Ko reads kept in flight by each reading thread, across the files it reads" }}
+	,	{EOptionFlag::cacheNeutral , { EOptionGroup::source     , "cache-neutral"        , "leave the page cache as it was. off, fadvise (drop the pages read for the backup) or direct (O_DIRECT reads when the filesystem allows it)" }}
+	,	{EOptionFlag::readOrder    , { EOptionGroup::source     , "read-order"           , "order of the file reads : scan (directory order), inode, extent (physical place) or auto (extent on a spinning disk, else scan)" }}
+	,	{EOptionFlag::deviceReaders, { EOptionGroup::source     , "device-readers"       , "files read at once from a same device by the hashing threads, and by the upload threads. A number, 0 for no limit, or auto (2 on a spinning disk, else no limit)" }}
+	,	{EOptionFlag::folderSummaries, { EOptionGroup::source   , "folder-summaries"     , "keep a digest of each folder, locally and in the container. The files of an unchanged folder are not checked one by one. Needs the last modification date finger print" }}
 	
 	,	{EOptionFlag::dstContainer , { EOptionGroup::destination, "container"     , "destination hubic container", "c" }}
 	,	{EOptionFlag::dstFolder    , { EOptionGroup::destination, "dst"           , "destination folder", "o" }}
 	,	{EOptionFlag::cryptPassword, { EOptionGroup::destination, "crypt-password", "optional crypto password", "k" }}
+	,	{EOptionFlag::cryptFormat  , { EOptionGroup::destination, "crypt-format"  , "cbc : aes-256-cbc, openssl enc compatible. gcm : aes-256-gcm by 1 Mo chunks, encrypted by several threads" }}
 
 	,	{EOptionFlag::removeNonExistingFiles, { EOptionGroup::destination, "del-non-existing", "allow deleting non existing backup files", "d" }}
+	,	{EOptionFlag::chunked      , { EOptionGroup::destination, "chunked"       , "store files of 1 Mo or more as deduplicated content defined chunks" }}
+	,	{EOptionFlag::packSmallFiles, { EOptionGroup::destination, "pack-small-files", "append new files smaller than this size, in bytes, to 64 Mo pack objects. 0 disables packing" }}
+	,	{EOptionFlag::archiveSmallFiles, { EOptionGroup::destination, "archive-small-files", "upload files smaller than this size, in bytes, by tar batches expanded server side. 0 disables it" }}
+	,	{EOptionFlag::compress     , { EOptionGroup::destination, "compress"      , "gzip level [1..9] of the contents before encryption. Files that don't compress are stored as is. 0 disables it" }}
+	,	{EOptionFlag::uploadOrder  , { EOptionGroup::destination, "upload-order"  , "order of the uploads : scan (as files are checked), largest (first, so the upload threads end together), smallest (first, for the file count) or newest (most recently modified first)" }}
+	,	{EOptionFlag::uploadParts  , { EOptionGroup::destination, "upload-parts"  , "with --chunked, chunks of a same file stored at once by each upload thread" }}
+	,	{EOptionFlag::deleteThreads, { EOptionGroup::destination, "delete-threads", "parallel DELETE requests when the server has no bulk-delete support" }}
+
+	,	{EOptionFlag::http2        , { EOptionGroup::network    , "http2"         , "use HTTP/2 when the server and libcurl (8.1 or later) support it. Metadata requests and small uploads are multiplexed" }}
+	,	{EOptionFlag::uploadRate   , { EOptionGroup::network    , "upload-rate"   , "max bytes sent by second, for all the threads. K, M or G suffix. Comma separated HH:MM-HH:MM=rate entries limit a time of the day, e.g. 08:00-19:00=2M,20M" }}
+	,	{EOptionFlag::requestRate  , { EOptionGroup::network    , "request-rate"  , "max requests started by second, for all the threads. Same syntax as --upload-rate" }}
+	,	{EOptionFlag::rateFile     , { EOptionGroup::network    , "rate-file"     , "file changing the rates while running. 'upload <rate>' and 'requests <rate>' lines, read again when the file changes" }}
 	
 };
 
@@ -183,6 +260,12 @@ public:
 	
 };
 
+static std::string getDefaultStateDir()
+{
+	const char * home = getenv("HOME");
+	return (bf::path(home ? home : ".") / ".hubic-backup").string();
+}
+
 static po::value_semantic* getDefaultValue(EOptionFlag f)
 {
 	static COptionsPriv _p;
@@ -190,17 +273,41 @@ static po::value_semantic* getDefaultValue(EOptionFlag f)
 		case EOptionFlag::Help         : break;
 		case EOptionFlag::Version      : break;
 		case EOptionFlag::logLevel     : return po::value<std::string>()->default_value(spdlog::level::to_str( LOGGER->level() ));
+		case EOptionFlag::stateDir     : return po::value<std::string>()->default_value(getDefaultStateDir());
+		case EOptionFlag::deadline     : return po::value<std::string>();
 
 		case EOptionFlag::hubicLogin   : return po::value<std::string>();
 		case EOptionFlag::hubicPwd     : return po::value<std::string>();
+		case EOptionFlag::noCredentialsCache: break;
 		case EOptionFlag::srcFolder    : return po::value<std::string>();
 		case EOptionFlag::excludes     : return po::value<std::string>();
 		case EOptionFlag::fingerPrintMd5: break;
+		case EOptionFlag::fingerPrintFast: break;
+		case EOptionFlag::readCache    : return po::value<uint64_t>()->default_value(_p._readCacheMax);
+		case EOptionFlag::ioEngine     : return po::value<std::string>()->default_value("auto");
+		case EOptionFlag::ioDepth      : return po::value<int>()->default_value(static_cast<int>(_p._ioDepth));
+		case EOptionFlag::cacheNeutral : return po::value<std::string>()->default_value("off");
+		case EOptionFlag::readOrder    : return po::value<std::string>()->default_value("auto");
+		case EOptionFlag::deviceReaders: return po::value<std::string>()->default_value("auto");
+		case EOptionFlag::folderSummaries: break;
 		case EOptionFlag::dstContainer : return po::value<std::string>()->default_value("default");
 		case EOptionFlag::dstFolder    : return po::value<std::string>();
 
 		case EOptionFlag::removeNonExistingFiles: break;
+		case EOptionFlag::chunked      : break;
+		case EOptionFlag::packSmallFiles: return po::value<uint64_t>()->default_value(_p._packSmallFilesMax);
+		case EOptionFlag::archiveSmallFiles: return po::value<uint64_t>()->default_value(_p._archiveSmallFilesMax);
+		case EOptionFlag::compress     : return po::value<int>()->default_value(_p._compressLevel);
+		case EOptionFlag::uploadOrder  : return po::value<std::string>()->default_value("scan");
+		case EOptionFlag::uploadParts  : return po::value<int>()->default_value(_p._uploadParts);
+		case EOptionFlag::deleteThreads: return po::value<int>()->default_value(_p._numThreadDelete);
 		case EOptionFlag::cryptPassword: return po::value<std::string>();
+		case EOptionFlag::cryptFormat  : return po::value<std::string>()->default_value("cbc");
+
+		case EOptionFlag::http2        : break;
+		case EOptionFlag::uploadRate   : return po::value<std::string>();
+		case EOptionFlag::requestRate  : return po::value<std::string>();
+		case EOptionFlag::rateFile     : return po::value<std::string>();
 	};
 	return new po::untyped_value(true);
 }
@@ -237,6 +344,40 @@ static void loadExcludes(std::set<std::string> & x, const bf::path & ePath)
 
 //* ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// HH:MM, the next one in local time, or a duration : 45s, 90m, 2h
+static bool parseDeadline(const std::string & s, std::time_t & deadline)
+{
+	const std::time_t now = std::time(nullptr);
+	if ((s.size() == 5) && (s[2] == ':')) {
+		const std::string h = s.substr(0, 2), m = s.substr(3);
+		if (!std::all_of(h.begin(), h.end(), ::isdigit) || !std::all_of(m.begin(), m.end(), ::isdigit) || (std::stoi(h) > 23) || (std::stoi(m) > 59))
+			return false;
+
+		std::tm t;
+		localtime_r(&now, &t);
+		t.tm_hour = std::stoi(h);
+		t.tm_min  = std::stoi(m);
+		t.tm_sec  = 0;
+		t.tm_isdst= -1;
+		deadline = std::mktime(&t);
+		if (deadline <= now) {
+			t.tm_mday++;
+			t.tm_isdst= -1;
+			deadline = std::mktime(&t);
+		}
+		return true;
+	}
+
+	const std::string n = s.empty() ? s : s.substr(0, s.size() - 1);
+	const char unit = s.empty() ? 0 : s.back();
+	const int factor = (unit == 's') ? 1 : ((unit == 'm') ? 60 : ((unit == 'h') ? 3600 : 0));
+	if ((factor == 0) || n.empty() || (n.size() > 6) || !std::all_of(n.begin(), n.end(), ::isdigit) || (std::stoi(n) == 0))
+		return false;
+
+	deadline = now + std::stoi(n) * factor;
+	return true;
+}
+
 #define CHECK_MANDATORY_ARG( a ) if (!exists( (a) )) throw std::logic_error(fmt::format("miss mandatory arg --{}", _o.at( (a) )._key));
 
 static std::string trimRightSlash( const std::string & src)
@@ -315,6 +456,12 @@ bool COptionsPriv::parse(int ac, char** av)
 		if (exists(EOptionFlag::logLevel))
 			setLogSeverity(at(EOptionFlag::logLevel).as<std::string>());
 
+		_stateDir = at(EOptionFlag::stateDir).as<std::string>();
+		_cacheCredentials = !exists(EOptionFlag::noCredentialsCache);
+
+		if (exists(EOptionFlag::deadline) && !parseDeadline(at(EOptionFlag::deadline).as<std::string>(), _deadline))
+			throw std::logic_error(fmt::format("invalid --{} value : {}", _o.at(EOptionFlag::deadline)._key, at(EOptionFlag::deadline).as<std::string>()));
+
 		if (!exists(EOptionFlag::hubicLogin)) {
 		
 				if (count("auth-token") && count("auth-endpoint")) {
@@ -354,8 +501,110 @@ bool COptionsPriv::parse(int ac, char** av)
 			_cryptoKey = getCryptoKey(_cryptoPassword);
 		}
 
+		const std::string cryptFormat = at(EOptionFlag::cryptFormat).as<std::string>();
+		if (cryptFormat == "gcm")
+			_cryptFormat = ECryptFormat::gcm;
+		else if (cryptFormat != "cbc")
+			throw std::logic_error(fmt::format("invalid --{} value : {}", _o.at(EOptionFlag::cryptFormat)._key, cryptFormat));
+
 		_removeNonExistingFiles = (exists( EOptionFlag::removeNonExistingFiles));
 		_forceComputeLocalMd5   = (exists( EOptionFlag::fingerPrintMd5));
+		_fastFingerPrint        = (exists( EOptionFlag::fingerPrintFast));
+		_http2                  = (exists( EOptionFlag::http2));
+		_chunked                = (exists( EOptionFlag::chunked));
+		_folderSummaries        = (exists( EOptionFlag::folderSummaries));
+
+		_numThreadDelete = at(EOptionFlag::deleteThreads).as<int>();
+		if (_numThreadDelete < 1)
+			throw std::logic_error(fmt::format("invalid --{} value : {}", _o.at(EOptionFlag::deleteThreads)._key, _numThreadDelete));
+
+		_packSmallFilesMax = at(EOptionFlag::packSmallFiles).as<uint64_t>();
+		if (_packSmallFilesMax > packSizeTarget)
+			throw std::logic_error(fmt::format("invalid --{} value : {}. Max is {}", _o.at(EOptionFlag::packSmallFiles)._key, _packSmallFilesMax, packSizeTarget));
+
+		_archiveSmallFilesMax = at(EOptionFlag::archiveSmallFiles).as<uint64_t>();
+		if (_archiveSmallFilesMax > archiveBatchBytes)
+			throw std::logic_error(fmt::format("invalid --{} value : {}. Max is {}", _o.at(EOptionFlag::archiveSmallFiles)._key, _archiveSmallFilesMax, archiveBatchBytes));
+
+		_compressLevel = at(EOptionFlag::compress).as<int>();
+		if ((_compressLevel < 0) || (_compressLevel > 9))
+			throw std::logic_error(fmt::format("invalid --{} value : {}", _o.at(EOptionFlag::compress)._key, _compressLevel));
+
+		const std::string uploadOrder = at(EOptionFlag::uploadOrder).as<std::string>();
+		if (uploadOrder == "largest")
+			_uploadOrder = EUploadOrder::largest;
+		else if (uploadOrder == "smallest")
+			_uploadOrder = EUploadOrder::smallest;
+		else if (uploadOrder == "newest")
+			_uploadOrder = EUploadOrder::newest;
+		else if (uploadOrder != "scan")
+			throw std::logic_error(fmt::format("invalid --{} value : {}", _o.at(EOptionFlag::uploadOrder)._key, uploadOrder));
+
+		_uploadParts = at(EOptionFlag::uploadParts).as<int>();
+		if ((_uploadParts < 1) || (_uploadParts > uploadPartsMax))
+			throw std::logic_error(fmt::format("invalid --{} value : {}. Max is {}", _o.at(EOptionFlag::uploadParts)._key, _uploadParts, uploadPartsMax));
+
+		_readCacheMax = at(EOptionFlag::readCache).as<uint64_t>();
+		if ((_readCacheMax > 0) && !contentFingerPrint())
+			throw std::logic_error(fmt::format("--{} needs --{} or --{}", _o.at(EOptionFlag::readCache)._key, _o.at(EOptionFlag::fingerPrintMd5)._key, _o.at(EOptionFlag::fingerPrintFast)._key));
+
+		const std::string ioEngine = at(EOptionFlag::ioEngine).as<std::string>();
+		if ((ioEngine != "auto") && !CFileReader::parseEngine(ioEngine, _ioEngine))
+			throw std::logic_error(fmt::format("invalid --{} value : {}", _o.at(EOptionFlag::ioEngine)._key, ioEngine));
+
+		if (!CFileReader::supported(_ioEngine)) {
+			LOGW("{} is not available, using {}", CFileReader::engineName(_ioEngine), CFileReader::engineName(EIoEngine::threads));
+			_ioEngine = EIoEngine::threads;
+		}
+
+		const int ioDepth = at(EOptionFlag::ioDepth).as<int>();
+		if ((ioDepth < 1) || (ioDepth > 256))
+			throw std::logic_error(fmt::format("invalid --{} value : {}", _o.at(EOptionFlag::ioDepth)._key, ioDepth));
+		_ioDepth = ioDepth;
+
+		const std::string cacheNeutral = at(EOptionFlag::cacheNeutral).as<std::string>();
+		if (cacheNeutral == "fadvise")
+			_cacheMode = ECacheMode::fadvise;
+		else if (cacheNeutral == "direct")
+			_cacheMode = ECacheMode::direct;
+		else if (cacheNeutral != "off")
+			throw std::logic_error(fmt::format("invalid --{} value : {}", _o.at(EOptionFlag::cacheNeutral)._key, cacheNeutral));
+
+		_bRotational = NDiskLayout::isRotational(_srcFolder);
+		const std::string readOrder = at(EOptionFlag::readOrder).as<std::string>();
+		if (readOrder == "auto")
+			_readOrder = _bRotational ? EReadOrder::extent : EReadOrder::scan;
+		else if (!NDiskLayout::parseOrder(readOrder, _readOrder))
+			throw std::logic_error(fmt::format("invalid --{} value : {}", _o.at(EOptionFlag::readOrder)._key, readOrder));
+
+		const std::string deviceReaders = at(EOptionFlag::deviceReaders).as<std::string>();
+		if (deviceReaders != "auto") {
+			const bool bNumber = (!deviceReaders.empty()) && (deviceReaders.size() < 6) && std::all_of(deviceReaders.begin(), deviceReaders.end(), ::isdigit);
+			if (!bNumber)
+				throw std::logic_error(fmt::format("invalid --{} value : {}", _o.at(EOptionFlag::deviceReaders)._key, deviceReaders));
+			_deviceReaders = std::stoi(deviceReaders);
+		}
+
+		for (auto f : {EOptionFlag::uploadRate, EOptionFlag::requestRate}) {
+			if (!exists(f))
+				continue;
+			const std::string rate = at(f).as<std::string>();
+			CRateSchedule schedule;
+			if (!CRateSchedule::parse(rate, schedule))
+				throw std::logic_error(fmt::format("invalid --{} value : {}", _o.at(f)._key, rate));
+			((f == EOptionFlag::uploadRate) ? _uploadRate : _requestRate) = rate;
+		}
+		if (exists(EOptionFlag::rateFile))
+			_rateFile = at(EOptionFlag::rateFile).as<std::string>();
+
+		if (_forceComputeLocalMd5 && _fastFingerPrint)
+			throw std::logic_error(fmt::format("--{} and --{} can't be used together", _o.at(EOptionFlag::fingerPrintMd5)._key, _o.at(EOptionFlag::fingerPrintFast)._key));
+
+		if (_folderSummaries && contentFingerPrint())
+			throw std::logic_error(fmt::format("--{} can't be used with --{} or --{}", _o.at(EOptionFlag::folderSummaries)._key, _o.at(EOptionFlag::fingerPrintMd5)._key, _o.at(EOptionFlag::fingerPrintFast)._key));
+
+		if ((_packSmallFilesMax > 0) && (_archiveSmallFilesMax > 0))
+			throw std::logic_error(fmt::format("--{} and --{} can't be used together", _o.at(EOptionFlag::packSmallFiles)._key, _o.at(EOptionFlag::archiveSmallFiles)._key));
 
 		if (count("curl-verbose")) {
 			_curlVerbose = (po::variables_map::at( "curl-verbose" ).as<std::string>() == "on");
@@ -374,6 +623,9 @@ bool COptionsPriv::parse(int ac, char** av)
 			_numThreadLocalMd5 = thCount;
 		}
 
+		// the cores left by the other upload threads
+		_numThreadCrypt = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) / _numThreadUpload);
+
 	}
 	catch (const std::exception & e)
 	{
@@ -391,19 +643,61 @@ bool COptionsPriv::parse(int ac, char** av)
 	LOGI("version {}", HUBACK_VERSION);
 	LOGI("with settings :");
 	LOGI(S_LIB " {}", "Hubic login", _hubicLogin);
+	LOGI(S_LIB " \"{}\"", "State folder", _stateDir.string() + "/");
+	if (_deadline != 0) {
+		std::tm t;
+		localtime_r(&_deadline, &t);
+		char buf[32];
+		std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &t);
+		LOGI(S_LIB " {}", "deadline", buf);
+	}
 	LOGI(S_LIB " \"{}\"", "Sources folder", _srcFolder.string() + "/");
 	for (const auto & s : _excludes)
 		LOGI(S_LIB " {}", "excludes", s);
 	LOGI(S_LIB " {}", "Container", _dstContainer);
 	LOGI(S_LIB " \"{}\"", "Destination", _dstFolder.string() + "/");
 	LOGI(S_LIB " {}", "Crypted ?", crypted() ? "yes" : "no");
-	if (crypted())
+	LOGI(S_LIB " {}", "Chunked ?", _chunked ? "yes" : "no");
+	if (_packSmallFilesMax > 0)
+		LOGI(S_LIB " {}", "pack files <", _packSmallFilesMax);
+	if (_archiveSmallFilesMax > 0)
+		LOGI(S_LIB " {}", "archive files <", _archiveSmallFilesMax);
+	if (_uploadOrder != EUploadOrder::scan)
+		LOGI(S_LIB " {}", "upload order", (_uploadOrder == EUploadOrder::largest) ? "largest first" : ((_uploadOrder == EUploadOrder::smallest) ? "smallest first" : "newest first"));
+	if (_chunked && (_uploadParts > 1))
+		LOGI(S_LIB " {}", "upload parts", fmt::format("{} chunk(s) at once", _uploadParts));
+	LOGI(S_LIB " {}", "Compression", _compressLevel ? fmt::format("gzip level {}", _compressLevel) : std::string("no"));
+	if (crypted()) {
 		LOGI(S_LIB " {}", "Cryptokey", _cryptoKey.hex());
+		LOGI(S_LIB " {}", "Crypt format", (_cryptFormat == ECryptFormat::gcm) ? fmt::format("aes-256-gcm, {} thread(s)", _numThreadCrypt) : std::string("aes-256-cbc"));
+	}
 
-	if (_removeNonExistingFiles)
+	if (_removeNonExistingFiles) {
 		LOGI(S_LIB " {}", "del non existing", "yes");
+		LOGI(S_LIB " {}", "delete thread", _numThreadDelete);
+	}
 	
-	LOGI(S_LIB " {}", "finger print", _forceComputeLocalMd5 ? "md5 computation" : "last modification date");
+	LOGI(S_LIB " {}", "finger print", _forceComputeLocalMd5 ? "md5 computation" : (_fastFingerPrint ? "xxh64, md5 of changed files" : "last modification date"));
+	if (_forceComputeLocalMd5) {
+		const NMD5::EEngine e = NMD5::CMultiComputer::bestEngine();
+		LOGI(S_LIB " {}", "md5 engine", fmt::format("{}, {} file(s) at once", NMD5::CMultiComputer::engineName(e), NMD5::CMultiComputer::laneCount(e)));
+	}
+	if (_readCacheMax > 0)
+		LOGI(S_LIB " {}", "read cache", fmt::format("{} bytes", _readCacheMax));
+	LOGI(S_LIB " {}", "io engine", (_ioEngine == EIoEngine::sync) ? std::string("sync") : fmt::format("{}, {} read(s) in flight", CFileReader::engineName(_ioEngine), _ioDepth));
+	if (_cacheMode != ECacheMode::normal)
+		LOGI(S_LIB " {}", "cache neutral", (_cacheMode == ECacheMode::direct) ? "O_DIRECT, else fadvise" : "fadvise");
+	LOGI(S_LIB " {}{}", "read order", NDiskLayout::orderName(_readOrder), _bRotational ? " (spinning disk)" : "");
+	LOGI(S_LIB " {}", "device readers", (_deviceReaders < 0) ? fmt::format("auto, {} on a spinning disk", rotationalDeviceReaders) : ((_deviceReaders == 0) ? std::string("no limit") : fmt::format("{} file(s) by device", _deviceReaders)));
+	if (_folderSummaries)
+		LOGI(S_LIB " {}", "folder summaries", "yes");
+	if (!_uploadRate.empty())
+		LOGI(S_LIB " {}", "upload rate", _uploadRate);
+	if (!_requestRate.empty())
+		LOGI(S_LIB " {}", "request rate", _requestRate);
+	if (!_rateFile.empty())
+		LOGI(S_LIB " \"{}\"", "rate file", _rateFile.string());
+	LOGI(S_LIB " {}", "http version", _http2 ? "2 (fallback to 1.1)" : "1.1");
 	LOGI(S_LIB " {}", "upload thread", _numThreadUpload);
 	LOGI(S_LIB " {}", "remoteMd5 thread", _numThreadRemoteMd5);
 	LOGI(S_LIB " {}", "localMd5 thread", _numThreadLocalMd5);
@@ -427,4 +721,23 @@ const COptions * COptions::get()
 	return s_pArgs;
 }
 
+// --device-readers : the limit of the per device read queues
+std::size_t COptions::deviceReaders(uint64_t device) const
+{
+	if (_deviceReaders >= 0)
+		return static_cast<std::size_t>(_deviceReaders);
+	return NDiskLayout::isRotational(device) ? rotationalDeviceReaders : 0;
+}
 
+std::string COptions::storageSettings() const
+{
+	return fmt::format("key:{} format:{} compress:{} chunked:{} pack:{}\n",
+		crypted() ? _cryptoKey.hex() : std::string(), static_cast<int>(_cryptFormat),
+		_compressLevel, _chunked ? 1 : 0, _packSmallFilesMax);
+}
+
+bf::path COptions::stateFile(const std::string & kind) const
+{
+	const std::string key = fmt::format("{}\n{}/{}", _srcFolder.string(), _dstContainer, _dstFolder.string());
+	return _stateDir / fmt::format("{}-{}.json", kind, NMD5::computeMd5(key).hex());
+}
@@ -27,7 +27,21 @@
 //- ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "common.h"
+#include "crypto.h"
 #include "md5.h"
+#include "fileReader.h"
+#include "diskLayout.h"
+
+//- ////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// order in which the checked files are uploaded, see --upload-order
+enum class EUploadOrder
+{
+	scan,     // as they are checked, or by --read-order
+	largest,  // largest first : the upload threads end together
+	smallest, // smallest first : the file count goes up fast
+	newest    // most recently modified first
+};
 
 //- ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -44,10 +58,25 @@ public:
 	
 public:
 	bool crypted() const { return !_cryptoPassword.empty(); }
+	bool contentFingerPrint() const { return _forceComputeLocalMd5 || _fastFingerPrint; }
+	bool shaped() const { return !(_uploadRate.empty() && _requestRate.empty() && _rateFile.empty()); }
+	std::size_t deviceReaders(uint64_t device) const;
+
+	// the settings that change the objects stored for a file : key, crypt
+	// format, compression, chunks and packs. The states kept for unchanged
+	// files (checkpoint, folder summaries) are void once they change. Not the
+	// archive size : archives are extracted by the server in the same objects
+	std::string storageSettings() const;
+
+	// a file of the state folder, one by source and destination
+	bf::path stateFile(const std::string & kind) const;
 
 public:
 	std::string  _hubicLogin;
 	std::string  _hubicPassword;
+	bool         _cacheCredentials;
+	bf::path     _stateDir;
+	std::time_t  _deadline; // --deadline, 0 : none
 
 	bf::path _srcFolder;
 	std::set<std::string>   _excludes;
@@ -56,15 +85,37 @@ public:
 	
 	std::string _cryptoPassword;
 	NMD5::CDigest _cryptoKey;
+	ECryptFormat  _cryptFormat;
 	
 public:
 	bool _removeNonExistingFiles;
 	bool _forceComputeLocalMd5;
+	bool _fastFingerPrint; // xxh64 index, the md5 of unchanged files is known
+	bool _http2;
+	bool _chunked;
+	uint64_t _packSmallFilesMax;
+	uint64_t _archiveSmallFilesMax;
+	uint64_t _readCacheMax;
+	EIoEngine   _ioEngine;
+	std::size_t _ioDepth; // reads in flight by reading thread
+	ECacheMode  _cacheMode;
+	EReadOrder  _readOrder;
+	bool        _bRotational; // source on a spinning disk
+	int         _deviceReaders; // files read at once by device, 0 : no limit, -1 : auto
+	bool        _folderSummaries; // skip the unchanged folders, see CFolderSummaries
+	EUploadOrder _uploadOrder;
+	int      _uploadParts; // chunks of a file stored at once, with --chunked
+	int      _compressLevel;
+	int  _numThreadDelete;
+	std::string _uploadRate;  // schedules, see CShaper. Empty : no limit
+	std::string _requestRate;
+	bf::path    _rateFile;    // read again when it changes
 
 public: // computed from machine core count
 	int _numThreadUpload   ;
 	int _numThreadLocalMd5 ;
 	int _numThreadRemoteMd5;
+	int _numThreadCrypt    ; // per gcm crypted upload
 
 public: // debug options
 	std::string _authToken;
@@ -0,0 +1,387 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "packStore.h"
+#include "../thirdparty/jsonxx/jsonxx.h"
+#include <iterator>
+#include <random>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+CPackStore::CPackStore(CContext & ctx)
+:	CContextual(ctx)
+,	_uploadedByteCount(0)
+,	_packedFileCount(0)
+,	_failedFileCount(0)
+{
+}
+
+std::string CPackStore::packUrl(const std::string & name) const
+{
+	CCurl curl;
+	return fmt::format("{}/{}/{}/{}/{}", _ctx._credentials.get().endpoint(), _ctx._options->_dstContainer, packPrefix, curl.escapePath(_ctx._options->_dstFolder).string(), name);
+}
+
+std::string CPackStore::newPackName() const
+{
+	static std::random_device s_random;
+	const auto now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	return fmt::format("pack-{:016x}-{:08x}", static_cast<uint64_t>(now), static_cast<uint32_t>(s_random()));
+}
+
+bool CPackStore::loadIndex(CRequest & rq, const std::string & name)
+{
+	rq.setHeaders(_ctx._credentials.authHeaders());
+	rq.get(packUrl(name + ".idx"));
+
+	jsonxx::Object idx;
+	if ((rq.getHttpResponseCode() != 200) || (!idx.parse(rq.getResponse())) || (!idx.has<jsonxx::Array>("entries"))) {
+		LOGE("can't read pack index '{}' [http response : {}]", name, rq.getHttpResponseCode());
+		return false;
+	}
+
+	const jsonxx::Array & entries = idx.get<jsonxx::Array>("entries");
+	uint64_t bytes(0);
+	for (std::size_t i=0; i<entries.size(); ++i)
+	{
+		if (!entries.has<jsonxx::Object>(i))
+			continue;
+
+		const jsonxx::Object & o = entries.get<jsonxx::Object>(i);
+		if ((!o.has<jsonxx::String>("path")) || (!o.has<jsonxx::Number>("offset")) || (!o.has<jsonxx::Number>("length")))
+			continue;
+
+		CPackEntry e;
+		e._pack      = name;
+		e._offset    = static_cast<uint64_t>(o.get<jsonxx::Number>("offset"));
+		e._length    = static_cast<uint64_t>(o.get<jsonxx::Number>("length"));
+		e._size      = o.has<jsonxx::Number>("size" ) ? static_cast<uint64_t>(o.get<jsonxx::Number>("size" )) : 0;
+		e._mtime     = o.has<jsonxx::Number>("mtime") ? static_cast<uint64_t>(o.get<jsonxx::Number>("mtime")) : 0;
+		e._md5       = NMD5::CDigest::fromString( o.has<jsonxx::String>("md5") ? o.get<jsonxx::String>("md5") : std::string() );
+		e._cryptoKey = NMD5::CDigest::fromString( o.has<jsonxx::String>("cryptoKey") ? o.get<jsonxx::String>("cryptoKey") : std::string() );
+		e._compression = o.has<jsonxx::String>("compression") ? o.get<jsonxx::String>("compression") : std::string();
+		_entries[o.get<jsonxx::String>("path")] = e;
+		bytes += e._length;
+	}
+	_packBytes[name] = bytes;
+	return true;
+}
+
+bool CPackStore::load()
+{
+	_entries.clear();
+	_packBytes.clear();
+	_orphans.clear();
+
+	// list the packs of the destination folder
+	CRequest rq(_ctx._options->_curlVerbose);
+	const std::string prefix = fmt::format("{}/{}/", packPrefix, _ctx._options->_dstFolder.string());
+	std::set<std::string> packs, indexes;
+	std::string marker;
+	for (bool bMore(true); bMore; )
+	{
+		rq.setHeaders(_ctx._credentials.authHeaders());
+		std::string url = fmt::format("{}/{}/?format=json&limit={}&prefix={}", _ctx._credentials.get().endpoint(), _ctx._options->_dstContainer, listingPageSize, rq.escapeString(prefix));
+		if (!marker.empty())
+			url += "&marker=" + rq.escapeString(marker);
+
+		rq.get(url);
+		if (rq.getHttpResponseCode() == 204)
+			break;
+
+		jsonxx::Array page;
+		if ((rq.getHttpResponseCode() != 200) || (!page.parse(rq.getResponse()))) {
+			LOGE("can't list packs [http response : {}]", rq.getHttpResponseCode());
+			return false;
+		}
+
+		for (std::size_t i=0; i<page.size(); ++i) {
+			if ((!page.has<jsonxx::Object>(i)) || (!page.get<jsonxx::Object>(i).has<jsonxx::String>("name")))
+				continue;
+			marker = page.get<jsonxx::Object>(i).get<jsonxx::String>("name");
+			const std::string name = marker.substr(prefix.length());
+			if (boost::algorithm::ends_with(name, ".idx"))
+				indexes.insert(name.substr(0, name.length() - 4));
+			else
+				packs.insert(name);
+		}
+		bMore = (page.size() >= listingPageSize);
+	}
+
+	// oldest first, so the newest entry of a path wins
+	for (const auto & name : indexes)
+		if ((packs.find(name) != packs.end()) && !loadIndex(rq, name))
+			return false;
+
+	for (const auto & name : packs)
+		if (indexes.find(name) == indexes.end())
+			_orphans.push_back(name);
+
+	LOGI("{} packed file(s) in {} pack(s)", _entries.size(), _packBytes.size());
+	return true;
+}
+
+bool CPackStore::find(const bf::path & relPath, CPackEntry & e) const
+{
+	std::lock_guard<std::mutex> lock(_m);
+	auto i = _entries.find(relPath);
+	if (i == _entries.end())
+		return false;
+	e = i->second;
+	return true;
+}
+
+bool CPackStore::append(const bf::path & relPath, CPackEntry e, const void * p, std::size_t len, CAsset * pAsset, std::unique_ptr<CPack> & full)
+{
+	std::lock_guard<std::mutex> lock(_m);
+	if (!_current) {
+		_current.reset(new CPack);
+		_current->_name = newPackName();
+		_current->_data.reserve(packSizeTarget + packSizeTarget / 8);
+	}
+
+	e._pack   = _current->_name;
+	e._offset = _current->_data.size();
+	e._length = len;
+	_current->_data.append(reinterpret_cast<const char*>(p), len);
+	_current->_entries.push_back(std::make_pair(relPath, e));
+	if (pAsset)
+		_current->_assets.push_back(pAsset);
+
+	if (_current->_data.size() >= packSizeTarget)
+		full = std::move(_current);
+	return true;
+}
+
+bool CPackStore::upload(const CPack & pack)
+{
+	bool bOk = uploadOnce(pack);
+	if ((!bOk) && (!_ctx.aborted())) { // retry once, as the other uploads
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+		LOGW("retrying uploading pack '{}'", pack._name);
+		bOk = uploadOnce(pack);
+	}
+
+	// the files of the pack are stored, or none of them
+	for (auto p : pack._assets) {
+		if (bOk)
+			p->setStored(true);
+		else
+			LOGE("'{}' not stored : its pack upload failed", p->getRelativePath().string());
+	}
+	(bOk ? _packedFileCount : _failedFileCount) += pack._assets.size();
+	return bOk;
+}
+
+bool CPackStore::uploadOnce(const CPack & pack)
+{
+	CRequest rq(_ctx._options->_curlVerbose);
+	rq.setHeaders(_ctx._credentials.uploadHeaders());
+	rq.addHeader("Content-Type", "application/octet-stream");
+	rq.addHeader("Etag", NMD5::computeMd5(pack._data).hex());
+	rq.put(packUrl(pack._name), pack._data.data(), pack._data.size());
+	if (rq.getHttpResponseCode() != 201) {
+		LOGE("Error uploading pack '{}' [http response : {}]", pack._name, rq.getHttpResponseCode());
+		return false;
+	}
+
+	// the index is written last : a pack without index is ignored
+	jsonxx::Array entries;
+	for (const auto & i : pack._entries) {
+		const CPackEntry & e = i.second;
+		jsonxx::Object o;
+		o << "path"      << i.first.string();
+		o << "offset"    << static_cast<jsonxx::Number>(e._offset);
+		o << "length"    << static_cast<jsonxx::Number>(e._length);
+		o << "size"      << static_cast<jsonxx::Number>(e._size);
+		o << "md5"       << e._md5.hex();
+		o << "mtime"     << static_cast<jsonxx::Number>(e._mtime);
+		o << "cryptoKey" << (e._cryptoKey.isValid() ? e._cryptoKey.hex() : std::string());
+		if (!e._compression.empty())
+			o << "compression" << e._compression;
+		entries << o;
+	}
+	jsonxx::Object idx;
+	idx << "version" << static_cast<jsonxx::Number>(1);
+	idx << "entries" << entries;
+	const std::string json = idx.json();
+
+	rq.setHeaders(_ctx._credentials.uploadHeaders());
+	rq.addHeader("Content-Type", "application/json");
+	rq.put(packUrl(pack._name + ".idx"), json.data(), json.size());
+	if (rq.getHttpResponseCode() != 201) {
+		LOGE("Error uploading pack index '{}' [http response : {}]", pack._name, rq.getHttpResponseCode());
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_m);
+		for (const auto & i : pack._entries)
+			_entries[i.first] = i.second;
+		_packBytes[pack._name] = pack._data.size();
+	}
+
+	_uploadedByteCount += pack._data.size() + json.size();
+	LOGD("pack '{}' uploaded : {} file(s), {} bytes", pack._name, pack._entries.size(), pack._data.size());
+	return true;
+}
+
+CUploader::result_code CPackStore::add(CAsset * p)
+{
+	assert( p );
+	assert( !p->isFolder() );
+
+	std::string data;
+	if ((!_ctx._readCache.take(p, data)) && !CFileReader::readFile(p->getFullPath().string(), data, _ctx._options->_cacheMode)) {
+		LOGE("file read error '{}'", p->getFullPath());
+		return CUploader::resError;
+	}
+
+	CHash h = p->getSrcHash();
+	h._computed = true;
+	h._len = data.size();
+	h._md5 = NMD5::computeMd5(data);
+	p->setSrcHash(h);
+
+	CPackEntry e;
+	e._size  = h._len;
+	e._md5   = h._md5;
+	e._mtime = p->getLocalLastModifTime();
+	if (CCompressor::compressIfWorth(data, _ctx._options->_compressLevel))
+		e._compression = "gzip";
+
+	std::unique_ptr<CPack> full;
+	if (_ctx.crypted()) {
+		std::unique_ptr<CCryptoContext> cryptoContext( CCryptoContext::create(_ctx._options->_cryptoPassword) );
+		CCryptEngine cryptor;
+		std::vector<uint8_t> crypted;
+		if (!cryptor.encrypt(crypted, data.data(), data.size(), cryptoContext.get())) {
+			LOGE("encryption error '{}'", p->getFullPath());
+			return CUploader::resError;
+		}
+		e._cryptoKey = _ctx._options->_cryptoKey;
+		append(p->getRelativePath(), e, crypted.data(), crypted.size(), p, full);
+
+	} else {
+		append(p->getRelativePath(), e, data.data(), data.size(), p, full);
+	}
+
+	if (full && !upload(*full))
+		return CUploader::resError;
+
+	return CUploader::resOk;
+}
+
+bool CPackStore::flush()
+{
+	std::unique_ptr<CPack> pack;
+	{
+		std::lock_guard<std::mutex> lock(_m);
+		pack = std::move(_current);
+	}
+	return (!pack) || pack->_entries.empty() || upload(*pack);
+}
+
+void CPackStore::remove(CRequest & rq, const std::string & name)
+{
+	for (const auto & n : { name + ".idx", name }) {
+		rq.setHeaders(_ctx._credentials.authHeaders());
+		rq.del(packUrl(n));
+		if ((rq.getHttpResponseCode() != 204) && (rq.getHttpResponseCode() != 404))
+			LOGW("can't delete '{}' [http response : {}]", n, rq.getHttpResponseCode());
+	}
+	_packBytes.erase(name);
+}
+
+void CPackStore::collectGarbage(const CAsset * pRoot)
+{
+	if (!enabled())
+		return;
+
+	// live bytes of each pack
+	std::map<std::string, uint64_t> liveBytes;
+	std::map<std::string, std::vector<std::pair<bf::path, CPackEntry>>> liveEntries;
+	for (const auto & i : _entries)
+	{
+		CAsset * p = pRoot->find(i.first);
+		const bool bLive = p
+			? ((!p->isFolder()) && packable(p->getSrcHash()._len))
+			: (!_ctx._options->_removeNonExistingFiles);
+		if (bLive) {
+			liveBytes[i.second._pack] += i.second._length;
+			liveEntries[i.second._pack].push_back(i);
+		}
+	}
+
+	CRequest rq(_ctx._options->_curlVerbose);
+	for (const auto & name : _orphans) {
+		LOGD("deleting orphan pack '{}'", name);
+		remove(rq, name);
+	}
+	_orphans.clear();
+
+	std::vector<std::string> rewritten;
+	const std::map<std::string, uint64_t> packBytes(_packBytes);
+	for (const auto & i : packBytes)
+	{
+		if (_ctx.aborted())
+			return;
+
+		const std::string & name = i.first;
+		const uint64_t live = liveBytes[name];
+		if (live == 0) {
+			LOGD("deleting pack '{}' : no live entry", name);
+			remove(rq, name);
+			continue;
+		}
+
+		if (2 * live >= i.second)
+			continue;
+
+		// mostly garbage : live entries are moved, as stored, to new packs
+		LOGD("compacting pack '{}' : {} live bytes out of {}", name, live, i.second);
+		rq.setHeaders(_ctx._credentials.authHeaders());
+		rq.get(packUrl(name));
+		const std::string & data = rq.getResponse();
+		if ((rq.getHttpResponseCode() != 200) || (data.size() != i.second)) {
+			LOGW("can't read pack '{}' [http response : {}]", name, rq.getHttpResponseCode());
+			continue;
+		}
+
+		bool bOk(true);
+		for (const auto & e : liveEntries[name]) {
+			std::unique_ptr<CPack> full;
+			append(e.first, e.second, data.data() + e.second._offset, e.second._length, nullptr, full);
+			if (full && !upload(*full))
+				bOk = false;
+		}
+		if (bOk)
+			rewritten.push_back(name);
+	}
+
+	// old packs are only deleted once their live entries are stored again
+	if (flush())
+		for (const auto & name : rewritten)
+			remove(rq, name);
+}
@@ -0,0 +1,129 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#pragma once
+
+#include "context.h"
+#include "compressor.h"
+#include "crypto.h"
+#include "uploader.h"
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+
+Small files packing (--pack-small-files SIZE)
+
+New files smaller than SIZE are appended to pack objects of about 64 Mo
+instead of being uploaded one by one. Packs of a destination folder are
+stored at the container root :
+	.hubk-packs/<destination folder>/pack-<time>-<random>
+	.hubk-packs/<destination folder>/pack-<time>-<random>.idx
+The .idx json object indexes its pack :
+	{ "version": 1, "entries": [ { "path": "...", "offset": 0, "length": n,
+	  "size": n, "md5": "...", "mtime": t, "cryptoKey": "",
+	  "compression": "gzip" }, ... ] }
+'length' is the stored length at 'offset'. Crypted entries have a crypto
+key. Each one is a complete 'openssl enc -aes-256-cbc' file of 'size' plain
+bytes, so one file can be restored with a range GET. With --compress, the
+entries that shrink are gzip files (compressed before encryption).
+
+Pack names sort by creation time : when a path is in several packs, the
+newest entry wins. Superseded and deleted entries are garbage collected by
+rewriting packs that are mostly garbage.
+
+*/
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct CPackEntry
+{
+	CPackEntry() : _offset(0), _length(0), _size(0), _mtime(0) {}
+
+	std::string   _pack;
+	uint64_t      _offset;
+	uint64_t      _length; // stored
+	uint64_t      _size;   // plain
+	NMD5::CDigest _md5;    // plain
+	uint64_t      _mtime;
+	NMD5::CDigest _cryptoKey;
+	std::string   _compression; // "gzip" or empty
+};
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CPackStore
+:	public CContextual
+{
+public:
+	CPackStore(CContext & ctx);
+
+public:
+	bool enabled() const { return _ctx._options->_packSmallFilesMax > 0; }
+	bool packable(uint64_t size) const { return enabled() && (size < _ctx._options->_packSmallFilesMax); }
+
+	bool load();
+	bool find(const bf::path & relPath, CPackEntry & e) const;
+
+	// thread safe. Full packs are uploaded by the calling thread. A file is
+	// stored once its pack and the pack index are : when a pack upload
+	// fails, all of its files fail
+	CUploader::result_code add(CAsset * p);
+	bool flush();
+
+	// rewrites packs with less than half live data. Entries of deleted files
+	// are only garbage with --del-non-existing
+	void collectGarbage(const CAsset * pRoot);
+
+	uint64_t uploadedByteCount() const { return _uploadedByteCount; }
+	uint64_t packedFileCount() const { return _packedFileCount; }
+	uint64_t failedFileCount() const { return _failedFileCount; }
+
+private:
+	struct CPack
+	{
+		std::string _name;
+		std::string _data;
+		std::vector<std::pair<bf::path, CPackEntry>> _entries;
+		std::vector<CAsset*> _assets; // files appended by this run. Entries moved by the garbage collection have none
+	};
+
+	std::string packUrl(const std::string & name) const;
+	std::string newPackName() const;
+	bool append(const bf::path & relPath, CPackEntry e, const void * p, std::size_t len, CAsset * pAsset, std::unique_ptr<CPack> & full);
+	bool upload(const CPack & pack);
+	bool uploadOnce(const CPack & pack);
+	bool loadIndex(CRequest & rq, const std::string & name);
+	void remove(CRequest & rq, const std::string & name);
+
+private:
+	mutable std::mutex _m;
+	std::map<bf::path, CPackEntry>  _entries;   // newest entry of each path
+	std::map<std::string, uint64_t> _packBytes; // stored bytes of each pack
+	std::unique_ptr<CPack>          _current;
+	std::vector<std::string>        _orphans;   // packs without index : interrupted uploads
+	std::atomic<uint64_t> _uploadedByteCount;
+	std::atomic<uint64_t> _packedFileCount;
+	std::atomic<uint64_t> _failedFileCount;
+};
@@ -55,15 +55,29 @@ void CProcess::waitDone()
 	_threads.clear();
 }
 
+bool CProcess::processBatch( std::vector<CAsset*> & batch )
+{
+	for (auto p : batch)
+		if (!process(p))
+			return false;
+	return true;
+}
+
 void CProcess::run()
 {
+	std::vector<CAsset*> batch;
 	while ((!_srcQueue.done()) || (!_srcQueue.isEmpty()))
 	{
-		CAsset * p = _srcQueue.get();
-		if (p) {
-			if (!process(p))
+		batch.clear();
+		for (CAsset * p; (batch.size() < batchSize()) && ((p = _srcQueue.get()) != nullptr); )
+			batch.push_back(p);
+
+		if (!batch.empty()) {
+			const bool bOk = processBatch(batch);
+			_srcQueue.release(batch);
+			if (!bOk)
 				break;
-			_dstQueue.add(p);
+			_dstQueue.add(batch);
 		}
 		std::this_thread::sleep_for(std::chrono::microseconds(5));
 		if (abort())
@@ -26,6 +26,7 @@
 
 #include <thread>
 #include <mutex>
+#include <vector>
 #include "asset.h"
 #include "queue.h"
 
@@ -44,6 +45,11 @@ public:
 
 protected:
 	virtual bool process( CAsset * p ) = 0;
+
+	// up to batchSize() assets are taken from the queue at once. By default
+	// they are processed one after the other
+	virtual std::size_t batchSize() const { return 1; }
+	virtual bool processBatch( std::vector<CAsset*> & batch );
 	virtual bool abort() { return false; }
 	virtual void onDone() {}
 	
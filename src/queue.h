@@ -25,7 +25,9 @@
 #pragma once
 
 
+#include <functional>
 #include <list>
+#include <map>
 #include <mutex>
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -35,13 +37,32 @@ class CTQueue
 :	protected std::list<T *>
 {
 public:
-	CTQueue() : _done(false) {}
+	CTQueue() : _done(false), _sweep(true), _laneItems(0), _lastDevice(0) {}
 	~CTQueue() {}
 
+	// optional order : items are taken by increasing key from the last taken
+	// one, then the sweep restarts from the smallest key (C-SCAN). Set before
+	// the first add
+	void setOrder(const std::function<uint64_t(const T *)> & key) { _key = key; _sweep = true; }
+
+	// optional priority : items are always taken by increasing key, the
+	// smallest first. Set before the first add
+	void setPriority(const std::function<uint64_t(const T *)> & key) { _key = key; _sweep = false; }
+
+	// optional partition by device : each device has its own pending items,
+	// and at most limit(device) of them taken and not released yet (0 : no
+	// limit). The device with the fewest taken items is served first. Set
+	// before the first add
+	void setDevice(const std::function<uint64_t(const T *)> & device, const std::function<std::size_t(uint64_t)> & limit)
+	{
+		_device = device;
+		_limit  = limit;
+	}
+
 	void add(T * p)
 	{
 		_m.lock();
-		this->push_back(p);
+		push(p);
 		_m.unlock();
 	}
 	
@@ -49,30 +70,34 @@ public:
 	void add(const TL & l) {
 		_m.lock();
 		for (auto i : l)
-			this->push_back(i);
+			push(i);
 		_m.unlock();
 	}
 	
 	
 	std::size_t size() {
 		_m.lock();
-		const std::size_t res= std::list<T *>::size();
+		const std::size_t res= std::list<T *>::size() + _laneItems;
 		_m.unlock();
 		return res;
 	}
 	
 	bool isEmpty() {
 		_m.lock();
-		const bool res= this->empty();
+		const bool res= this->empty() && (_laneItems == 0);
 		_m.unlock();
 		return res;
 	}
 	
+	// nullptr when empty, or when all the devices with pending items are at
+	// their limit
 	T * get()
 	{
 		T * res(nullptr);
 		_m.lock();
-		if (!this->empty()) {
+		if (_laneItems > 0)
+			res = getFromLanes();
+		else if (!this->empty()) {
 			res= this->front();
 			this->pop_front();
 		}
@@ -80,16 +105,111 @@ public:
 		return res;
 	}
 
+	// the item taken by get() is not read anymore
+	void release(T * p)
+	{
+		if (!_device)
+			return;
+		_m.lock();
+		SLane & l = _lanes[_device(p)];
+		if (l._taken > 0)
+			l._taken--;
+		_m.unlock();
+	}
+
+	template<class TL>
+	void release(const TL & l) {
+		for (auto i : l)
+			release(i);
+	}
+
 	bool done() { return _done; }
 	void setDone() { _done = true; }
 	void resetDone() { _done = false; }
 
-	std::list<T *> & lock() { _m.lock(); return (*this); }
+	// not for ordered or partitioned queues
+	std::list<T *> & lock() { assert( !_key && !_device ); _m.lock(); return (*this); }
 	void unlock() { _m.unlock(); }
 
+private:
+	struct SLane
+	{
+		SLane() : _head(0), _taken(0), _limit(0) {}
+		std::list<T *>               _fifo;
+		std::multimap<uint64_t, T *> _ordered;
+		uint64_t                     _head;
+		std::size_t                  _taken;
+		std::size_t                  _limit;
+	};
+
+	void push(T * p)
+	{
+		if ((!_key) && (!_device)) {
+			this->push_back(p);
+			return;
+		}
+
+		const uint64_t dev = _device ? _device(p) : 0;
+		auto i = _lanes.find(dev);
+		if (i == _lanes.end()) {
+			i = _lanes.insert(std::make_pair(dev, SLane())).first;
+			i->second._limit = _limit ? _limit(dev) : 0;
+		}
+		if (_key)
+			i->second._ordered.insert(std::make_pair(_key(p), p));
+		else
+			i->second._fifo.push_back(p);
+		_laneItems++;
+	}
+
+	T * getFromLanes()
+	{
+		// fewest taken items first, ties served in turn from the last device
+		SLane * best(nullptr);
+		uint64_t bestDevice(0);
+		for (auto & i : _lanes) {
+			SLane & l = i.second;
+			if ((l._fifo.empty() && l._ordered.empty()) || ((l._limit > 0) && (l._taken >= l._limit)))
+				continue;
+			const bool bAfter = (best != nullptr) && (bestDevice <= _lastDevice) && (i.first > _lastDevice);
+			if ((best == nullptr) || (l._taken < best->_taken) || ((l._taken == best->_taken) && bAfter)) {
+				best = &l;
+				bestDevice = i.first;
+			}
+		}
+		if (best == nullptr)
+			return nullptr;
+
+		T * res(nullptr);
+		if (!best->_ordered.empty()) {
+			auto i = _sweep ? best->_ordered.lower_bound(best->_head) : best->_ordered.begin();
+			if (i == best->_ordered.end())
+				i = best->_ordered.begin();
+			best->_head = i->first;
+			res = i->second;
+			best->_ordered.erase(i);
+		} else {
+			res = best->_fifo.front();
+			best->_fifo.pop_front();
+		}
+		if (_device)
+			best->_taken++;
+		_laneItems--;
+		_lastDevice = bestDevice;
+		return res;
+	}
+
 protected:
 	std::mutex       _m;
 	std::atomic_bool _done;
-};
 
+private:
+	std::function<uint64_t(const T *)>    _key;
+	bool                                  _sweep; // C-SCAN, else priority
+	std::function<uint64_t(const T *)>    _device;
+	std::function<std::size_t(uint64_t)> _limit;
+	std::map<uint64_t, SLane>             _lanes;
+	std::size_t                           _laneItems;
+	uint64_t                              _lastDevice;
+};
 
@@ -0,0 +1,97 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "readCache.h"
+#include "asset.h"
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+CReadCache::CReadCache()
+:	_budget(0)
+,	_used(0)
+,	_hitCount(0)
+,	_hitBytes(0)
+{
+}
+
+bool CReadCache::reserve(uint64_t size)
+{
+	if ((size == 0) || (size > readCacheFileMax))
+		return false;
+
+	std::lock_guard<std::mutex> lock(_m);
+	if (_used + size > _budget)
+		return false;
+
+	_used += size;
+	return true;
+}
+
+void CReadCache::release(uint64_t size)
+{
+	std::lock_guard<std::mutex> lock(_m);
+	assert(_used >= size);
+	_used -= size;
+}
+
+void CReadCache::put(const CAsset * p, std::string && data)
+{
+	std::lock_guard<std::mutex> lock(_m);
+	_data[p] = std::move(data);
+}
+
+bool CReadCache::take(const CAsset * p, std::string & data)
+{
+	std::lock_guard<std::mutex> lock(_m);
+	auto i = _data.find(p);
+	if (i == _data.end())
+		return false;
+
+	data = std::move(i->second);
+	_data.erase(i);
+	_used -= data.size();
+	_hitCount++;
+	_hitBytes += data.size();
+	return true;
+}
+
+int CReadCache::open(CFileReader & reader, const CAsset * p, std::string & data)
+{
+	data.clear();
+	if (take(p, data))
+		return reader.open(data.data(), data.size());
+
+	return reader.open(p->getFullPath().string());
+}
+
+void CReadCache::drop(const CAsset * p)
+{
+	std::lock_guard<std::mutex> lock(_m);
+	auto i = _data.find(p);
+	if (i == _data.end())
+		return;
+
+	_used -= i->second.size();
+	_data.erase(i);
+}
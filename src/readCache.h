@@ -0,0 +1,74 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#pragma once
+
+#include "common.h"
+#include "fileReader.h"
+#include <unordered_map>
+
+class CAsset;
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// --read-cache : the md5 pass keeps the content of the files it expects to
+// be uploaded, so the upload doesn't read them again. Bounded : when the
+// pool is full, or for files larger than readCacheFileMax, the upload reads
+// the file as before
+
+class CReadCache
+{
+public:
+	CReadCache();
+
+public:
+	void init(uint64_t budget) { _budget = budget; }
+	bool enabled() const { return _budget > 0; }
+
+	// room for a file content, to be put or released
+	bool reserve(uint64_t size);
+	void release(uint64_t size);
+	void put(const CAsset * p, std::string && data);
+
+	// the kept content of p, removed from the pool
+	bool take(const CAsset * p, std::string & data);
+
+	// a reader slot on the kept content of p, else on the file itself.
+	// 'data' holds the content and must outlive the slot
+	int open(CFileReader & reader, const CAsset * p, std::string & data);
+
+	// forgets a content which was not used
+	void drop(const CAsset * p);
+
+	uint64_t hitCount() const { return _hitCount; }
+	uint64_t hitBytes() const { return _hitBytes; }
+
+private:
+	std::mutex _m;
+	uint64_t   _budget;
+	uint64_t   _used;
+	std::unordered_map<const CAsset *, std::string> _data;
+	std::atomic<uint64_t> _hitCount;
+	std::atomic<uint64_t> _hitBytes;
+};
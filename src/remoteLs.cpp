@@ -25,6 +25,7 @@
 #include "remoteLs.h"
 #include "queue.h"
 #include "request.h"
+#include "../thirdparty/jsonxx/jsonxx.h"
 
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -32,17 +33,20 @@
 class CRemoteLs::CAssetData
 {
 public:
-	CAssetData(bool bIsFolder, const std::string & path)
+	CAssetData(bool bIsFolder, const std::string & path, const CRemoteObject & o = CRemoteObject())
 	:	_isFolder(bIsFolder)
 	,	_path(path)
+	,	_object(o)
 	{
 	}
 	bool isFolder() const { return _isFolder; }
 	std::string path() const { return _path; }
+	const CRemoteObject & object() const { return _object; }
 	
 private:
-	bool        _isFolder;
-	std::string _path;
+	bool          _isFolder;
+	std::string   _path;
+	CRemoteObject _object;
 };
 
 
@@ -96,19 +100,22 @@ public:
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 CRemoteLs::CRemoteLs()
-:	_queue(nullptr)
+:	_credentials(nullptr)
+,	_queue(nullptr)
 {
 }
 
-void CRemoteLs::build( const bf::path & folder, const CCredentials & cr, std::size_t threadCount)
+void CRemoteLs::build( const std::string & container, const bf::path & folder, CCredentialProvider & credentials, std::size_t threadCount)
 {
 	LOGI("building remote tree from {} ... ", folder.string());
 
 	CAssetQueue queue;
 	_queue = &queue;
 
-	_paths.clear();
-	_cr = cr;
+	_objects.clear();
+	_bySize.clear();
+	_credentials = &credentials;
+	_container = container;
 	_folderCount = 1;
 	std::vector<std::thread> threads(threadCount);
 	for (std::size_t i=0; i<threadCount; ++i)
@@ -124,11 +131,22 @@ void CRemoteLs::build( const bf::path & folder, const CCredentials & cr, std::si
 	
 	for (auto i : queue.lock()) {
 		assert( ! i->isFolder() );
-		_paths.insert( makeRel( folder, i->path() ) );
+		_objects.insert( std::make_pair( makeRel( folder, i->path() ), i->object() ) );
 	}
 	
 	queue.unlock();
-	
+
+	for (auto i = _objects.cbegin(); i != _objects.cend(); ++i)
+		_bySize.insert( std::make_pair( i->second._bytes, i ) );
+}
+
+std::vector<CRemoteLs::CObjects::const_iterator> CRemoteLs::findBySize(uint64_t bytes) const
+{
+	std::vector<CObjects::const_iterator> result;
+	const auto range = _bySize.equal_range(bytes);
+	for (auto i = range.first; i != range.second; ++i)
+		result.push_back(i->second);
+	return result;
 }
 
 void CRemoteLs::logNotifier() // thread function
@@ -145,8 +163,6 @@ void CRemoteLs::logNotifier() // thread function
 
 void CRemoteLs::run() // thread function
 {
-	const CCredentials cr(_cr);
-	
 	CRequest rq(false);
 	while (_folderCount > 0) {
 
@@ -160,49 +176,65 @@ void CRemoteLs::run() // thread function
 		delete pFolder;
 		LOGT("[{:6}] Building destination file list from {} ", _folderCount.load(), folder.string() );
 		
-		rq.addHeader(headerAuthToken, cr.token());
-		
-		const std::string url( fmt::format("{}/{}/?prefix={}/&delimiter=/", cr.endpoint(), "default", rq.escapePath(folder).string()) );
-		rq.get(url);
-		const std::string r = rq.getResponse();
-		//std::cout << "-- " << r.length() << std::endl << r  << std::endl ;
-		
-		std::set<std::string> all;
+		// json listing, paged by 'listingPageSize' entries
+		std::map<std::string, CRemoteObject> all;
 		std::set<std::string> dirs;
-		
-		std::string line;
-		std::istringstream isstream(r);
-		while (std::getline(isstream, line))
+		std::string marker;
+		for (bool bMore(true); bMore; )
 		{
-			//const bf::path relPath = makeRel(folder, line);
-			//all.insert(relPath.string());
-			all.insert(line);
-		}
-		
-		bool bFound(true);
-		while (bFound)
-		{
-			bFound = false;
-			for (auto i: all) {
-				
-				assert( !i.empty() );
-				if (i[i.length() -1] == '/')
-				{
-					dirs.insert(i.substr( 0, i.length()-1));
-					all.erase(i);
-					bFound = true;
-					
-					auto f= all.find( i.substr( 0, i.length()-1) );
-					if (f != all.end()) {
-						all.erase(f);
-					}
-					break;
+			const CCredentials cr = _credentials->get();
+			rq.setHeaders(_credentials->authHeaders());
+
+			// the container root (empty destination folder) is listed without prefix
+			const std::string prefix = folder.empty() ? std::string() : rq.escapePath(folder).string() + "/";
+			std::string url( fmt::format("{}/{}/?format=json&limit={}&prefix={}&delimiter=/", cr.endpoint(), _container, listingPageSize, prefix) );
+			if (!marker.empty())
+				url += "&marker=" + rq.escapeString(marker);
+
+			rq.get(url);
+			if (rq.getHttpResponseCode() == 204)
+				break; // empty
+
+			jsonxx::Array page;
+			if ((rq.getHttpResponseCode() != 200) || (!page.parse(rq.getResponse()))) {
+				LOGE("can't list remote folder '{}' [http response : {}]", folder.string(), rq.getHttpResponseCode());
+				break;
+			}
+
+			for (std::size_t i=0; i<page.size(); ++i)
+			{
+				if (!page.has<jsonxx::Object>(i))
+					continue;
+
+				const jsonxx::Object & o = page.get<jsonxx::Object>(i);
+				if (o.has<jsonxx::String>("subdir")) {
+					marker = o.get<jsonxx::String>("subdir");
+					dirs.insert( marker.substr(0, marker.length() - 1) );
+
+				} else if (o.has<jsonxx::String>("name")) {
+					marker = o.get<jsonxx::String>("name");
+					all[marker] = CRemoteObject(
+						NMD5::CDigest::fromString( o.has<jsonxx::String>("hash") ? o.get<jsonxx::String>("hash") : std::string() ),
+						o.has<jsonxx::Number>("bytes") ? static_cast<uint64_t>(o.get<jsonxx::Number>("bytes")) : 0
+					);
 				}
 			}
+
+			bMore = (page.size() >= listingPageSize);
 		}
+
+		// pseudo folder objects
+		for (const auto & d : dirs )
+			all.erase(d);
+		
+		// the chunks, packs and summaries stores are at the container root :
+		// they are not backups, never to be matched nor deleted as orphans
+		if (folder.empty())
+			for (const char * reserved : { chunkPrefix, packPrefix, summaryPrefix })
+				dirs.erase(reserved);
 		
-		for (auto i : all )
-			_queue->add( new CAssetData(false, i) );
+		for (const auto & i : all )
+			_queue->add( new CAssetData(false, i.first, i.second) );
 		
 		_folderCount += dirs.size();
 		
@@ -25,17 +25,36 @@
 #pragma once
 
 #include "common.h"
-#include "credentials.h"
+#include "auth.h"
+#include "md5.h"
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// remote object as listed by the json container listing
+struct CRemoteObject
+{
+	CRemoteObject() : _bytes(0) {}
+	CRemoteObject(const NMD5::CDigest & etag, uint64_t bytes) : _etag(etag), _bytes(bytes) {}
+
+	NMD5::CDigest _etag; // md5 of the stored (possibly crypted) data
+	uint64_t      _bytes;
+};
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 class CRemoteLs
 {
+public:
+	typedef std::map<bf::path, CRemoteObject> CObjects;
+
 public:
 	CRemoteLs();
-	void build( const bf::path & folder, const CCredentials & cr, std::size_t threadCount = 6);
-	const std::set<bf::path> & paths() const { return _paths; }
-	bool exists(const bf::path & p) const { return _paths.find(p) != _paths.end(); }
+	void build( const std::string & container, const bf::path & folder, CCredentialProvider & credentials, std::size_t threadCount = 6);
+	const CObjects & objects() const { return _objects; }
+	bool exists(const bf::path & p) const { return _objects.find(p) != _objects.end(); }
+
+	// content index : objects whose stored size is 'bytes'
+	std::vector<CObjects::const_iterator> findBySize(uint64_t bytes) const;
 	
 private:
 	void run(); // thread function
@@ -46,9 +65,10 @@ private:
 	class CAssetQueue;
 
 private:
-	CCredentials             _cr;
+	CCredentialProvider    * _credentials;
+	std::string              _container;
 	CAssetQueue*             _queue;
 	std::atomic<std::size_t> _folderCount;
-	std::set<bf::path>       _paths;
+	CObjects                 _objects;
+	std::multimap<uint64_t, CObjects::const_iterator> _bySize;
 };
-
@@ -23,13 +23,34 @@
 /*************************************************************************/
 
 #include "request.h"
+#include "shaper.h"
 
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+void CHeaderList::add( const std::string & str)
+{
+	_lines.push_back(str);
+	_p = curl_slist_append(_p, str.c_str());
+}
+
+void CHeaderList::add( const std::string & key, const std::string & value)
+{
+	add(fmt::format("{}: {}", boost::algorithm::trim_copy(key), boost::algorithm::trim_copy(value)));
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+CAuthRefresher * CRequest::s_pAuthRefresher(nullptr);
+
 CRequest::CRequest(bool bVerbose)
 :	_bVerbose(bVerbose)
+,	_expectedBodySize(std::numeric_limits<uint64_t>::max())
+,	_bBytesShaped(false)
 ,	_httpResponseCode(0)
+,	_putData(nullptr)
+,	_putLen(0)
+,	_putPos(0)
 {
 }
 
@@ -50,49 +71,118 @@ void CRequest::setPostData(const std::string & data)
 	_curl.setopt(CURLOPT_POSTFIELDS   , _postData.c_str());
 }
 
+size_t CRequest::readPutData(void *ptr, size_t size, size_t nmemb, void * p)
+{
+	CRequest * rq = reinterpret_cast<CRequest*>(p);
+	const std::size_t n = std::min(size * nmemb, rq->_putLen - rq->_putPos);
+	memcpy(ptr, rq->_putData + rq->_putPos, n);
+	rq->_putPos += n;
+	rq->shapeSent(n);
+	return n;
+}
+
+// curl rewinds the body when it replays the request on a fresh connection
+int CRequest::seekPutData(void * p, curl_off_t offset, int origin)
+{
+	CRequest * rq = reinterpret_cast<CRequest*>(p);
+	if ((origin != SEEK_SET) || (offset < 0) || (static_cast<std::size_t>(offset) > rq->_putLen))
+		return CURL_SEEKFUNC_CANTSEEK;
+	rq->_putPos = static_cast<std::size_t>(offset);
+	return CURL_SEEKFUNC_OK;
+}
+
+void CRequest::shapeSent(std::size_t n)
+{
+	CShaper * pShaper = CShaper::get();
+	if (pShaper && !_bBytesShaped && (n > 0))
+		pShaper->acquireBytes(n);
+}
+
+// PUT of an in memory body. The data must stay valid until the call returns
+CURLcode CRequest::put(const std::string & url, const void * data, std::size_t len)
+{
+	_putData = reinterpret_cast<const uint8_t*>(data);
+	_putLen  = len;
+	_putPos  = 0;
+	setExpectedBodySize(len);
+	setopt(CURLOPT_READDATA, this);
+	setopt(CURLOPT_READFUNCTION, CRequest::readPutData);
+	setopt(CURLOPT_SEEKDATA, this);
+	setopt(CURLOPT_SEEKFUNCTION, CRequest::seekPutData);
+	setopt(CURLOPT_INFILESIZE_LARGE, static_cast<curl_off_t>(len));
+	const CURLcode res = perform(PUT, url);
+	setopt(CURLOPT_INFILESIZE_LARGE, static_cast<curl_off_t>(-1));
+	setopt(CURLOPT_SEEKFUNCTION, static_cast<curl_seek_callback>(nullptr)); // streamed uploads can't seek
+	_putData = nullptr;
+	_putLen = _putPos = 0;
+	return res;
+}
+
+static boost::string_ref trim(boost::string_ref s)
+{
+	while (!s.empty() && isspace(static_cast<unsigned char>(s.front())))
+		s.remove_prefix(1);
+	while (!s.empty() && isspace(static_cast<unsigned char>(s.back())))
+		s.remove_suffix(1);
+	return s;
+}
+
 std::string CRequest::getResponseHeaderField(const std::string & key) const
 {
-	const std::string k = boost::algorithm::to_lower_copy(boost::algorithm::trim_copy(key));
+	const boost::string_ref k = trim(key);
 	if (k.empty())
 		return std::string();
 	
-	const auto i= _headerMap.find(k);
-	if (i == _headerMap.end())
-		return std::string();
+	for (const auto & f : _headerFields)
+		if (boost::algorithm::iequals(f.first, k))
+			return f.second.to_string();
 
-	return i->second;
+	return std::string();
 }
 
-static void parseResponseHeader( std::map<std::string, std::string> & headerMap, const std::string & result)
+// split the raw header block in place. No copy, fields point into 'result'
+static void parseResponseHeader( std::vector<std::pair<boost::string_ref, boost::string_ref>> & fields, const std::string & result)
 {
-	headerMap.clear();
+	fields.clear();
 
-	std::string line;
-	std::istringstream isstream(result);
-	while (std::getline(isstream, line))
+	boost::string_ref remaining(result);
+	while (!remaining.empty())
 	{
-		const std::string::size_type i = line.find( ':' );
-		if (i == std::string::npos)
+		const std::size_t eol = remaining.find('\n');
+		const boost::string_ref line = remaining.substr(0, eol);
+		remaining.remove_prefix( (eol == boost::string_ref::npos) ? remaining.size() : eol + 1 );
+
+		const std::size_t i = line.find( ':' );
+		if (i == boost::string_ref::npos)
 			continue;
 		
-		const std::string left = boost::algorithm::to_lower_copy(boost::algorithm::trim_copy(line.substr(0,i)));
-		const std::string right= boost::algorithm::trim_copy(line.substr(i+1));
+		const boost::string_ref left = trim(line.substr(0,i));
 		if (left.empty())
 			continue;
 		
-		if (headerMap.find(left) != headerMap.end()) {
-			LOGW("Duplicate header keyword {}", left);
-		} else {
-			headerMap[left] = right;
-		}
+		fields.push_back( std::make_pair(left, trim(line.substr(i+1))) );
 	}
 }
 
-CURLcode CRequest::perform(TYPE t, const std::string & url)
+CURLcode CRequest::performOnce(TYPE t, const std::string & url)
 {
+	// shared prebuilt headers are used as is. Only build a new list when
+	// request specific headers were added
 	curl_slist *headers= nullptr;
-	for (const auto & h : _headers)
-		headers = curl_slist_append(headers, h.c_str());
+	bool bOwnHeaders(false);
+	if (_headers.empty()) {
+		if (_sharedHeaders)
+			headers = _sharedHeaders->get();
+
+	} else {
+		bOwnHeaders = true;
+		if (_sharedHeaders)
+			for (const auto & h : _sharedHeaders->lines())
+				headers = curl_slist_append(headers, h.c_str());
+
+		for (const auto & h : _headers)
+			headers = curl_slist_append(headers, h.c_str());
+	}
 	
 	setopt(CURLOPT_VERBOSE, _bVerbose ? 1L : 0L);
 	setopt(CURLOPT_URL, url.c_str());
@@ -124,19 +214,50 @@ CURLcode CRequest::perform(TYPE t, const std::string & url)
 	
 	if (headers)
 		setopt(CURLOPT_HTTPHEADER, headers);
+
+	// with HTTP/2 enabled, metadata requests and small uploads are multiplexed
+	// on a few connections of the multiplexer. ALPN falls back to HTTP/1.1 when
+	// needed. Large uploads keep HTTP/1.1 connections of their own
+	bool bMultiplexed(false);
+	CCurlLibrary * pLib = CCurlLibrary::get();
+	if (pLib && pLib->http2())
+		bMultiplexed = (t != PUT) || (_expectedBodySize <= smallObjectSizeMax);
+	if (bMultiplexed) {
+		setopt(CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+		setopt(CURLOPT_PIPEWAIT, 1L);
+	} else {
+		setopt(CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1); // curl defaults to h2 over tls
+		setopt(CURLOPT_PIPEWAIT, 0L);
+	}
 	
 	setopt(CURLOPT_HEADERFUNCTION, CCurl::wfString);
 	setopt(CURLOPT_HEADERDATA, &_headerResponse);
 
+	// --upload-rate, --request-rate. The body of a multiplexed upload is read
+	// by the thread driving all the shared connections, it must not wait
+	// there : its bytes are counted before the request
+	_bBytesShaped = false;
+	if (CShaper * pShaper = CShaper::get()) {
+		pShaper->acquireRequest();
+		if (bMultiplexed && (t == PUT) && (_expectedBodySize != std::numeric_limits<uint64_t>::max())) {
+			pShaper->acquireBytes(_expectedBodySize);
+			_bBytesShaped = true;
+		}
+	}
+
 	_headerResponse.clear();
- 	const CURLcode res = _curl.perform(_response);
+ 	const CURLcode res = _curl.perform(_response, bMultiplexed);
 
 	_httpResponseCode= 0;
 	curl_easy_getinfo(_curl, CURLINFO_RESPONSE_CODE, &_httpResponseCode);
-	parseResponseHeader( _headerMap, _headerResponse );
 
-	_headers.clear();
-	if (headers)
+	long connectCount(0);
+	curl_easy_getinfo(_curl, CURLINFO_NUM_CONNECTS, &connectCount);
+	if (CCurlLibrary::get())
+		CCurlLibrary::get()->onPerformed(connectCount);
+	parseResponseHeader( _headerFields, _headerResponse );
+
+	if (headers && bOwnHeaders)
 		curl_slist_free_all(headers);
 	
 	if (res) {
@@ -146,3 +267,74 @@ CURLcode CRequest::perform(TYPE t, const std::string & url)
 	return res;
 }
 
+bool CRequest::renewAuth(std::string & url)
+{
+	if (s_pAuthRefresher == nullptr)
+		return false;
+
+	// collect the request headers and look for the rejected token
+	std::list<std::string> lines;
+	if (_sharedHeaders)
+		lines.insert(lines.end(), _sharedHeaders->lines().begin(), _sharedHeaders->lines().end());
+	lines.insert(lines.end(), _headers.begin(), _headers.end());
+
+	std::string rejectedToken;
+	for (const auto & l : lines) {
+		const std::string::size_type i = l.find(':');
+		if ((i != std::string::npos) && boost::algorithm::iequals(trim(boost::string_ref(l).substr(0, i)), headerAuthToken))
+			rejectedToken = trim(boost::string_ref(l).substr(i+1)).to_string();
+	}
+
+	if (rejectedToken.empty())
+		return false; // not a storage request
+
+	std::string rejectedEndpoint;
+	CCredentials cr;
+	if (!s_pAuthRefresher->renew(rejectedToken, rejectedEndpoint, cr))
+		return false;
+
+	_headers.clear();
+	for (const auto & l : lines) {
+		const std::string::size_type i = l.find(':');
+		if ((i != std::string::npos) && boost::algorithm::iequals(trim(boost::string_ref(l).substr(0, i)), headerAuthToken))
+			addHeader(headerAuthToken, cr.token());
+		else
+			_headers.push_back(l);
+	}
+	_sharedHeaders.reset();
+
+	if ((!rejectedEndpoint.empty()) && boost::algorithm::starts_with(url, rejectedEndpoint))
+		url = cr.endpoint() + url.substr(rejectedEndpoint.length());
+
+	return true;
+}
+
+CURLcode CRequest::perform(TYPE t, const std::string & url)
+{
+	CURLcode res = performOnce(t, url);
+
+	// the server closed a multiplexed connection (GOAWAY) before handling the
+	// request : replay it once, unless its body is streamed
+	const bool bHttp2Failed = (res == CURLE_HTTP2) || (res == CURLE_HTTP2_STREAM);
+	if (bHttp2Failed && ((t != PUT) || (_putData != nullptr))) {
+		LOGW("HTTP/2 request failed (curl code {}). Retrying", res);
+		_putPos = 0;
+		res = performOnce(t, url);
+	}
+
+	// token expired or revoked : renew the credentials and retry once.
+	// Streamed uploads can't be replayed here, the caller retries them
+	if ((res == CURLE_OK) && (_httpResponseCode == 401)) {
+		std::string retryUrl(url);
+		if (renewAuth(retryUrl) && (t != PUT)) {
+			LOGW("request rejected (401). Retrying with renewed credentials");
+			res = performOnce(t, retryUrl);
+		}
+	}
+
+	_headers.clear();
+	_sharedHeaders.reset();
+	_expectedBodySize = std::numeric_limits<uint64_t>::max();
+	return res;
+}
+
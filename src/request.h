@@ -25,6 +25,47 @@
 #pragma once
 
 #include "curl.h"
+#include "credentials.h"
+#include <memory>
+#include <boost/utility/string_ref.hpp>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Prebuilt request header list. Built once and shared (read only) by any
+// number of requests, e.g. the auth token header used by every HEAD.
+
+class CHeaderList
+{
+public:
+	CHeaderList() : _p(nullptr) {}
+	~CHeaderList() { if (_p) curl_slist_free_all(_p); }
+
+public:
+	void add( const std::string & str);
+	void add( const std::string & key, const std::string & value);
+	curl_slist * get() const { return _p; }
+	const std::vector<std::string> & lines() const { return _lines; }
+
+private:
+	CHeaderList(const CHeaderList &) = delete;
+	CHeaderList & operator=(const CHeaderList &) = delete;
+
+private:
+	curl_slist             * _p;
+	std::vector<std::string> _lines;
+};
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CAuthRefresher
+{
+public:
+	virtual ~CAuthRefresher() {}
+
+	// called when a request authenticated with 'rejectedToken' got a 401.
+	// Fills the endpoint used with that token and the credentials to retry with
+	virtual bool renew(const std::string & rejectedToken, std::string & rejectedEndpoint, CCredentials & cr) = 0;
+};
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -35,6 +76,9 @@ public:
 		GET, HEAD, PUT, POST, DELETE
 	};
 
+public:
+	static void setAuthRefresher(CAuthRefresher * p) { s_pAuthRefresher = p; }
+
 public:
 	CRequest(bool bVerbose);
 	virtual ~CRequest() {}
@@ -43,6 +87,7 @@ public:
 public:
 	void addHeader( const std::string & str);
 	void addHeader( const std::string & key, const std::string & value);
+	void setHeaders( const std::shared_ptr<const CHeaderList> & headers) { _sharedHeaders = headers; }
 	
 public:
 	operator const CCurl& () const { return _curl; }
@@ -50,11 +95,14 @@ public:
 	
 	template<typename T> CURLcode setopt(CURLoption option, T v) { return _curl.setopt( option, v); }
 	void setPostData(const std::string & data);
+	void setExpectedBodySize(uint64_t sz) { _expectedBodySize = sz; }
+	void shapeSent(std::size_t n); // body bytes handed to curl, for --upload-rate
 
 public:
 	virtual CURLcode perform(TYPE t, const std::string & url);
 	CURLcode get (const std::string & url) { return perform(GET, url); }
 	CURLcode put (const std::string & url) { return perform(PUT, url); }
+	CURLcode put (const std::string & url, const void * data, std::size_t len);
 	CURLcode head(const std::string & url) { return perform(HEAD, url); }
 	CURLcode post(const std::string & url) { return perform(POST, url); }
 	CURLcode del (const std::string & url) { return perform(DELETE, url); }
@@ -67,15 +115,31 @@ public:
 
 	std::string getResponseHeaderField(const std::string & key) const;
 
+private:
+	CURLcode performOnce(TYPE t, const std::string & url);
+	bool renewAuth(std::string & url);
+	static size_t readPutData(void *ptr, size_t size, size_t nmemb, void * rq);
+	static int seekPutData(void * rq, curl_off_t offset, int origin);
+
+private:
+	typedef std::pair<boost::string_ref, boost::string_ref> CHeaderField;
+	static CAuthRefresher * s_pAuthRefresher;
+
 private:
 	std::list<std::string> _headers;
+	std::shared_ptr<const CHeaderList> _sharedHeaders;
 	CCurl _curl;
 	
 	bool        _bVerbose;
+	uint64_t    _expectedBodySize;
+	bool        _bBytesShaped; // the body was counted by --upload-rate before the request
 	long        _httpResponseCode;
 	std::string _response;
 	std::string _headerResponse;
 	std::string _postData;
-	std::map<std::string, std::string> _headerMap;
+	const uint8_t * _putData;
+	std::size_t     _putLen;
+	std::size_t     _putPos;
+	std::vector<CHeaderField> _headerFields; // point into _headerResponse
 };
 
@@ -0,0 +1,280 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "shaper.h"
+#include <fstream>
+#include <ctime>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool parseRate(const std::string & s, uint64_t & rate)
+{
+	if (s.empty() || !isdigit(static_cast<unsigned char>(s[0])))
+		return false;
+
+	std::size_t end(0);
+	uint64_t v(0);
+	try {
+		v = std::stoull(s, &end);
+	} catch (const std::exception &) {
+		return false;
+	}
+
+	const std::string unit = s.substr(end);
+	if (unit == "K" || unit == "k")
+		v *= 1024;
+	else if (unit == "M" || unit == "m")
+		v *= 1024 * 1024;
+	else if (unit == "G" || unit == "g")
+		v *= 1024 * 1024 * 1024;
+	else if (!unit.empty())
+		return false;
+
+	rate = v;
+	return true;
+}
+
+// HH:MM, in minutes since midnight
+static bool parseTime(const std::string & s, int & minute)
+{
+	if ((s.size() != 5) || (s[2] != ':') || !isdigit(static_cast<unsigned char>(s[0])) || !isdigit(static_cast<unsigned char>(s[1]))
+	||  !isdigit(static_cast<unsigned char>(s[3])) || !isdigit(static_cast<unsigned char>(s[4])))
+		return false;
+
+	const int h = (s[0] - '0') * 10 + (s[1] - '0');
+	const int m = (s[3] - '0') * 10 + (s[4] - '0');
+	if ((h > 24) || (m > 59) || ((h == 24) && (m > 0)))
+		return false;
+
+	minute = h * 60 + m;
+	return true;
+}
+
+bool CRateSchedule::parse(const std::string & s, CRateSchedule & result)
+{
+	CRateSchedule r;
+	std::vector<std::string> entries;
+	boost::algorithm::split(entries, s, boost::is_any_of(","));
+	for (auto e : entries) {
+		boost::algorithm::trim(e);
+		if (e.empty())
+			return false;
+
+		const std::string::size_type eq = e.find('=');
+		if (eq == std::string::npos) {
+			if (!parseRate(e, r._default))
+				return false;
+			continue;
+		}
+
+		const std::string range = e.substr(0, eq);
+		const std::string::size_type dash = range.find('-');
+		CRange rg;
+		if ((dash == std::string::npos)
+		||  !parseTime(range.substr(0, dash), rg._begin)
+		||  !parseTime(range.substr(dash + 1), rg._end)
+		||  !parseRate(e.substr(eq + 1), rg._rate))
+			return false;
+
+		r._ranges.push_back(rg);
+	}
+
+	result = r;
+	return true;
+}
+
+uint64_t CRateSchedule::rateAt(int minute) const
+{
+	for (const auto & rg : _ranges) {
+		const bool bIn = (rg._begin <= rg._end)
+			? ((minute >= rg._begin) && (minute < rg._end))
+			: ((minute >= rg._begin) || (minute < rg._end)); // over midnight
+		if (bIn)
+			return rg._rate;
+	}
+	return _default;
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+CTokenBucket::CTokenBucket()
+:	_rate(0)
+,	_tokens(0)
+,	_last(std::chrono::steady_clock::now())
+{
+}
+
+void CTokenBucket::setRate(uint64_t rate)
+{
+	if (rate == _rate)
+		return;
+
+	_rate = rate;
+	_tokens = std::min(_tokens, static_cast<double>(rate));
+}
+
+std::chrono::microseconds CTokenBucket::take(uint64_t n, std::chrono::steady_clock::time_point now)
+{
+	if (_rate == 0) {
+		_tokens = 0;
+		_last = now;
+		return std::chrono::microseconds(0);
+	}
+
+	// refill, up to one second of budget. The tokens may be negative : the
+	// debt of the previous callers, who are already waiting for it
+	const double elapsed = std::chrono::duration<double>(now - _last).count();
+	_last = now;
+	_tokens = std::min(_tokens + elapsed * _rate, static_cast<double>(_rate));
+	_tokens -= n;
+	if (_tokens >= 0)
+		return std::chrono::microseconds(0);
+
+	return std::chrono::microseconds(static_cast<int64_t>(-_tokens * 1e6 / _rate));
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static CShaper * s_pShaper(nullptr);
+
+CShaper * CShaper::get()
+{
+	return s_pShaper;
+}
+
+CShaper::CShaper(const std::string & uploadSchedule, const std::string & requestSchedule, const bf::path & rateFile)
+:	_rateFile(rateFile)
+,	_rateFileTime(0)
+,	_waitedMicroseconds(0)
+{
+	// the options were checked
+	CRateSchedule::parse(uploadSchedule, _cmdUpload);
+	CRateSchedule::parse(requestSchedule, _cmdRequests);
+	_upload = _cmdUpload;
+	_requests = _cmdRequests;
+	update(std::chrono::steady_clock::now());
+
+	assert(s_pShaper == nullptr);
+	s_pShaper = this;
+}
+
+CShaper::~CShaper()
+{
+	s_pShaper = nullptr;
+}
+
+void CShaper::loadRateFile()
+{
+	boost::system::error_code ec;
+	const std::time_t t = bf::last_write_time(_rateFile, ec);
+	if (ec) {
+		if (_rateFileTime != 0)
+			LOGI("rate file '{}' removed, back to the command line rates", _rateFile.string());
+		_rateFileTime = 0;
+		_upload = _cmdUpload;
+		_requests = _cmdRequests;
+		return;
+	}
+	if (t == _rateFileTime)
+		return;
+	_rateFileTime = t;
+
+	// a schedule missing from the file is the command line one
+	_upload = _cmdUpload;
+	_requests = _cmdRequests;
+
+	std::ifstream f(_rateFile.c_str());
+	std::string line;
+	while (getline(f, line)) {
+		boost::algorithm::trim(line);
+		if (line.empty() || (line[0] == '#'))
+			continue;
+
+		const std::string::size_type sp = line.find_first_of(" \t");
+		const std::string key = line.substr(0, sp);
+		const std::string value = (sp == std::string::npos) ? std::string() : boost::algorithm::trim_copy(line.substr(sp));
+		CRateSchedule * pDst = (key == "upload") ? &_upload : ((key == "requests") ? &_requests : nullptr);
+		if ((pDst == nullptr) || !CRateSchedule::parse(value, *pDst)) {
+			LOGW("rate file '{}' : invalid line '{}'", _rateFile.string(), line);
+			continue;
+		}
+		LOGI("rate file '{}' : {}", _rateFile.string(), line);
+	}
+}
+
+// called with _m held
+void CShaper::update(std::chrono::steady_clock::time_point now)
+{
+	if (now - _lastUpdate < std::chrono::seconds(1))
+		return;
+	_lastUpdate = now;
+
+	if (!_rateFile.empty())
+		loadRateFile();
+
+	const std::time_t t = std::time(nullptr);
+	std::tm local;
+	localtime_r(&t, &local);
+	const int minute = local.tm_hour * 60 + local.tm_min;
+
+	const uint64_t bytes = _upload.rateAt(minute);
+	const uint64_t calls = _requests.rateAt(minute);
+	if ((bytes != _bytes.rate()) || (calls != _calls.rate()))
+		LOGD("rates : upload {} B/s, {} request(s)/s (0 : no limit)", bytes, calls);
+	_bytes.setRate(bytes);
+	_calls.setRate(calls);
+}
+
+void CShaper::wait(std::chrono::microseconds d)
+{
+	if (d.count() <= 0)
+		return;
+
+	_waitedMicroseconds += d.count();
+	std::this_thread::sleep_for(d);
+}
+
+void CShaper::acquireBytes(uint64_t n)
+{
+	std::chrono::microseconds d;
+	{
+		std::lock_guard<std::mutex> lock(_m);
+		const auto now = std::chrono::steady_clock::now();
+		update(now);
+		d = _bytes.take(n, now);
+	}
+	wait(d);
+}
+
+void CShaper::acquireRequest()
+{
+	std::chrono::microseconds d;
+	{
+		std::lock_guard<std::mutex> lock(_m);
+		const auto now = std::chrono::steady_clock::now();
+		update(now);
+		d = _calls.take(1, now);
+	}
+	wait(d);
+}
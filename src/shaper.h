@@ -0,0 +1,131 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#pragma once
+
+#include "common.h"
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+
+Upload and request rate limits (--upload-rate, --request-rate)
+
+A rate is a number, optionally followed by K, M or G (x1024), per second :
+bytes sent for the upload rate, requests started for the request rate. 0 is
+no limit. A schedule is a comma separated list of rates, each one optionally
+restricted to a local time range :
+	08:00-19:00=10M,20:00-06:00=50M,2M
+The first matching range wins, a rate without range applies out of them.
+Out of the ranges, with no default rate, there is no limit.
+
+With --rate-file, the file is read again when it changes, and its lines
+replace the schedules of the command line without a restart :
+	upload 08:00-19:00=10M
+	requests 100
+A schedule the file doesn't set, and a missing file, is the command line one.
+
+Both limits are token buckets shared by all the request threads. A thread
+takes what it needs and sleeps for the missing tokens, so the budget left by
+idle threads is used by the busy ones. Up to one second of unused budget
+is kept for bursts.
+
+*/
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct CRateSchedule
+{
+	struct CRange
+	{
+		int      _begin; // minutes since midnight
+		int      _end;
+		uint64_t _rate;
+	};
+
+	CRateSchedule() : _default(0) {}
+	// false when 's' is not a valid schedule. 'result' is unchanged then
+	static bool parse(const std::string & s, CRateSchedule & result);
+	uint64_t rateAt(int minute) const;
+
+	std::vector<CRange> _ranges;
+	uint64_t            _default;
+};
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CTokenBucket
+{
+public:
+	CTokenBucket();
+
+	// 0 : no limit
+	void setRate(uint64_t rate);
+	uint64_t rate() const { return _rate; }
+
+	// takes n tokens. Returns how long the caller has to wait for them
+	std::chrono::microseconds take(uint64_t n, std::chrono::steady_clock::time_point now);
+
+private:
+	uint64_t _rate;
+	double   _tokens;
+	std::chrono::steady_clock::time_point _last;
+};
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CShaper
+{
+public:
+	// nullptr when no limit is set
+	static CShaper * get();
+
+public:
+	CShaper(const std::string & uploadSchedule, const std::string & requestSchedule, const bf::path & rateFile);
+	~CShaper();
+
+	// block the calling thread while over the limits. Thread safe
+	void acquireBytes(uint64_t n);
+	void acquireRequest();
+
+	double waitedSeconds() const { return _waitedMicroseconds / 1e6; }
+
+private:
+	void update(std::chrono::steady_clock::time_point now);
+	void loadRateFile();
+	void wait(std::chrono::microseconds d);
+
+private:
+	std::mutex    _m;
+	CRateSchedule _cmdUpload; // from the command line
+	CRateSchedule _cmdRequests;
+	CRateSchedule _upload; // in use
+	CRateSchedule _requests;
+	CTokenBucket  _bytes;
+	CTokenBucket  _calls;
+	bf::path      _rateFile;
+	std::time_t   _rateFileTime;
+	std::chrono::steady_clock::time_point _lastUpdate;
+	std::atomic<uint64_t> _waitedMicroseconds;
+};
@@ -24,6 +24,9 @@
 
 #include "srcFileList.h"
 #include "wildcard.h"
+#include "diskLayout.h"
+#include <sys/stat.h>
+#include <algorithm>
 #include "common.h"
 
 static bool exclude( const bf::path & path,  const std::set<std::string> & patterns )
@@ -55,9 +58,12 @@ void CSourceParser::parse(const bf::path & src, const std::set<std::string> & ex
 	assert( bf::is_directory(src) );
 	_excludeFileCount= 0;
 	_srcFileCount= 0;
+	_linkFileCount= 0;
+	_links.clear();
 
 	delete _root;
 	_root = new CAsset(nullptr, src.string(), true );
+	_root->setDevice(NDiskLayout::device(src.string()));
 	
 	onStart();
 	
@@ -66,16 +72,34 @@ void CSourceParser::parse(const bf::path & src, const std::set<std::string> & ex
 	onDone();
 }
 
-void CSourceParser::parseRec(CAsset * pCrt, const std::set<std::string> & excludeList)
+// entries are sorted by name, the directory order may change between runs
+static NMD5::CDigest summarize(std::vector<std::pair<std::string, std::string>> & entries, const std::string & head)
+{
+	std::sort(entries.begin(), entries.end());
+	std::string s(head);
+	for (const auto & e : entries) {
+		s += e.first;
+		s += '\0';
+		s += e.second;
+		s += '\n';
+	}
+	return NMD5::computeMd5(s);
+}
+
+NMD5::CDigest CSourceParser::parseRec(CAsset * pCrt, const std::set<std::string> & excludeList)
 {
 	assert( pCrt );
 	if (!pCrt->isFolder() || abort())
-		return;
+		return NMD5::CDigest();
 
 	namespace bf= bf;
 	const auto crt = pCrt->getFullPath();
 	const bf::path root = pCrt->getRoot();
 	
+	std::vector<CAsset*> newAssets;
+	std::vector<std::pair<std::string, std::string>> files; // name, "size mtime"
+	bool bSummarized(true);
+
 	bf::directory_iterator end_iter;
 	for	( bf::directory_iterator dir_iter(crt) ; (!abort()) && dir_iter != end_iter ; ++dir_iter)
 	{
@@ -92,15 +116,31 @@ void CSourceParser::parseRec(CAsset * pCrt, const std::set<std::string> & exclud
 		const std::string encodedName( _curl.escapeString(name));
 		if (bf::is_regular_file(dir_iter->status()) )
 		{
-			const std::time_t lwt = bf::last_write_time( f );
+			struct stat st;
+			const bool bStat = (stat(f.c_str(), &st) == 0);
+			const std::time_t lwt = bStat ? st.st_mtime : bf::last_write_time( f );
 			newAsset = new CAsset(pCrt, name, false);
 			newAsset->setLocalLastModifTime(lwt);
+			newAsset->setDevice(pCrt->getDevice());
+			files.push_back(std::make_pair(name, fmt::format("{} {}", bStat ? st.st_size : 0, lwt)));
+			bSummarized = bSummarized && bStat;
+
+			// the other links of an inode are stored from its first one
+			if (bStat && (st.st_nlink > 1)) {
+				const auto i = _links.insert(std::make_pair(std::make_pair(static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino)), newAsset));
+				if (!i.second) {
+					newAsset->setLinkPrimary(i.first->second);
+					_linkFileCount++;
+				}
+			}
 			
 			_srcFileCount++;
 		}
 		else if (bf::is_directory(dir_iter->status()))
 		{
+			// a folder can be a mount point, its files are on its device
 			newAsset = new CAsset(pCrt, name, true);
+			newAsset->setDevice(NDiskLayout::device(f.string()));
 		}
 		else
 		{
@@ -108,12 +148,28 @@ void CSourceParser::parseRec(CAsset * pCrt, const std::set<std::string> & exclud
 		}
 		
 		if (newAsset)
-			onNewAsset(newAsset);
+			newAssets.push_back(newAsset);
 	}
+
+	const NMD5::CDigest own = bSummarized ? summarize(files, "files\n") : NMD5::CDigest();
+	onFolderListed(pCrt, own);
+	for (CAsset * p : newAssets)
+		onNewAsset(p);
 	
+	std::vector<std::pair<std::string, std::string>> folders; // name, tree
 	const std::size_t childCount( pCrt->childCount() );
-	for (std::size_t i=0; i<childCount; ++i)
-		parseRec(pCrt->childAt(i), excludeList);
+	for (std::size_t i=0; i<childCount; ++i) {
+		CAsset * pChild = pCrt->childAt(i);
+		const NMD5::CDigest tree = parseRec(pChild, excludeList);
+		if (pChild->isFolder()) {
+			folders.push_back(std::make_pair(pChild->_name, tree.hex()));
+			bSummarized = bSummarized && tree.isValid();
+		}
+	}
+
+	const NMD5::CDigest tree = bSummarized ? summarize(folders, own.hex() + "\n") : NMD5::CDigest();
+	onFolderDone(pCrt, own, tree);
+	return tree;
 }
 
 
@@ -26,6 +26,7 @@
 
 #include "parser.h"
 #include "curl.h"
+#include "md5.h"
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -33,19 +34,30 @@ class CSourceParser
 :	public CParser
 {
 public:
-	CSourceParser() : _excludeFileCount(0), _srcFileCount(0) {}
+	CSourceParser() : _excludeFileCount(0), _srcFileCount(0), _linkFileCount(0) {}
 	~CSourceParser() {}
 
 	void parse(const bf::path & src, const std::set<std::string> & excludeList);
 	uint64_t getExcludeFileCount() const { return _excludeFileCount; }
 	uint64_t getSrcFileCount() const { return _srcFileCount; }
+	uint64_t getLinkFileCount() const { return _linkFileCount; }
+
+protected: // callback
+	// 'own' sums up the name, size and last modification date of the files
+	// of a folder. Called once its entries are created, before onNewAsset is
+	// called for them. Invalid when a file couldn't be stat'ed
+	virtual void onFolderListed(CAsset * , const NMD5::CDigest & /*own*/) {}
+	// 'tree' also sums up the names and the trees of the sub folders
+	virtual void onFolderDone(CAsset * , const NMD5::CDigest & /*own*/, const NMD5::CDigest & /*tree*/) {}
 
 private:
-	void parseRec(CAsset * crt, const std::set<std::string> & excludeList);
+	NMD5::CDigest parseRec(CAsset * crt, const std::set<std::string> & excludeList);
 
 private:
 	CCurl _curl; // for url_encode function
 	std::atomic<uint64_t> _excludeFileCount;
 	std::atomic<uint64_t> _srcFileCount;
+	std::atomic<uint64_t> _linkFileCount; // hard links besides the first one
+	std::map<std::pair<uint64_t, uint64_t>, CAsset*> _links; // (st_dev, st_ino) of multiply linked files
 };
 
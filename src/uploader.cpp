@@ -30,11 +30,17 @@ CUploader::CUploader(CContext & ctx)
 :	CContextual(ctx)
 ,	_rq(ctx._options->_curlVerbose)
 ,	_crt(nullptr)
-,	_f(nullptr)
+,	_gcmCryptor(ctx._options->_numThreadCrypt)
+,	_bCompressing(false)
+,	_pendingPos(0)
+,	_reader(ctx._options->_ioEngine, ctx._options->_ioDepth, ioPieceSize, 1, ctx._options->_cacheMode)
+,	_slot(-1)
 ,	_totalReaded(0)
 ,	_totalUploaded(0)
 ,	_bStarting(false)
 ,	_bDone(false)
+,	_bEof(false)
+,	_bStreamError(false)
 ,	_cryptoContext(nullptr)
 {
 }
@@ -57,16 +63,23 @@ size_t CUploader::rdd(uint8_t *pDst, size_t size, size_t nmemb)
 		return 0;
 
 	std::size_t uploaded= 0;
-	if (!crypted())
+	if (_bCompressing || gcm()) {
+		uploaded = rddBuffered(pDst, size * nmemb);
+		if (uploaded == CURL_READFUNC_ABORT)
+			return CURL_READFUNC_ABORT;
+
+	} else if (!crypted())
 	{
 		if (_bStarting)
 			_bStarting = false;
 		
-		uploaded= fread(pDst,size,nmemb,_f);
+		uploaded= _reader.read(_slot, pDst, size * nmemb);
+		if (_reader.error(_slot))
+			return streamError("read");
 		if (_md5Computer.isInitialised())
 			_md5Computer.feed(pDst, uploaded);
 		
-		_bDone = feof(_f) || (uploaded == 0);
+		_bDone = _reader.eof(_slot) || (uploaded == 0);
 		
 	} else {
 		std::vector<uint8_t> cryptedData;
@@ -76,7 +89,8 @@ size_t CUploader::rdd(uint8_t *pDst, size_t size, size_t nmemb)
 			assert( _cryptoContext );
 			
 			LOGD("upload starting ... '{}'", _crt->getRelativePath().string());
-			_cryptor.encryptStart(cryptedData, _cryptoContext);
+			if (!_cryptor.encryptStart(cryptedData, _cryptoContext))
+				return streamError("encryption");
 			memcpy( pDst + uploaded, cryptedData.data(), cryptedData.size());
 			
 			_md5EncComputer.feed(pDst + uploaded, cryptedData.size());
@@ -85,16 +99,19 @@ size_t CUploader::rdd(uint8_t *pDst, size_t size, size_t nmemb)
 		}
 		
 		std::vector<uint8_t> readedData(std::max((2*size*nmemb) / 3, size_t(1)));
-		const std::size_t readed = fread(readedData.data(),1,readedData.size(),_f);
+		const std::size_t readed = _reader.read(_slot, readedData.data(), readedData.size());
+		if (_reader.error(_slot))
+			return streamError("read");
 		if (_md5Computer.isInitialised())
 			_md5Computer.feed(readedData.data(), readed);
 
-		_bDone = feof(_f) || (readed == 0);
+		_bDone = _reader.eof(_slot) || (readed == 0);
 		readedData.resize(readed);
 		
 		if (!readedData.empty()) {
 		
-			_cryptor.update(cryptedData, readedData.data(), readedData.size());
+			if (!_cryptor.update(cryptedData, readedData.data(), readedData.size()))
+				return streamError("encryption");
 			memcpy( pDst + uploaded, cryptedData.data(), cryptedData.size());
 
 			_md5EncComputer.feed( cryptedData.data(), cryptedData.size() );
@@ -103,7 +120,8 @@ size_t CUploader::rdd(uint8_t *pDst, size_t size, size_t nmemb)
 		
 		if (_bDone) {
 		
-			_cryptor.finalize(cryptedData);
+			if (!_cryptor.finalize(cryptedData))
+				return streamError("encryption");
 			if (!cryptedData.empty()) {
 				memcpy( pDst + uploaded, cryptedData.data(), cryptedData.size());
 				_md5EncComputer.feed( cryptedData.data(), cryptedData.size() );
@@ -121,16 +139,121 @@ size_t CUploader::rdd(uint8_t *pDst, size_t size, size_t nmemb)
 	LOGT(" {}% [ {} / {} ] uploaded ({})", prc, std::min(h._len, _totalUploaded), h._len, uploaded );
 	
 	_totalUploaded += uploaded;
+	_rq.shapeSent(uploaded);
 	return uploaded;
 }
 
-static void addMetaDatasToRequest(CRequest & r, CAsset * p, bool crypted  )
+// compressed or gcm crypted data go through a buffer : their size differs
+// from the curl buffer size. gcm reads one chunk per crypt thread at once
+size_t CUploader::rddBuffered(uint8_t *pDst, size_t size)
+{
+	while ((_pending.size() - _pendingPos < size) && (!_bEof))
+	{
+		if (_pendingPos > 0) {
+			_pending.erase(_pending.begin(), _pending.begin() + _pendingPos);
+			_pendingPos = 0;
+		}
+
+		std::vector<uint8_t> readedData(gcm() ? gcmChunkSize * _ctx._options->_numThreadCrypt : compressSampleSize);
+		const std::size_t readed = _reader.read(_slot, readedData.data(), readedData.size());
+		if (_reader.error(_slot))
+			return streamError("read");
+		if (_md5Computer.isInitialised())
+			_md5Computer.feed(readedData.data(), readed);
+		_totalReaded += readed;
+		_bEof = _reader.eof(_slot) || (readed == 0);
+
+		std::vector<uint8_t> compressedData;
+		if (_bCompressing) {
+			if ((!_compressor.update(compressedData, readedData.data(), readed)) || (_bEof && !_compressor.finalize(compressedData)))
+				return streamError("compression");
+		} else {
+			readedData.resize(readed);
+			compressedData.swap(readedData);
+		}
+
+		if (gcm()) {
+			std::vector<uint8_t> cryptedData;
+			if (_bStarting) {
+				if (!_gcmCryptor.encryptStart(cryptedData, _ctx._options->_cryptoPassword))
+					return streamError("encryption");
+				_pending.insert(_pending.end(), cryptedData.begin(), cryptedData.end());
+			}
+			if (!_gcmCryptor.update(cryptedData, compressedData.data(), compressedData.size()))
+				return streamError("encryption");
+			_pending.insert(_pending.end(), cryptedData.begin(), cryptedData.end());
+			if (_bEof) {
+				if (!_gcmCryptor.finalize(cryptedData))
+					return streamError("encryption");
+				_pending.insert(_pending.end(), cryptedData.begin(), cryptedData.end());
+			}
+		} else if (crypted()) {
+			std::vector<uint8_t> cryptedData;
+			if (_bStarting) {
+				if (!_cryptor.encryptStart(cryptedData, _cryptoContext))
+					return streamError("encryption");
+				_pending.insert(_pending.end(), cryptedData.begin(), cryptedData.end());
+			}
+			if ((!compressedData.empty()) && !_cryptor.update(cryptedData, compressedData.data(), compressedData.size()))
+				return streamError("encryption");
+			_pending.insert(_pending.end(), cryptedData.begin(), cryptedData.end());
+			if (_bEof) {
+				if (!_cryptor.finalize(cryptedData))
+					return streamError("encryption");
+				_pending.insert(_pending.end(), cryptedData.begin(), cryptedData.end());
+			}
+		} else
+			_pending.insert(_pending.end(), compressedData.begin(), compressedData.end());
+		_bStarting = false;
+	}
+
+	const std::size_t n = std::min(size, _pending.size() - _pendingPos);
+	memcpy(pDst, _pending.data() + _pendingPos, n);
+	_md5EncComputer.feed(pDst, n);
+	_pendingPos += n;
+
+	_bDone = _bEof && (_pendingPos == _pending.size());
+	return n;
+}
+
+// aborts the transfer, nothing partial must be stored as the object
+size_t CUploader::streamError(const char * what)
+{
+	LOGE("{} error uploading '{}'", what, _crt->getRelativePath().string());
+	_bStreamError = true;
+	_bDone = true;
+	return CURL_READFUNC_ABORT;
+}
+
+// the decision is taken on the first block of the file
+bool CUploader::isCompressible(CAsset * p)
+{
+	if (_ctx._options->_compressLevel == 0)
+		return false;
+
+	if (!_cachedData.empty())
+		return CCompressor::isCompressible(_cachedData.data(), std::min(_cachedData.size(), compressSampleSize), _ctx._options->_compressLevel);
+
+	std::string sample;
+	if (!CFileReader::readFile(p->getFullPath().string(), sample, _ctx._options->_cacheMode, compressSampleSize))
+		return false;
+
+	return CCompressor::isCompressible(sample.data(), sample.size(), _ctx._options->_compressLevel);
+}
+
+// the plain content md5 and length are set as soon as the stored data differs
+static void addMetaDatasToRequest(CRequest & r, CAsset * p, bool crypted, bool compressed, bool gcm)
 {
-	if (crypted) {
+	if (crypted || compressed) {
 		r.addHeader(metaUncryptedMd5, p->getSrcHash()._md5.hex());
 		r.addHeader(metaUncryptedLen, fmt::format("{}", p->getSrcHash()._len));
-		r.addHeader(metaCryptoKey   , COptions::get()->_cryptoKey.hex());
 	}
+	if (crypted)
+		r.addHeader(metaCryptoKey   , COptions::get()->_cryptoKey.hex());
+	if (gcm)
+		r.addHeader(metaCryptFormat , "gcm1");
+	if (compressed)
+		r.addHeader(metaCompression , "gzip");
 	r.addHeader( metaLastModificationDate, fmt::format("{}", p->getLocalLastModifTime() ));
 }
 
@@ -141,18 +264,149 @@ bool CUploader::checkMd5(const std::string & url)
 		assert( _crt->getSrcHash()._md5.isValid() );
 	}
 	
-	const auto expected = (crypted()) ? _md5EncComputer.getDigest() : _crt->getSrcHash()._md5;
-	_rq.addHeader(headerAuthToken, _ctx._cr.token());
+	const auto expected = (crypted() || _bCompressing) ? _md5EncComputer.getDigest() : _crt->getSrcHash()._md5;
+	_rq.setHeaders(_ctx._credentials.authHeaders());
 	_rq.head(url);
 	return (NMD5::CDigest::fromString(_rq.getResponseHeaderField("Etag")) == expected);
 }
 
 
 
+// the md5 of a whole file, with the reader of the uploads
+bool CUploader::readMd5(const std::string & path, NMD5::CDigest & md5)
+{
+	const int slot = _reader.open(path);
+	if (slot < 0)
+		return false;
+
+	NMD5::CComputer c;
+	c.init();
+	bool bRes(true);
+	while (bRes && !_reader.eof(slot))
+	{
+		const uint8_t * data(nullptr);
+		std::size_t readed(0);
+		bRes = _reader.next(slot, data, readed);
+		if (bRes && readed)
+			c.feed(data, readed);
+	}
+	c.done();
+	_reader.close(slot);
+	md5 = c.getDigest();
+	return bRes;
+}
+
+std::string CUploader::objectUrl(const bf::path & relPath) const
+{
+	return fmt::format("{}/{}/{}", _ctx._credentials.get().endpoint(), _ctx._options->_dstContainer, (_ctx._options->_dstFolder / _rq.escapePath(relPath)).string() );
+}
+
+// server side copy of an already stored object with the same content.
+// Returns false when no candidate matches, the caller uploads the file then
+bool CUploader::copy(CAsset * p)
+{
+	assert( p );
+	assert( !p->isFolder() );
+
+	// candidates are matched on the plain content md5
+	CHash hLocal = p->getSrcHash();
+	if (!hLocal._md5.isValid()) {
+		uint64_t sz(0);
+		if ((!NMD5::computeFileMd5(hLocal._md5, p->getFullPath().string(), &sz)) || (sz != hLocal._len))
+			return false;
+		p->setSrcHash(hLocal);
+	}
+
+	CRequest rq(_ctx._options->_curlVerbose);
+	const std::string url= objectUrl(p->getRelativePath());
+	std::size_t headCount(0);
+	for (const auto & s : p->getCopySources())
+	{
+		bool bCompressed(false), bGcm(false);
+		if (!crypted()) {
+			if (s._etag != hLocal._md5)
+				continue;
+
+		} else {
+			// the plain md5 and the key are only known from the candidate metadatas
+			if (headCount++ >= copyMaxCandidates)
+				break;
+
+			rq.setHeaders(_ctx._credentials.authHeaders());
+			rq.head(objectUrl(s._path));
+			if ((rq.getHttpResponseCode() != 200) ||
+				(NMD5::CDigest::fromString(rq.getResponseHeaderField(metaUncryptedMd5)) != hLocal._md5) ||
+				(static_cast<uint64_t>(atoll(rq.getResponseHeaderField(metaUncryptedLen).c_str())) != hLocal._len) ||
+				(NMD5::CDigest::fromString(rq.getResponseHeaderField(metaCryptoKey)) != _ctx._options->_cryptoKey))
+				continue;
+			bCompressed = !rq.getResponseHeaderField(metaCompression).empty();
+			bGcm = (rq.getResponseHeaderField(metaCryptFormat) == "gcm1");
+		}
+
+		LOGD("copying '{}' from '{}'", p->getRelativePath().string(), s._path.string());
+		rq.setHeaders(_ctx._credentials.authHeaders());
+		rq.addHeader("X-Copy-From", fmt::format("/{}/{}", _ctx._options->_dstContainer, (_ctx._options->_dstFolder / rq.escapePath(s._path)).string()));
+		rq.setopt(CURLOPT_INFILESIZE_LARGE, static_cast<curl_off_t>(0));
+		rq.put(url);
+		rq.setopt(CURLOPT_INFILESIZE_LARGE, static_cast<curl_off_t>(-1));
+
+		if (rq.getHttpResponseCode() != 201) {
+			LOGW("Server side copy of '{}' failed [http response : {}]", url, rq.getHttpResponseCode());
+			return false;
+		}
+
+		// the source may have been replaced since it was listed
+		if (NMD5::CDigest::fromString(rq.getResponseHeaderField("Etag")) != s._etag) {
+			LOGW("Server side copy of '{}' : etag mismatch got '{}' != expected '{}'", url, rq.getResponseHeaderField("Etag"), s._etag.hex());
+			return false;
+		}
+
+		// update meta datas
+		rq.setHeaders(_ctx._credentials.authHeaders());
+		addMetaDatasToRequest(rq, p, crypted(), bCompressed, bGcm );
+		rq.setPostData("");
+		rq.post(url);
+		if ((rq.getHttpResponseCode() / 100) != 2) {
+			LOGW("Can't update meta datas of '{}' [http response : {}]", url, rq.getHttpResponseCode());
+			return false;
+		}
+
+		LOGD("'{}' copied Ok.", url );
+		return true;
+	}
+
+	return false;
+}
+
+// other link of a file : a copy of the object of its first link, stored or
+// found up to date in this run. Same inode, so the copied metadatas (md5,
+// size, key, modification date) hold for it too
+bool CUploader::link(CAsset * p)
+{
+	assert( p );
+	const CAsset * primary = p->getLinkPrimary();
+	assert( primary && primary->isStored() );
+
+	CRequest rq(_ctx._options->_curlVerbose);
+	const std::string url= objectUrl(p->getRelativePath());
+	rq.setHeaders(_ctx._credentials.authHeaders());
+	rq.addHeader("X-Copy-From", fmt::format("/{}/{}", _ctx._options->_dstContainer, (_ctx._options->_dstFolder / rq.escapePath(primary->getRelativePath())).string()));
+	rq.addHeader(metaLastModificationDate, fmt::format("{}", p->getLocalLastModifTime()));
+	rq.setopt(CURLOPT_INFILESIZE_LARGE, static_cast<curl_off_t>(0));
+	rq.put(url);
+	rq.setopt(CURLOPT_INFILESIZE_LARGE, static_cast<curl_off_t>(-1));
+
+	if (rq.getHttpResponseCode() != 201) {
+		LOGW("Server side copy of '{}' from its hard link failed [http response : {}]", url, rq.getHttpResponseCode());
+		return false;
+	}
+	return true;
+}
+
 CUploader::result_code CUploader::upload(CAsset * p)
 {
 	assert(_crt == nullptr);
-	assert(_f == nullptr);
+	assert(_slot < 0);
 
 	assert( p );
 	assert( !p->isFolder() );
@@ -164,36 +418,67 @@ CUploader::result_code CUploader::upload(CAsset * p)
 	_crt = p;
 	_totalReaded= _totalUploaded= 0;
 	_bStarting = true;
-	_bDone = false;
+	_bDone = _bEof = _bStreamError = false;
+	_pending.clear();
+	_pendingPos = 0;
 	
+	_slot = _ctx._readCache.open(_reader, p, _cachedData);
+	if (_slot < 0) {
+		LOGE("file open error '{}'", p->getFullPath());
+		_crt = nullptr;
+		return resError;
+	}
+	_bCompressing = isCompressible(p) && _compressor.start(_ctx._options->_compressLevel);
+
+	// crypted or compressed, the plain md5 is a metadata sent before the data.
+	// Not known yet (changed content with --fingerprint-fast, resumed upload) :
+	// from the kept content, else the file is read once more for it
+	if ((!hLocal._md5.isValid()) && (crypted() || _bCompressing)) {
+		if (!_cachedData.empty())
+			hLocal._md5 = NMD5::computeMd5(_cachedData);
+
+		else {
+			_reader.close(_slot);
+			_slot = -1;
+			if (readMd5(p->getFullPath().string(), hLocal._md5))
+				_slot = _reader.open(p->getFullPath().string());
+			if (_slot < 0) {
+				LOGE("file read error '{}'", p->getFullPath());
+				_crt = nullptr;
+				return resError;
+			}
+		}
+		hLocal._computed = true;
+		p->setSrcHash(hLocal);
+	}
+
 	if (!hLocal._md5.isValid())
 		_md5Computer.init();
-	
-	if (crypted()) {
+	if (crypted() || _bCompressing)
 		_md5EncComputer.init();
-		
+	
+	if (crypted() && !gcm()) {
 		assert( _cryptoContext == nullptr );
 		// create one context for each upload so the salt will be regenerated !
 		_cryptoContext = CCryptoContext::create(_ctx._options->_cryptoPassword);
 	}
 	
-	_rq.addHeader(headerAuthToken, _ctx._cr.token());
-	_rq.addHeader(metaVersion, HUBACK_VERSION);
+	_rq.setHeaders(_ctx._credentials.uploadHeaders());
 	
-	if (crypted())
+	// the body is streamed chunked : it ends where the file ends, even if it
+	// changed since the listing. No Content-Length with it (proxies reject both)
+	if (crypted() || _bCompressing)
 		_rq.addHeader("Content-Type", "application/octet-stream");
 	
-	else
-		_rq.addHeader("Content-Length", fmt::format("{}", hLocal._len));
-	
-	const std::string url= fmt::format("{}/{}/{}", _ctx._cr.endpoint(), _ctx._options->_dstContainer, (_ctx._options->_dstFolder / _rq.escapePath(p->getRelativePath())).string() );
+	const std::string url= objectUrl(p->getRelativePath());
 
-	addMetaDatasToRequest(_rq, p, crypted() );
+	addMetaDatasToRequest(_rq, p, crypted(), _bCompressing, gcm() );
+	_rq.setExpectedBodySize(hLocal._len);
 	_rq.setopt(CURLOPT_READDATA, this);
 	_rq.setopt(CURLOPT_READFUNCTION, CUploader::_rdd);
-	_f = fopen(p->getFullPath().c_str(), "rb");
-	_rq.put(url);
-	fclose(_f); _f = nullptr;
+	const CURLcode res = _rq.put(url);
+	_reader.close(_slot); _slot = -1;
+	std::string().swap(_cachedData);
 	
 	if (_md5Computer.isInitialised()) {
 		_md5Computer.done();
@@ -207,12 +492,29 @@ CUploader::result_code CUploader::upload(CAsset * p)
 	if (_cryptoContext) {
 		delete _cryptoContext;
 		_cryptoContext = nullptr;
+	}
 
+	if (crypted() || _bCompressing)
 		_md5EncComputer.done();
+	if (crypted())
 		LOGI("md5 encrypted '{}' = '{}'", _crt->getRelativePath().string(), _md5EncComputer.getDigest().hex());
-	}
+
+	if (_bCompressing)
+		LOGD("'{}' compressed : {} -> {} bytes", _crt->getRelativePath().string(), hLocal._len, _totalUploaded);
 
 	
+	if (_bStreamError) {
+		_crt = nullptr;
+		return resError;
+	}
+
+	// the connection died and curl can't replay a streamed body : start over
+	if ((res == CURLE_SEND_FAIL_REWIND) || (res == CURLE_HTTP2) || (res == CURLE_HTTP2_STREAM)) {
+		_crt = nullptr;
+		LOGW("Connection lost uploading '{}' [will retry]", url);
+		return resRetry;
+	}
+
 	if (_rq.getHttpResponseCode() != 201)
 	{
 		_crt = nullptr;
@@ -220,6 +522,11 @@ CUploader::result_code CUploader::upload(CAsset * p)
 			LOGW("Server internal error (500) uploading '{}' [will retry]", url);
 			return resRetry;
 		}
+
+		if (_rq.getHttpResponseCode() == 401) {
+			LOGW("Token rejected (401) uploading '{}' [will retry]", url);
+			return resRetry;
+		}
 	
 		LOGE("Error uploading '{}' [http response : {}]", url, _rq.getHttpResponseCode());
 		return resError;
@@ -234,7 +541,7 @@ CUploader::result_code CUploader::upload(CAsset * p)
 		std::this_thread::sleep_for(std::chrono::seconds(5));
 		if (!checkMd5(url)) {
 			LOGE("Error uploading encrypted {}", url);
-			LOGE("md5 mismatch got '{}' != expected '{}'", _rq.getResponseHeaderField("Etag"), (crypted() ? _md5EncComputer.getDigest().hex() : _md5Computer.getDigest().hex()));
+			LOGE("md5 mismatch got '{}' != expected '{}'", _rq.getResponseHeaderField("Etag"), ((crypted() || _bCompressing) ? _md5EncComputer.getDigest().hex() : _md5Computer.getDigest().hex()));
 			LOGE("http response : {}", _rq.getHeaderResponse());
 			_crt = nullptr;
 			return resError;
@@ -242,8 +549,8 @@ CUploader::result_code CUploader::upload(CAsset * p)
 	}
 
 	// update meta datas
-	_rq.addHeader(headerAuthToken, _ctx._cr.token());
-	addMetaDatasToRequest(_rq, p, crypted() );
+	_rq.setHeaders(_ctx._credentials.authHeaders());
+	addMetaDatasToRequest(_rq, p, crypted(), _bCompressing, gcm() );
 	_rq.post(url);
 	
 	LOGD("'{}' uploaded Ok.", url );
@@ -25,7 +25,9 @@
 #pragma once
 
 #include "context.h"
+#include "compressor.h"
 #include "crypto.h"
+#include "cryptGcm.h"
 #include "request.h"
 
 //- /////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -44,13 +46,21 @@ public:
 	CUploader(CContext & ctx);
 	~CUploader();
 	result_code upload(CAsset * p);
+	bool copy(CAsset * p);
+	bool link(CAsset * p);
 	uint64_t uploadedByteCount() const { return _totalUploaded; }
 
 private:
 	bool crypted() const { return _ctx._options->crypted(); }
+	bool gcm() const { return crypted() && (_ctx._options->_cryptFormat == ECryptFormat::gcm); }
 	static size_t _rdd(void *ptr, size_t size, size_t nmemb, void *uploader);
 	size_t rdd(uint8_t *pDst, size_t size, size_t nmemb);
+	size_t rddBuffered(uint8_t *pDst, size_t size);
+	size_t streamError(const char * what);
+	bool isCompressible(CAsset * p);
 	bool checkMd5(const std::string & url);
+	bool readMd5(const std::string & path, NMD5::CDigest & md5);
+	std::string objectUrl(const bf::path & relPath) const;
 
 
 private:
@@ -58,16 +68,25 @@ private:
 	CAsset      * _crt;
 	CCryptEngine  _cryptor;
 	std::vector<uint8_t> _cryptedData;
+	CGcmCryptEngine _gcmCryptor;
+	CCompressor   _compressor;
+	bool          _bCompressing;
+	std::vector<uint8_t> _pending; // compressed (and crypted) data not sent yet
+	std::string   _cachedData; // content kept by the md5 pass (--read-cache)
+	std::size_t   _pendingPos;
 	
 	NMD5::CComputer _md5Computer;
-	NMD5::CComputer _md5EncComputer;
+	NMD5::CComputer _md5EncComputer; // sent data, when crypted or compressed
 
-	FILE    * _f;
+	CFileReader _reader;
+	int       _slot;
 	uint64_t  _totalReaded; // for encryption progress
 	uint64_t  _totalUploaded;
 
 	bool _bStarting;
 	bool _bDone;
+	bool _bEof; // file read, compressed data may remain to be sent
+	bool _bStreamError; // compression or encryption failed : the upload was aborted
 	
 	CCryptoContext * _cryptoContext;
 	
@@ -0,0 +1,154 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "xxh64.h"
+#include <cstring>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static constexpr uint64_t prime1 = 11400714785074694791ULL;
+static constexpr uint64_t prime2 = 14029467366897019727ULL;
+static constexpr uint64_t prime3 =  1609587929392839161ULL;
+static constexpr uint64_t prime4 =  9650029242287828579ULL;
+static constexpr uint64_t prime5 =  2870177450012600261ULL;
+
+static inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+// little endian reads, whatever the host
+static inline uint64_t read64(const uint8_t * p)
+{
+	uint64_t v;
+	memcpy(&v, p, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+static inline uint32_t read32(const uint8_t * p)
+{
+	uint32_t v;
+	memcpy(&v, p, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+
+static inline uint64_t round(uint64_t acc, uint64_t input)
+{
+	acc += input * prime2;
+	acc  = rotl(acc, 31);
+	return acc * prime1;
+}
+
+static inline uint64_t mergeRound(uint64_t acc, uint64_t v)
+{
+	acc ^= round(0, v);
+	return acc * prime1 + prime4;
+}
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint64_t CXxh64::compute(const void * p, std::size_t len, uint64_t seed)
+{
+	CXxh64 h(seed);
+	h.feed(p, len);
+	return h.digest();
+}
+
+CXxh64::CXxh64(uint64_t seed)
+:	_seed(seed)
+,	_total(0)
+,	_memSize(0)
+{
+	_v[0] = seed + prime1 + prime2;
+	_v[1] = seed + prime2;
+	_v[2] = seed;
+	_v[3] = seed - prime1;
+}
+
+void CXxh64::feed(const void * src, std::size_t len)
+{
+	const uint8_t * p = reinterpret_cast<const uint8_t*>(src);
+	const uint8_t * const end = p + len;
+	_total += len;
+
+	// complete the 32 bytes stripe of the previous feed first
+	if (_memSize + len < 32) {
+		memcpy(_mem + _memSize, p, len);
+		_memSize += len;
+		return;
+	}
+	if (_memSize) {
+		memcpy(_mem + _memSize, p, 32 - _memSize);
+		p += 32 - _memSize;
+		for (int i = 0; i < 4; i++)
+			_v[i] = round(_v[i], read64(_mem + 8 * i));
+		_memSize = 0;
+	}
+
+	uint64_t v0 = _v[0], v1 = _v[1], v2 = _v[2], v3 = _v[3];
+	for (; p + 32 <= end; p += 32) {
+		v0 = round(v0, read64(p +  0));
+		v1 = round(v1, read64(p +  8));
+		v2 = round(v2, read64(p + 16));
+		v3 = round(v3, read64(p + 24));
+	}
+	_v[0] = v0; _v[1] = v1; _v[2] = v2; _v[3] = v3;
+
+	_memSize = end - p;
+	memcpy(_mem, p, _memSize);
+}
+
+uint64_t CXxh64::digest() const
+{
+	uint64_t h;
+	if (_total >= 32) {
+		h = rotl(_v[0], 1) + rotl(_v[1], 7) + rotl(_v[2], 12) + rotl(_v[3], 18);
+		for (int i = 0; i < 4; i++)
+			h = mergeRound(h, _v[i]);
+	} else
+		h = _seed + prime5;
+
+	h += _total;
+
+	const uint8_t * p = _mem;
+	const uint8_t * const end = _mem + _memSize;
+	for (; p + 8 <= end; p += 8)
+		h = rotl(h ^ round(0, read64(p)), 27) * prime1 + prime4;
+	if (p + 4 <= end) {
+		h = rotl(h ^ (read32(p) * prime1), 23) * prime2 + prime3;
+		p += 4;
+	}
+	for (; p < end; p++)
+		h = rotl(h ^ (*p * prime5), 11) * prime1;
+
+	h ^= h >> 33;
+	h *= prime2;
+	h ^= h >> 29;
+	h *= prime3;
+	h ^= h >> 32;
+	return h;
+}
@@ -0,0 +1,53 @@
+/*************************************************************************/
+/* hubic-backup - an fast and easy to use hubic backup CLI tool          */
+/* Copyright (c) 2015 Franck Chopin.                                     */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+
+//- /////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// xxh64, the non cryptographic hash of --fingerprint-fast. Several GB/s on
+// one core : the local change detection runs at disk speed
+
+class CXxh64
+{
+public:
+	static uint64_t compute(const void * p, std::size_t len, uint64_t seed = 0);
+
+public:
+	CXxh64(uint64_t seed = 0);
+
+public:
+	void feed(const void * p, std::size_t len);
+	uint64_t digest() const;
+
+private:
+	uint64_t    _seed;
+	uint64_t    _v[4];
+	uint64_t    _total;
+	uint8_t     _mem[32];
+	std::size_t _memSize;
+};